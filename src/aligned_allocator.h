@@ -0,0 +1,85 @@
+/**
+    @file   aligned_allocator.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::AlignedAllocator class.
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace kuu
+{
+
+/**
+    @brief   An allocator that aligns the memory to the given boundary.
+
+    @details The block is over-allocated with malloc and the pointer
+             to the start of the block is stored just before the
+             aligned memory. The alignment must be a power of two.
+
+    @code
+    std::vector<glm::vec4, AlignedAllocator<glm::vec4, 16>> positions;
+    @endcode
+ **/
+template<typename T, size_t Alignment>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() {}
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    /**
+        Allocates memory for n objects.
+     **/
+    T* allocate(size_t n)
+    {
+        const size_t bytes = n * sizeof(T) + Alignment + sizeof(void*);
+        void* block = std::malloc(bytes);
+        if (!block)
+            throw std::bad_alloc();
+
+        uintptr_t p = reinterpret_cast<uintptr_t>(block) + sizeof(void*);
+        p = (p + Alignment - 1) & ~uintptr_t(Alignment - 1);
+        reinterpret_cast<void**>(p)[-1] = block;
+        return reinterpret_cast<T*>(p);
+    }
+
+    /**
+        Frees the memory returned by @ref allocate.
+     **/
+    void deallocate(T* p, size_t /*n*/)
+    {
+        if (p)
+            std::free(reinterpret_cast<void**>(p)[-1]);
+    }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&,
+                const AlignedAllocator<U, Alignment>&)
+{ return true; }
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&,
+                const AlignedAllocator<U, Alignment>&)
+{ return false; }
+
+/**
+    A vector whose items start at a 16-byte boundary.
+ **/
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 16>>;
+
+} // namespace kuu
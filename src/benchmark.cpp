@@ -0,0 +1,477 @@
+/**
+    @file   benchmark.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Headless benchmark of the rendering thread and the frame
+            presentation.
+
+    The benchmark drives the rendering thread and presents its frames
+    into a framebuffer on the main thread, the same way the widget
+    does but without a window. The results are written as JSON.
+
+    The average cache miss ratio (ACMR) of a mesh is reported before
+    and after the vertex cache optimization. The mesh is a mesh file
+    given with --mesh or a grid with triangles in row order.
+
+    @code
+    QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1 \
+        qopenglwidget-bench --frames 1000 --present both
+    @endcode
+ **/
+
+#include "mesh_optimizer.h"
+#include "opengl_mesh_file.h"
+#include "opengl_rendering_thread.h"
+#include "opengl_state_cache.h"
+#include "opengl_viewport_target.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <QtCore/QCommandLineParser>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFramebufferObject>
+
+namespace
+{
+
+using namespace kuu;
+using namespace kuu::opengl;
+
+using Clock = std::chrono::steady_clock;
+
+/* ---------------------------------------------------------------- *
+   Returns the duration in milliseconds.
+ * ---------------------------------------------------------------- */
+double milliseconds(Clock::duration elapsed)
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::milli>>(elapsed).count();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the nearest-rank percentile of the samples.
+ * ---------------------------------------------------------------- */
+double percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0.0;
+
+    std::sort(samples.begin(), samples.end());
+    size_t rank = size_t(p / 100.0 * samples.size() + 0.5);
+    rank = std::min(std::max(rank, size_t(1)), samples.size());
+    return samples[rank - 1];
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the summary of the samples as JSON object.
+ * ---------------------------------------------------------------- */
+std::string summary(const std::vector<double>& samples)
+{
+    double mean = 0.0;
+    for (double sample : samples)
+        mean += sample;
+    if (!samples.empty())
+        mean /= samples.size();
+
+    std::ostringstream json;
+    json << "{ \"mean\": " << mean
+         << ", \"p50\": "  << percentile(samples, 50.0)
+         << ", \"p95\": "  << percentile(samples, 95.0)
+         << ", \"p99\": "  << percentile(samples, 99.0)
+         << " }";
+    return json.str();
+}
+
+/* ---------------------------------------------------------------- *
+   Benchmark settings.
+ * ---------------------------------------------------------------- */
+struct Settings
+{
+    QSize size = QSize(720, 576);
+    int warmupFrames = 60;
+    int frames = 1000;
+    int quads = 1;
+    QString mesh; // mesh file of the ACMR measurement
+    FramePacer::Settings framePacing;
+};
+
+/* ---------------------------------------------------------------- *
+   Vertex cache efficiency of a mesh.
+ * ---------------------------------------------------------------- */
+struct MeshResult
+{
+    std::string mesh;
+    double acmrBefore = 0.0;
+    double acmrAfter  = 0.0;
+};
+
+/* ---------------------------------------------------------------- *
+   Benchmark result of a single presentation mode.
+ * ---------------------------------------------------------------- */
+struct Result
+{
+    std::string presentMode;
+    double seconds = 0.0;
+    int frames = 0;
+    std::vector<double> frameTimes;   // between rendered frames
+    std::vector<double> acquireTimes; // UI wait for the frame
+    std::vector<double> presentTimes; // UI present CPU time
+    RenderingThread::Stats stats;     // thread statistics at the end
+};
+
+/* ---------------------------------------------------------------- *
+   Measures the ACMR of the mesh file before and after the vertex
+   cache optimization. Without a file a grid mesh is measured.
+ * ---------------------------------------------------------------- */
+bool measureMesh(const QString& path, MeshResult& result)
+{
+    std::vector<unsigned int> indices;
+    int vertexCount = 0;
+    if (path.isEmpty())
+    {
+        // Rows of triangles, the vertices of the previous row are
+        // out of the cache when the next row is rendered.
+        const int size = 256;
+        for (int y = 0; y < size - 1; ++y)
+        {
+            for (int x = 0; x < size - 1; ++x)
+            {
+                const unsigned int i = unsigned(y * size + x);
+                const unsigned int quad[6] =
+                { i, i + 1, i + size + 1, i + size + 1, i + size, i };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        vertexCount = size * size;
+        result.mesh = "grid";
+    }
+    else
+    {
+        MeshFile file;
+        if (!file.open(path))
+            return false;
+
+        const MeshFile::Content& c = file.content();
+        if (c.indexType == GL_UNSIGNED_SHORT)
+        {
+            const uint16_t* data =
+                static_cast<const uint16_t*>(c.indexData);
+            indices.assign(data, data + c.indexCount);
+        }
+        else
+        {
+            const uint32_t* data =
+                static_cast<const uint32_t*>(c.indexData);
+            indices.assign(data, data + c.indexCount);
+        }
+        vertexCount = c.vertexCount;
+        result.mesh = path.toStdString();
+    }
+
+    result.acmrBefore = MeshOptimizer::acmr(indices, vertexCount);
+    MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+    result.acmrAfter  = MeshOptimizer::acmr(indices, vertexCount);
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Runs the rendering thread and presents its frames into the target
+   framebuffer until the wanted count of frames has been rendered.
+   The context must be current.
+ * ---------------------------------------------------------------- */
+Result run(QOpenGLContext* context,
+           ViewportTarget::PresentMode presentMode,
+           const Settings& settings)
+{
+    Result result;
+    result.presentMode =
+        presentMode == ViewportTarget::PresentMode::Blit ? "blit"
+                                                         : "draw";
+
+    QOpenGLFramebufferObjectFormat targetFormat;
+    targetFormat.setAttachment(
+        QOpenGLFramebufferObject::CombinedDepthStencil);
+    QOpenGLFramebufferObject target(settings.size, targetFormat);
+
+    StateCache::current().invalidate();
+    ViewportTarget viewportTarget;
+    viewportTarget.setPresentMode(presentMode);
+
+    // Time stamps of rendered frames, written by the thread.
+    const int totalFrames = settings.warmupFrames + settings.frames;
+    std::vector<Clock::time_point> frameStamps(totalFrames);
+    std::atomic<int> renderedFrames(0);
+
+    RenderingThread thread(context, settings.size, [&]()
+    {
+        const int i = renderedFrames.load();
+        if (i < totalFrames)
+            frameStamps[i] = Clock::now();
+        renderedFrames.store(i + 1);
+    });
+    thread.framePacer()->setSettings(settings.framePacing);
+    thread.setQuadCount(settings.quads);
+    thread.start();
+
+    const glm::ivec2 targetSize(settings.size.width(),
+                                settings.size.height());
+    uint64_t presentedFrame = 0;
+    while (renderedFrames.load() < totalFrames)
+    {
+        KUU_TRACE_SCOPE("present");
+
+        const Clock::time_point acquireStart = Clock::now();
+        const SwapChain::Frame frame = thread.acquireFrame();
+        const Clock::time_point acquireEnd = Clock::now();
+
+        if (frame.texture == 0 || frame.number == presentedFrame)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        target.bind();
+        glViewport(0, 0, targetSize.x, targetSize.y);
+        viewportTarget.render(
+            frame.texture,
+            glm::ivec2(frame.size.width(), frame.size.height()),
+            glm::ivec2(frame.textureSize.width(),
+                       frame.textureSize.height()),
+            target.handle(),
+            targetSize);
+        thread.releaseFrame();
+        target.release();
+        const Clock::time_point presentEnd = Clock::now();
+
+        presentedFrame = frame.number;
+        thread.framePacer()->framePresented(frame.number);
+
+        if (renderedFrames.load() > settings.warmupFrames)
+        {
+            result.acquireTimes.push_back(
+                milliseconds(acquireEnd - acquireStart));
+            result.presentTimes.push_back(
+                milliseconds(presentEnd - acquireEnd));
+        }
+    }
+
+    result.stats = thread.stats();
+    thread.stop();
+    thread.quit();
+    thread.wait();
+    glFinish();
+
+    // Frame times of the measured frames.
+    for (int i = settings.warmupFrames + 1; i < totalFrames; ++i)
+        result.frameTimes.push_back(
+            milliseconds(frameStamps[i] - frameStamps[i - 1]));
+    result.frames  = settings.frames;
+    result.seconds = milliseconds(frameStamps[totalFrames - 1] -
+                                  frameStamps[settings.warmupFrames])
+                     / 1000.0;
+    return result;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    // Run headless unless the platform is explicitly set.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+
+    // Parse the command line options.
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Headless benchmark of the QOpenGLWidget multithread example");
+    parser.addHelpOption();
+
+    QCommandLineOption framesOption(
+        "frames", "Count of measured frames.", "count", "1000");
+    QCommandLineOption warmupOption(
+        "warmup", "Count of frames before measuring.", "count", "60");
+    QCommandLineOption sizeOption(
+        "size", "Framebuffer size.", "WxH", "720x576");
+    QCommandLineOption presentOption(
+        "present",
+        "Frame presentation mode: draw, blit or both (default).",
+        "mode", "both");
+    QCommandLineOption framesInFlightOption(
+        "max-frames-in-flight",
+        "Maximum count of frames rendered ahead of presentation, "
+        "0 for unlimited.",
+        "count", "2");
+    QCommandLineOption quadsOption(
+        "quads", "Count of rendered quads.", "count", "1");
+    QCommandLineOption meshOption(
+        "mesh", "Mesh file of the ACMR measurement, a grid by default.",
+        "file");
+    QCommandLineOption traceOption(
+        "trace", "Write a Chrome trace event timeline of the threads.",
+        "file");
+    QCommandLineOption outputOption(
+        "output", "Output JSON file, standard output by default.",
+        "file");
+    parser.addOption(framesOption);
+    parser.addOption(warmupOption);
+    parser.addOption(sizeOption);
+    parser.addOption(presentOption);
+    parser.addOption(framesInFlightOption);
+    parser.addOption(quadsOption);
+    parser.addOption(meshOption);
+    parser.addOption(traceOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    Settings settings;
+    settings.frames       = std::max(parser.value(framesOption).toInt(), 2);
+    settings.warmupFrames = std::max(parser.value(warmupOption).toInt(), 0);
+    const QStringList size = parser.value(sizeOption).split('x');
+    if (size.size() == 2)
+        settings.size = QSize(std::max(size[0].toInt(), 1),
+                              std::max(size[1].toInt(), 1));
+    settings.quads        = std::max(parser.value(quadsOption).toInt(), 1);
+    settings.mesh         = parser.value(meshOption);
+    settings.framePacing.policy = FramePacer::Policy::Unlocked;
+    settings.framePacing.maxFramesInFlight =
+        parser.value(framesInFlightOption).toInt();
+
+    std::vector<ViewportTarget::PresentMode> presentModes;
+    const QString present = parser.value(presentOption);
+    if (present != "blit")
+        presentModes.push_back(ViewportTarget::PresentMode::Draw);
+    if (present != "draw")
+        presentModes.push_back(ViewportTarget::PresentMode::Blit);
+
+    if (parser.isSet(traceOption))
+    {
+        Trace::setEnabled(true);
+        Trace::setThreadName("Presenting thread");
+    }
+
+    // Create the context of the presenting thread.
+    QSurfaceFormat format;
+    format.setDepthBufferSize(16);
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create())
+    {
+        std::cerr << "Failed to create OpenGL context" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+
+    if (!context.makeCurrent(&surface))
+    {
+        std::cerr << "Failed to make OpenGL context current"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+#ifdef _WIN32
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
+    {
+        std::cerr << "Failed to initialize GLEW." << std::endl;
+        return EXIT_FAILURE;
+    }
+#endif
+
+    const std::string renderer = (const char*) glGetString(GL_RENDERER);
+    const std::string version  = (const char*) glGetString(GL_VERSION);
+
+    MeshResult meshResult;
+    if (!measureMesh(settings.mesh, meshResult))
+        return EXIT_FAILURE;
+
+    // Run the benchmark for each presentation mode.
+    std::vector<Result> results;
+    for (ViewportTarget::PresentMode presentMode : presentModes)
+        results.push_back(run(&context, presentMode, settings));
+
+    context.doneCurrent();
+
+    if (parser.isSet(traceOption) &&
+        !Trace::write(parser.value(traceOption).toStdString()))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Write the results.
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"renderer\": \"" << renderer << "\",\n"
+         << "  \"version\": \""  << version  << "\",\n"
+         << "  \"size\": [" << settings.size.width() << ", "
+                            << settings.size.height() << "],\n"
+         << "  \"frames\": " << settings.frames << ",\n"
+         << "  \"quads\": "  << settings.quads  << ",\n"
+         << "  \"acmr\": { \"mesh\": \"" << meshResult.mesh
+            << "\", \"before\": " << meshResult.acmrBefore
+            << ", \"after\": "   << meshResult.acmrAfter << " },\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        const double fps = r.seconds > 0.0 ? (r.frames - 1) / r.seconds
+                                           : 0.0;
+        json << "    {\n"
+             << "      \"present_mode\": \"" << r.presentMode << "\",\n"
+             << "      \"fps\": " << fps << ",\n"
+             << "      \"frame_time_ms\": "
+                << summary(r.frameTimes) << ",\n"
+             << "      \"acquire_wait_ms\": "
+                << summary(r.acquireTimes) << ",\n"
+             << "      \"present_ms\": "
+                << summary(r.presentTimes) << ",\n"
+             << "      \"stage_ms\": { "
+                << "\"cpu_frame\": "   << r.stats.cpuFrame
+                << ", \"cpu_update\": " << r.stats.cpuUpdate
+                << ", \"cpu_render\": " << r.stats.cpuRender
+                << ", \"gpu_clear\": "  << r.stats.gpuClear
+                << ", \"gpu_render\": " << r.stats.gpuRender
+                << " }\n"
+             << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n"
+         << "}\n";
+
+    if (parser.isSet(outputOption))
+    {
+        std::ofstream file(
+            parser.value(outputOption).toLocal8Bit().constData());
+        if (!file)
+        {
+            std::cerr << "Failed to open output file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        file << json.str();
+    }
+    else
+    {
+        std::cout << json.str();
+    }
+
+    return EXIT_SUCCESS;
+}
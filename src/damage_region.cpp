@@ -0,0 +1,191 @@
+/**
+    @file   damage_region.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::DamageRegion class.
+ **/
+
+#include "damage_region.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+namespace kuu
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Returns the count of pixels in the rectangle.
+ * ---------------------------------------------------------------- */
+long long rectArea(const QRect& r)
+{
+    return r.isEmpty() ? 0 : (long long) r.width() * r.height();
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+DamageRegion::DamageRegion(const QSize& bounds, int maxRects)
+    : bounds_(bounds)
+    , maxRects_(std::max(maxRects, 1))
+{}
+
+/* ---------------------------------------------------------------- */
+
+void DamageRegion::add(const QRect& rect)
+{
+    if (full_)
+        return;
+
+    const QRect frame(QPoint(0, 0), bounds_);
+    const QRect r = bounds_.isValid() ? rect.intersected(frame) : rect;
+    if (r.isEmpty())
+        return;
+
+    if (bounds_.isValid() && r.contains(frame))
+    {
+        addAll();
+        return;
+    }
+
+    rects_.push_back(r);
+    mergeOverlapping(rects_.size() - 1);
+
+    // Merge the pair that grows the least until the count fits.
+    while (int(rects_.size()) > maxRects_)
+    {
+        size_t bestI = 0;
+        size_t bestJ = 1;
+        long long bestCost = LLONG_MAX;
+        for (size_t i = 0; i < rects_.size(); ++i)
+            for (size_t j = i + 1; j < rects_.size(); ++j)
+            {
+                const long long cost =
+                    rectArea(rects_[i].united(rects_[j])) -
+                    rectArea(rects_[i]) - rectArea(rects_[j]);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestI = i;
+                    bestJ = j;
+                }
+            }
+
+        rects_[bestI] = rects_[bestI].united(rects_[bestJ]);
+        rects_.erase(rects_.begin() + bestJ);
+        mergeOverlapping(bestI);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void DamageRegion::add(const std::vector<QRect>& rects)
+{
+    for (const QRect& r : rects)
+        add(r);
+}
+
+/* ---------------------------------------------------------------- */
+
+void DamageRegion::addAll()
+{
+    full_ = true;
+    rects_.assign(1, QRect(QPoint(0, 0), bounds_));
+}
+
+/* ---------------------------------------------------------------- */
+
+void DamageRegion::clear()
+{
+    full_ = false;
+    rects_.clear();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool DamageRegion::isEmpty() const
+{ return rects_.empty(); }
+
+/* ---------------------------------------------------------------- */
+
+bool DamageRegion::isFull() const
+{ return full_; }
+
+/* ---------------------------------------------------------------- */
+
+const std::vector<QRect>& DamageRegion::rects() const
+{ return rects_; }
+
+/* ---------------------------------------------------------------- */
+
+long long DamageRegion::area() const
+{
+    long long sum = 0;
+    for (const QRect& r : rects_)
+        sum += rectArea(r);
+    return sum;
+}
+
+/* ---------------------------------------------------------------- */
+
+QRect DamageRegion::project(const glm::mat4& clip,
+                            const glm::vec3* points,
+                            int count,
+                            const QSize& viewport)
+{
+    const QRect frame(QPoint(0, 0), viewport);
+    if (count <= 0)
+        return QRect();
+
+    glm::vec2 min( FLT_MAX);
+    glm::vec2 max(-FLT_MAX);
+    for (int i = 0; i < count; ++i)
+    {
+        const glm::vec4 p = clip * glm::vec4(points[i], 1.0f);
+        if (p.w <= 0.0f)
+            return frame;
+
+        const glm::vec2 ndc = glm::vec2(p) / p.w;
+        min = glm::min(min, ndc);
+        max = glm::max(max, ndc);
+    }
+
+    // Map into pixels and grow by a pixel to cover the pixels that
+    // the rasterizer touches at the edges.
+    const glm::vec2 size(viewport.width(), viewport.height());
+    const glm::vec2 p0 = (min * 0.5f + 0.5f) * size;
+    const glm::vec2 p1 = (max * 0.5f + 0.5f) * size;
+    const int x0 = int(std::floor(p0.x)) - 1;
+    const int y0 = int(std::floor(p0.y)) - 1;
+    const int x1 = int(std::ceil(p1.x))  + 1;
+    const int y1 = int(std::ceil(p1.y))  + 1;
+    return QRect(x0, y0, x1 - x0, y1 - y0).intersected(frame);
+}
+
+/* ---------------------------------------------------------------- */
+
+void DamageRegion::mergeOverlapping(size_t index)
+{
+    for (size_t j = 0; j < rects_.size();)
+    {
+        if (j == index || !rects_[index].intersects(rects_[j]))
+        {
+            ++j;
+            continue;
+        }
+
+        rects_[index] = rects_[index].united(rects_[j]);
+        rects_.erase(rects_.begin() + j);
+        if (j < index)
+            index--;
+        j = 0;
+    }
+}
+
+} // namespace kuu
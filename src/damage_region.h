@@ -0,0 +1,122 @@
+/**
+    @file   damage_region.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::DamageRegion class.
+ **/
+
+#pragma once
+
+#include <vector>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+namespace kuu
+{
+
+/**
+    @brief   A region of a frame that has changed.
+
+    @details The region is a short list of rectangles in framebuffer
+             pixels with the origin at the bottom-left corner. Added
+             rectangles that overlap are united. When the region has
+             more rectangles than its limit, the two rectangles whose
+             bounding rectangle adds the least area are merged, so the
+             region stays cheap to scissor while covering little more
+             than the changed pixels.
+
+             The region can also be full, e.g. when the whole frame
+             has to be repainted.
+
+    @code
+    DamageRegion damage(frameSize);
+    damage.add(previousBounds);
+    damage.add(DamageRegion::project(clip, corners, 4, frameSize));
+    for (const QRect& r : damage.rects())
+    {
+        glScissor(r.x(), r.y(), r.width(), r.height());
+        ...
+    }
+    @endcode
+ **/
+class DamageRegion
+{
+public:
+    /**
+        @brief Constructs an empty region.
+        @param bounds   The size of the frame, the rectangles are
+                        clipped to it.
+        @param maxRects The maximum count of rectangles.
+     **/
+    explicit DamageRegion(const QSize& bounds = QSize(),
+                          int maxRects = 4);
+
+    /**
+        Adds the rectangle into the region.
+     **/
+    void add(const QRect& rect);
+
+    /**
+        Adds the rectangles into the region.
+     **/
+    void add(const std::vector<QRect>& rects);
+
+    /**
+        Makes the region cover the whole frame.
+     **/
+    void addAll();
+
+    /**
+        Removes all the rectangles.
+     **/
+    void clear();
+
+    /**
+        Returns true if the region has no rectangles.
+     **/
+    bool isEmpty() const;
+
+    /**
+        Returns true if the region covers the whole frame.
+     **/
+    bool isFull() const;
+
+    /**
+        Returns the rectangles of the region. A full region has a
+        single rectangle of the frame size.
+     **/
+    const std::vector<QRect>& rects() const;
+
+    /**
+        Returns the count of pixels in the region.
+     **/
+    long long area() const;
+
+    /**
+        @brief  Returns the bounding rectangle of the projected
+                points in framebuffer pixels.
+        @param  clip     The transform from the point space into the
+                         clip space.
+        @param  points   The points.
+        @param  count    The count of points.
+        @param  viewport The size of the viewport.
+        @return The rectangle clipped to the viewport. The whole
+                viewport if a point is behind the camera.
+     **/
+    static QRect project(const glm::mat4& clip,
+                         const glm::vec3* points,
+                         int count,
+                         const QSize& viewport);
+
+private:
+    // Merges the rectangles that overlap the rectangle at the index.
+    void mergeOverlapping(size_t index);
+
+    QSize bounds_;
+    int maxRects_;
+    bool full_ = false;
+    std::vector<QRect> rects_;
+};
+
+} // namespace kuu
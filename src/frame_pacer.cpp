@@ -0,0 +1,155 @@
+/**
+    @file   frame_pacer.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::FramePacer class.
+ **/
+
+#include "frame_pacer.h"
+#include <algorithm>
+
+namespace kuu
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Returns the frame interval of the given in frequency.
+ * ---------------------------------------------------------------- */
+FramePacer::Clock::duration interval(double hz)
+{
+    using namespace std::chrono;
+    return duration_cast<FramePacer::Clock::duration>(
+        duration<double>(1.0 / hz));
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+FramePacer::FramePacer()
+    : updatePending_(false)
+{}
+
+/* ---------------------------------------------------------------- */
+
+void FramePacer::setSettings(const Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    settings_ = settings;
+    condition_.notify_all();
+}
+
+/* ---------------------------------------------------------------- */
+
+FramePacer::Settings FramePacer::settings() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return settings_;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool FramePacer::waitForNextFrame()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Wait until the UI has presented enough frames.
+    condition_.wait(lock, [this]()
+    {
+        if (interrupted_ || settings_.maxFramesInFlight <= 0)
+            return true;
+        const uint64_t inFlight = renderedFrame_ - presentedFrame_;
+        return inFlight < uint64_t(settings_.maxFramesInFlight);
+    });
+
+    if (interrupted_)
+        return false;
+
+    // Calculate the time when the frame should be started.
+    const Clock::time_point now = Clock::now();
+    Clock::time_point deadline = now;
+    switch (settings_.policy)
+    {
+        case Policy::Unlocked:
+            break;
+
+        case Policy::TargetFps:
+        {
+            if (settings_.targetFps <= 0.0)
+                break;
+
+            // Start from now if the loop has fallen behind so that
+            // the missed frames are not rendered in a burst.
+            const Clock::duration step = interval(settings_.targetFps);
+            if (nextFrameTime_ + step < now)
+                nextFrameTime_ = now;
+            deadline = nextFrameTime_;
+            nextFrameTime_ += step;
+            break;
+        }
+
+        case Policy::DisplayRefresh:
+        {
+            if (settings_.refreshRate <= 0.0 ||
+                presentTime_ == Clock::time_point())
+            {
+                break;
+            }
+
+            // Start at the next refresh after the previous present.
+            const Clock::duration step = interval(settings_.refreshRate);
+            const auto ticks = (now - presentTime_) / step + 1;
+            deadline = presentTime_ + ticks * step;
+            break;
+        }
+    }
+
+    condition_.wait_until(lock, deadline, [this]()
+    { return interrupted_; });
+
+    return !interrupted_;
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramePacer::frameRendered(uint64_t frameNumber)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    renderedFrame_ = std::max(renderedFrame_, frameNumber);
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramePacer::framePresented(uint64_t frameNumber)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    presentedFrame_ = std::max(presentedFrame_, frameNumber);
+    presentTime_ = Clock::now();
+    condition_.notify_all();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool FramePacer::requestUpdate()
+{
+    return !updatePending_.exchange(true);
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramePacer::updateDelivered()
+{
+    updatePending_.store(false);
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramePacer::interrupt()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    interrupted_ = true;
+    condition_.notify_all();
+}
+
+} // namespace kuu
@@ -0,0 +1,146 @@
+/**
+    @file   frame_pacer.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::FramePacer class.
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace kuu
+{
+
+/**
+    @brief   Paces the frames of a rendering loop.
+
+    @details The rendering thread calls @ref waitForNextFrame before
+             it starts a frame and @ref frameRendered after the frame
+             has been published. The UI thread calls @ref
+             framePresented after it has presented a frame.
+
+             The pacer can be run with the following policies:
+
+             - Unlocked: frames are rendered as fast as possible.
+             - TargetFps: frames are started at a fixed rate.
+             - DisplayRefresh: frames are started at the display
+               refresh rate, aligned to the time the UI has
+               presented the previous frame.
+
+             With every policy the count of frames rendered ahead of
+             presentation can be capped. With a cap the rendering
+             thread waits until the UI has presented enough frames.
+
+             The pacer also coalesces the update requests to the UI:
+             @ref requestUpdate returns true only if the UI has not
+             yet started to paint after the previous request.
+ **/
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+        Pacing policy.
+     **/
+    enum class Policy
+    {
+        Unlocked,
+        TargetFps,
+        DisplayRefresh
+    };
+
+    /**
+        Pacing settings.
+     **/
+    struct Settings
+    {
+        // Pacing policy.
+        Policy policy = Policy::DisplayRefresh;
+        // Frame rate with the TargetFps policy.
+        double targetFps = 60.0;
+        // Display refresh rate with the DisplayRefresh policy.
+        double refreshRate = 60.0;
+        // Maximum count of frames rendered but not yet presented,
+        // 0 for unlimited.
+        int maxFramesInFlight = 2;
+    };
+
+    /**
+        Constructs the frame pacer with the default settings.
+     **/
+    FramePacer();
+
+    /**
+        Sets the pacing settings. Can be called from any thread.
+     **/
+    void setSettings(const Settings& settings);
+
+    /**
+        Returns the pacing settings.
+     **/
+    Settings settings() const;
+
+    /**
+        @brief   Waits until the next frame can be started.
+        @details Called by the rendering thread.
+        @return  False if the wait was interrupted.
+     **/
+    bool waitForNextFrame();
+
+    /**
+        @brief Tells that a frame has been rendered and published.
+        @param frameNumber The running number of the frame.
+     **/
+    void frameRendered(uint64_t frameNumber);
+
+    /**
+        @brief   Tells that a frame has been presented.
+        @details Called by the UI thread. This releases the rendering
+                 thread if it waits for the frames in flight and
+                 aligns the DisplayRefresh policy to the current time.
+        @param   frameNumber The running number of the frame.
+     **/
+    void framePresented(uint64_t frameNumber);
+
+    /**
+        @brief   Requests the UI to update.
+        @return  True if the caller should post an update request to
+                 the UI, false if a request is already pending.
+     **/
+    bool requestUpdate();
+
+    /**
+        @brief   Tells that the UI has started to paint.
+        @details Must be called before the UI acquires the frame so
+                 that a frame published during painting triggers a
+                 new update request.
+     **/
+    void updateDelivered();
+
+    /**
+        Interrupts the rendering thread if it is waiting. All the
+        subsequent waits return immediately.
+     **/
+    void interrupt();
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    Settings settings_;
+    bool interrupted_ = false;
+
+    uint64_t renderedFrame_  = 0; // newest rendered frame
+    uint64_t presentedFrame_ = 0; // newest presented frame
+
+    Clock::time_point nextFrameTime_;  // TargetFps deadline
+    Clock::time_point presentTime_;    // DisplayRefresh anchor
+
+    std::atomic<bool> updatePending_;
+};
+
+} // namespace kuu
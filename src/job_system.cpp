@@ -0,0 +1,347 @@
+/**
+    @file   job_system.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::JobSystem class.
+ **/
+
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include "trace.h"
+
+namespace kuu
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/* ---------------------------------------------------------------- *
+   A queued job and the counter it signals.
+ * ---------------------------------------------------------------- */
+struct Job
+{
+    std::function<void()> function;
+    JobSystem::CounterPtr counter;
+};
+
+/* ---------------------------------------------------------------- *
+   The deque of a worker and the statistics of the worker.
+ * ---------------------------------------------------------------- */
+struct Queue
+{
+    std::mutex mutex;
+    std::deque<Job> jobs;
+
+    std::atomic<uint64_t> jobCount { 0 };
+    std::atomic<uint64_t> stealCount { 0 };
+    std::atomic<int64_t> busyTime { 0 }; // nanoseconds
+};
+
+// The scheduler and the worker index of the calling thread. Not set
+// on the threads that are not workers.
+thread_local const void* currentSystem = nullptr;
+thread_local int currentWorker = -1;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+JobSystem::Counter::Counter()
+    : pending_(0)
+{}
+
+/* ---------------------------------------------------------------- */
+
+bool JobSystem::Counter::isDone() const
+{ return pending_.load(std::memory_order_acquire) == 0; }
+
+/* ---------------------------------------------------------------- *
+   The data of the job system.
+ * ---------------------------------------------------------------- */
+struct JobSystem::Data
+{
+    Data(int workerCount)
+    {
+        if (workerCount < 0)
+            workerCount =
+                int(std::thread::hardware_concurrency()) - 1;
+        workerCount = std::max(workerCount, 0);
+
+        // A deque per worker and the shared deque of other threads.
+        for (int i = 0; i < workerCount + 1; ++i)
+            queues.push_back(std::unique_ptr<Queue>(new Queue));
+
+        statsStart = Clock::now();
+        for (int i = 0; i < workerCount; ++i)
+            threads.push_back(std::thread([this, i]() { work(i); }));
+    }
+
+    ~Data()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            exiting = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    // Returns the index of the deque of the calling thread.
+    int queueIndex() const
+    {
+        if (currentSystem == this)
+            return currentWorker;
+        return int(queues.size()) - 1;
+    }
+
+    // Pushes the job into the deque of the calling thread and wakes
+    // up a sleeping worker.
+    void push(const Job& job)
+    {
+        Queue& queue = *queues[queueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+
+        // Lock so that the notification is not lost between the
+        // check and the wait of a worker.
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeUp.notify_one();
+    }
+
+    // Queues the job now or when the dependency is done.
+    void submit(const Job& job, const CounterPtr& dependency)
+    {
+        job.counter->pending_.fetch_add(1, std::memory_order_acq_rel);
+        if (dependency)
+        {
+            std::lock_guard<std::mutex> lock(dependency->mutex_);
+            if (!dependency->isDone())
+            {
+                dependency->continuations_.push_back([this, job]()
+                { push(job); });
+                return;
+            }
+        }
+        push(job);
+    }
+
+    // Takes the newest job of the own deque or steals the oldest job
+    // of another deque.
+    bool take(int index, Job& job, bool& stolen)
+    {
+        const int count = int(queues.size());
+        for (int i = 0; i < count; ++i)
+        {
+            Queue& queue = *queues[(index + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+
+            if (i == 0)
+            {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+            stolen = i != 0;
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Runs the job and signals its counter.
+    void execute(int index, Job& job, bool stolen)
+    {
+        const Clock::time_point start = Clock::now();
+        {
+            KUU_TRACE_SCOPE("JobSystem::job");
+            job.function();
+        }
+        const Clock::time_point end = Clock::now();
+
+        Queue& queue = *queues[index];
+        queue.jobCount.fetch_add(1, std::memory_order_relaxed);
+        if (stolen)
+            queue.stealCount.fetch_add(1, std::memory_order_relaxed);
+        using namespace std::chrono;
+        queue.busyTime.fetch_add(
+            duration_cast<nanoseconds>(end - start).count(),
+            std::memory_order_relaxed);
+
+        // Queue the jobs that depend on the counter when it is done.
+        std::vector<std::function<void()>> ready;
+        {
+            Counter& counter = *job.counter;
+            std::lock_guard<std::mutex> lock(counter.mutex_);
+            if (counter.pending_.fetch_sub(
+                    1, std::memory_order_acq_rel) == 1)
+            {
+                ready.swap(counter.continuations_);
+            }
+        }
+        for (const std::function<void()>& continuation : ready)
+            continuation();
+    }
+
+    // Runs the jobs of a worker until the system is destroyed.
+    void work(int index)
+    {
+        Trace::setThreadName("Job worker");
+        currentSystem = this;
+        currentWorker = index;
+
+        for (;;)
+        {
+            Job job;
+            bool stolen = false;
+            if (take(index, job, stolen))
+            {
+                execute(index, job, stolen);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this]()
+            {
+                return exiting ||
+                       queued.load(std::memory_order_acquire) > 0;
+            });
+            if (exiting)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    // Sleeping workers wait for queued jobs.
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool exiting = false;
+    // Count of jobs in the deques.
+    std::atomic<int> queued { 0 };
+
+    // Start of the statistics window, guarded by statsMutex.
+    std::mutex statsMutex;
+    Clock::time_point statsStart;
+};
+
+/* ---------------------------------------------------------------- */
+
+JobSystem::JobSystem(int workerCount)
+    : d(std::make_shared<Data>(workerCount))
+{}
+
+/* ---------------------------------------------------------------- */
+
+int JobSystem::workerCount() const
+{ return int(d->threads.size()); }
+
+/* ---------------------------------------------------------------- */
+
+JobSystem::CounterPtr JobSystem::run(const std::function<void()>& job,
+                                     const CounterPtr& dependency)
+{
+    CounterPtr counter = std::make_shared<Counter>();
+    run(job, counter, dependency);
+    return counter;
+}
+
+/* ---------------------------------------------------------------- */
+
+void JobSystem::run(const std::function<void()>& job,
+                    const CounterPtr& counter,
+                    const CounterPtr& dependency)
+{
+    d->submit({ job, counter }, dependency);
+}
+
+/* ---------------------------------------------------------------- */
+
+void JobSystem::wait(const CounterPtr& counter)
+{
+    const int index = d->queueIndex();
+    while (!counter->isDone())
+    {
+        Job job;
+        bool stolen = false;
+        if (d->take(index, job, stolen))
+            d->execute(index, job, stolen);
+        else
+            std::this_thread::yield();
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void JobSystem::parallelFor(int begin, int end, int grainSize,
+                            const std::function<void(int, int)>& function)
+{
+    const int count = end - begin;
+    if (count <= 0)
+        return;
+
+    // A few jobs per thread balance the load when the jobs take a
+    // different time.
+    const int threadCount = workerCount() + 1;
+    const int grain = grainSize > 0
+        ? grainSize
+        : std::max(count / (threadCount * 4), 1);
+    if (count <= grain || threadCount == 1)
+    {
+        function(begin, end);
+        return;
+    }
+
+    CounterPtr counter = std::make_shared<Counter>();
+    for (int first = begin; first < end; first += grain)
+    {
+        const int last = std::min(first + grain, end);
+        run([&function, first, last]() { function(first, last); },
+            counter, nullptr);
+    }
+    wait(counter);
+}
+
+/* ---------------------------------------------------------------- */
+
+std::vector<JobSystem::WorkerStats> JobSystem::stats()
+{
+    std::lock_guard<std::mutex> lock(d->statsMutex);
+    const Clock::time_point now = Clock::now();
+    using namespace std::chrono;
+    const double window =
+        duration<double, std::milli>(now - d->statsStart).count();
+    d->statsStart = now;
+
+    std::vector<WorkerStats> out;
+    for (const std::unique_ptr<Queue>& queue : d->queues)
+    {
+        WorkerStats s;
+        s.jobs     = queue->jobCount.exchange(0);
+        s.steals   = queue->stealCount.exchange(0);
+        s.busyTime = queue->busyTime.exchange(0) / 1e6;
+        s.utilization = window > 0.0
+            ? std::min(s.busyTime / window, 1.0) : 0.0;
+        out.push_back(s);
+    }
+    return out;
+}
+
+} // namespace kuu
@@ -0,0 +1,166 @@
+/**
+    @file   job_system.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::JobSystem class.
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kuu
+{
+
+/**
+    @brief   A work-stealing job scheduler.
+
+    @details The scheduler has a pool of worker threads, by default one
+             less than the hardware threads as the thread that waits
+             for the jobs runs jobs too. Each worker has its own deque
+             of jobs. A worker pushes and pops the jobs it creates at
+             the back of its deque, so it runs the newest job while
+             its data is still in the cache. An idle worker steals the
+             oldest job from the front of another deque. Jobs created
+             by other threads go into a shared deque that all the
+             workers steal from. Workers with nothing to steal sleep.
+
+             A job can signal a @ref Counter. The counter is done when
+             all its jobs have run. A job can also depend on a
+             counter. It is queued only when that counter is done, so
+             jobs can be chained into a task graph without a thread
+             blocking in between.
+
+             @ref wait runs queued jobs on the calling thread until
+             the counter is done. @ref parallelFor splits an index
+             range into chunks, runs them as jobs and waits for them.
+
+    @code
+    JobSystem jobs;
+    jobs.parallelFor(0, count, 1024, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            update(i);
+    });
+
+    JobSystem::CounterPtr a = jobs.run(updateTransforms);
+    JobSystem::CounterPtr b = jobs.run(buildCommands, a);
+    jobs.wait(b);
+    @endcode
+ **/
+class JobSystem
+{
+public:
+    /**
+        @brief   A counter of the pending jobs.
+        @details Jobs that depend on the counter are queued when the
+                 count drops to zero.
+     **/
+    class Counter
+    {
+    public:
+        Counter();
+
+        /**
+            Returns true if all the jobs of the counter have run.
+         **/
+        bool isDone() const;
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<int> pending_;
+        std::mutex mutex_;
+        // Jobs that wait for the counter.
+        std::vector<std::function<void()>> continuations_;
+    };
+    using CounterPtr = std::shared_ptr<Counter>;
+
+    /**
+        Statistics of a worker since the previous @ref stats call.
+     **/
+    struct WorkerStats
+    {
+        // Count of jobs run.
+        uint64_t jobs = 0;
+        // Count of jobs stolen from other deques.
+        uint64_t steals = 0;
+        // Time spent running jobs in milliseconds.
+        double busyTime = 0.0;
+        // Fraction of the time spent running jobs.
+        double utilization = 0.0;
+    };
+
+    /**
+        @brief Constructs the scheduler and starts the workers.
+        @param workerCount The count of worker threads. If negative
+                           then one less than the hardware threads.
+                           With zero workers the jobs run in @ref
+                           wait on the waiting thread.
+     **/
+    explicit JobSystem(int workerCount = -1);
+
+    /**
+        Returns the count of worker threads.
+     **/
+    int workerCount() const;
+
+    /**
+        @brief  Queues a job.
+        @param  job        The job.
+        @param  dependency The counter that must be done before the
+                           job is run, nullptr if none.
+        @return The counter of the job.
+     **/
+    CounterPtr run(const std::function<void()>& job,
+                   const CounterPtr& dependency = nullptr);
+
+    /**
+        @brief Queues a job that signals an existing counter.
+        @param job        The job.
+        @param counter    The counter of the job.
+        @param dependency The counter that must be done before the
+                          job is run, nullptr if none.
+     **/
+    void run(const std::function<void()>& job,
+             const CounterPtr& counter,
+             const CounterPtr& dependency);
+
+    /**
+        Runs queued jobs on the calling thread until the counter is
+        done.
+     **/
+    void wait(const CounterPtr& counter);
+
+    /**
+        @brief Runs the function over the index range in parallel and
+               waits until it is done.
+        @param begin     The first index.
+        @param end       The index after the last one.
+        @param grainSize The count of indices in a job. If not
+                         positive then the range is split into a few
+                         jobs per thread.
+        @param function  Called with the sub-range [begin, end) of
+                         each job.
+     **/
+    void parallelFor(int begin, int end, int grainSize,
+                     const std::function<void(int, int)>& function);
+
+    /**
+        @brief   Returns the statistics of each worker since the
+                 previous call.
+        @details The last item is the threads that wait for jobs and
+                 run them in @ref wait.
+     **/
+    std::vector<WorkerStats> stats();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace kuu
@@ -5,7 +5,9 @@
  **/
 
 #include "src/opengl_widget.h"
+#include "src/trace.h"
 #include <iostream>
+#include <QtCore/QCommandLineParser>
 #include <QtGui/QIcon>
 #include <QtGui/QOpenGLContext>
 #include <QtWidgets/QApplication>
@@ -18,6 +20,124 @@ int main(int argc, char *argv[])
     using namespace kuu;
     using namespace kuu::opengl;
 
+    // Parse the command line options.
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "QOpenGLWidget multithread example");
+    parser.addHelpOption();
+
+    QCommandLineOption pacingOption(
+        "pacing",
+        "Frame pacing policy: unlocked, fps or vsync (default).",
+        "policy", "vsync");
+    QCommandLineOption fpsOption(
+        "fps",
+        "Target frame rate of the fps pacing policy.",
+        "fps", "60");
+    QCommandLineOption framesInFlightOption(
+        "max-frames-in-flight",
+        "Maximum count of frames rendered ahead of presentation, "
+        "0 for unlimited.",
+        "count", "2");
+    QCommandLineOption presentOption(
+        "present",
+        "Frame presentation mode: draw (default) or blit.",
+        "mode", "draw");
+    parser.addOption(pacingOption);
+    parser.addOption(fpsOption);
+    parser.addOption(framesInFlightOption);
+    QCommandLineOption hudOption(
+        "hud", "Show the frame statistics overlay.");
+    QCommandLineOption quadsOption(
+        "quads",
+        "Count of quads, more than one are rendered instanced.",
+        "count", "1");
+    QCommandLineOption workersOption(
+        "workers",
+        "Count of job workers that update the quad transforms, -1 to "
+        "use one less than the hardware threads.",
+        "count", "-1");
+    QCommandLineOption dynamicResolutionOption(
+        "dynamic-resolution",
+        "Scale the render resolution to hold the frame time of the "
+        "target frame rate.");
+    QCommandLineOption minScaleOption(
+        "min-scale",
+        "Minimum scale of the dynamic resolution.",
+        "scale", "0.5");
+    QCommandLineOption upscaleOption(
+        "upscale",
+        "Upscale filter: bilinear (default) or sharpen.",
+        "filter", "bilinear");
+    QCommandLineOption onDemandOption(
+        "on-demand",
+        "Render only when the scene changes or a frame is requested.");
+    QCommandLineOption staticOption(
+        "static", "Do not rotate the quads.");
+    QCommandLineOption meshOption(
+        "mesh",
+        "Mesh file written by qopenglwidget-meshconv, rendered with "
+        "the quads.",
+        "file");
+    QCommandLineOption textureOption(
+        "texture", "Image file that textures the quads.", "file");
+    QCommandLineOption atlasOption(
+        "atlas",
+        "Image file packed into a texture atlas of the quads, can be "
+        "given many times. Replaces the --texture image.",
+        "file");
+    parser.addOption(presentOption);
+    parser.addOption(hudOption);
+    parser.addOption(quadsOption);
+    parser.addOption(workersOption);
+    parser.addOption(dynamicResolutionOption);
+    parser.addOption(minScaleOption);
+    parser.addOption(upscaleOption);
+    parser.addOption(onDemandOption);
+    parser.addOption(staticOption);
+    parser.addOption(meshOption);
+    parser.addOption(textureOption);
+    parser.addOption(atlasOption);
+    parser.process(app);
+
+    FramePacer::Settings framePacing;
+    const QString pacing = parser.value(pacingOption);
+    if (pacing == "unlocked")
+        framePacing.policy = FramePacer::Policy::Unlocked;
+    else if (pacing == "fps")
+        framePacing.policy = FramePacer::Policy::TargetFps;
+    else
+        framePacing.policy = FramePacer::Policy::DisplayRefresh;
+    framePacing.targetFps = parser.value(fpsOption).toDouble();
+    framePacing.maxFramesInFlight =
+        parser.value(framesInFlightOption).toInt();
+
+    ResolutionGovernor::Settings resolutionScaling;
+    resolutionScaling.enabled = parser.isSet(dynamicResolutionOption);
+    if (framePacing.targetFps > 0.0)
+        resolutionScaling.targetFrameTime =
+            1000.0 / framePacing.targetFps;
+    resolutionScaling.minScale = parser.value(minScaleOption).toDouble();
+
+    const ViewportTarget::UpscaleFilter upscaleFilter =
+        parser.value(upscaleOption) == "sharpen"
+            ? ViewportTarget::UpscaleFilter::Sharpen
+            : ViewportTarget::UpscaleFilter::Bilinear;
+
+    const ViewportTarget::PresentMode presentMode =
+        parser.value(presentOption) == "blit"
+            ? ViewportTarget::PresentMode::Blit
+            : ViewportTarget::PresentMode::Draw;
+
+    // Record a timeline of the threads if the trace file is set.
+    const QString traceFile =
+        QString::fromLocal8Bit(qgetenv("KUU_TRACE"));
+    if (!traceFile.isEmpty())
+    {
+        Trace::setEnabled(true);
+        Trace::setThreadName("UI thread");
+    }
+
     // Check that the threaded OpenGL is supported.
     if (!QOpenGLContext::supportsThreadedOpenGL())
     {
@@ -45,8 +165,26 @@ int main(int argc, char *argv[])
     widget->setWindowIcon(QIcon("://icons/application_icon.png"));
     widget->resize(size);
     widget->move(position);
+    widget->setFramePacing(framePacing);
+    widget->setPresentMode(presentMode);
+    widget->setResolutionScaling(resolutionScaling);
+    widget->setUpscaleFilter(upscaleFilter);
+    widget->setHudVisible(parser.isSet(hudOption));
+    widget->setQuadCount(parser.value(quadsOption).toInt());
+    widget->setJobWorkerCount(parser.value(workersOption).toInt());
+    widget->setRenderOnDemand(parser.isSet(onDemandOption));
+    widget->setAnimated(!parser.isSet(staticOption));
+    widget->setMeshFile(parser.value(meshOption));
+    widget->setTextureFile(parser.value(textureOption));
+    widget->setAtlasFiles(parser.values(atlasOption));
     widget->show();
     widget->startThread();
 
-    return app.exec();
+    const int result = app.exec();
+    if (!traceFile.isEmpty())
+    {
+        widget->stopThread();
+        Trace::write(traceFile.toStdString());
+    }
+    return result;
 }
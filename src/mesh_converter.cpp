@@ -0,0 +1,798 @@
+/**
+    @file   mesh_converter.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Converts Wavefront OBJ files into binary mesh files.
+
+    The OBJ file is memory mapped and split into chunks at line
+    boundaries. The chunks are parsed in parallel, then the relative
+    face indices are resolved and the vertices of each chunk are
+    de-duplicated in parallel. The triangles and vertices of each part
+    are reordered for the GPU vertex caches and the indices are
+    stored as 16-bit if the vertex count allows. The result is
+    written as a binary mesh file that is read with
+    kuu::opengl::MeshFile.
+
+    Each object and group of the OBJ file becomes a part of the mesh.
+    The vertices have a float position, a 10-bit normal if the file
+    has normals and a float texture coordinate if the file has
+    texture coordinates, in shader locations 0, 1 and 2. Polygons are
+    triangulated as fans.
+
+    @code
+    qopenglwidget-meshconv model.obj model.kmesh
+    @endcode
+ **/
+
+#include "mesh_optimizer.h"
+#include "opengl_mesh_file.h"
+#include "opengl_vertex_format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+
+namespace
+{
+
+using namespace kuu;
+using namespace kuu::opengl;
+using Clock = std::chrono::steady_clock;
+
+/* ---------------------------------------------------------------- *
+   A corner of a triangle. The indices are zero-based and -1 if the
+   corner does not have the attribute.
+ * ---------------------------------------------------------------- */
+struct Corner
+{
+    int position;
+    int texCoord;
+    int normal;
+
+    bool operator==(const Corner& other) const
+    {
+        return position == other.position &&
+               texCoord == other.texCoord &&
+               normal   == other.normal;
+    }
+};
+
+/* ---------------------------------------------------------------- *
+   Hash of a corner.
+ * ---------------------------------------------------------------- */
+struct CornerHash
+{
+    size_t operator()(const Corner& c) const
+    {
+        uint64_t hash = uint64_t(uint32_t(c.position));
+        hash = hash * 0x9E3779B97F4A7C15ull ^ uint32_t(c.texCoord);
+        hash = hash * 0x9E3779B97F4A7C15ull ^ uint32_t(c.normal);
+        return size_t(hash ^ (hash >> 32));
+    }
+};
+
+// Flags of the corner indices that are relative to the chunk.
+const uint8_t RelativePosition = 1;
+const uint8_t RelativeTexCoord = 2;
+const uint8_t RelativeNormal   = 4;
+
+/* ---------------------------------------------------------------- *
+   A run of triangles in a chunk. A run that starts with an object
+   or a group statement starts a new part.
+ * ---------------------------------------------------------------- */
+struct Run
+{
+    size_t firstCorner;
+    bool startsPart;
+
+    // De-duplicated vertices and the indices of the run.
+    std::vector<uint8_t> vertices;
+    int vertexCount = 0;
+    std::vector<uint32_t> indices;
+};
+
+/* ---------------------------------------------------------------- *
+   A chunk of lines of the OBJ file.
+ * ---------------------------------------------------------------- */
+struct Chunk
+{
+    const char* begin = nullptr;
+    const char* end   = nullptr;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner> corners; // three per triangle
+    std::vector<uint8_t> relative;
+    std::vector<Run> runs;
+    int malformedLines = 0;
+    int invalidTriangles = 0;
+
+    // Offsets of the chunk attributes in the whole file.
+    int positionBase = 0;
+    int texCoordBase = 0;
+    int normalBase   = 0;
+};
+
+/* ---------------------------------------------------------------- *
+   The attributes of the whole file.
+ * ---------------------------------------------------------------- */
+struct Attributes
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+};
+
+/* ---------------------------------------------------------------- *
+   The vertex layout of the output.
+ * ---------------------------------------------------------------- */
+struct Layout
+{
+    bool hasNormals   = false;
+    bool hasTexCoords = false;
+    int stride         = 0;
+    int normalOffset   = 0;
+    int texCoordOffset = 0;
+};
+
+/* ---------------------------------------------------------------- */
+
+bool isSpace(char c)
+{ return c == ' ' || c == '\t' || c == '\r'; }
+
+bool isDigit(char c)
+{ return c >= '0' && c <= '9'; }
+
+void skipSpaces(const char*& p, const char* end)
+{
+    while (p < end && isSpace(*p))
+        ++p;
+}
+
+/* ---------------------------------------------------------------- *
+   Parses a float. The C library functions would depend on the
+   locale that Qt sets.
+ * ---------------------------------------------------------------- */
+bool parseFloat(const char*& p, const char* end, float& value)
+{
+    static const double powers[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    skipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int digits   = 0;
+    int exponent = 0;
+    for (; p < end && isDigit(*p); ++p, ++digits)
+        mantissa = mantissa * 10.0 + (*p - '0');
+    if (p < end && *p == '.')
+        for (++p; p < end && isDigit(*p); ++p, ++digits, --exponent)
+            mantissa = mantissa * 10.0 + (*p - '0');
+    if (digits == 0)
+        return false;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        int e = 0;
+        for (; p < end && isDigit(*p); ++p)
+            e = std::min(e * 10 + (*p - '0'), 1000);
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if (exponent >= 0 && exponent <= 22)
+        mantissa *= powers[exponent];
+    else if (exponent < 0 && exponent >= -22)
+        mantissa /= powers[-exponent];
+    else
+        mantissa *= std::pow(10.0, exponent);
+
+    value = float(negative ? -mantissa : mantissa);
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Parses an integer.
+ * ---------------------------------------------------------------- */
+bool parseInt(const char*& p, const char* end, int& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    if (p == end || !isDigit(*p))
+        return false;
+
+    int v = 0;
+    for (; p < end && isDigit(*p); ++p)
+        v = v * 10 + (*p - '0');
+    value = negative ? -v : v;
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts an OBJ index into a zero-based index. A negative index
+   is relative to the count of attributes read so far, it is made
+   relative to the start of the chunk and flagged.
+ * ---------------------------------------------------------------- */
+int toIndex(int index, size_t count, uint8_t flag, uint8_t& relative)
+{
+    if (index > 0)
+        return index - 1;
+    if (index == 0)
+        return -1;
+    relative |= flag;
+    return int(count) + index;
+}
+
+/* ---------------------------------------------------------------- *
+   Parses a face corner, e.g. 1, 1/2, 1//3 or 1/2/3.
+ * ---------------------------------------------------------------- */
+bool parseCorner(const char*& p, const char* end,
+                 const Chunk& chunk,
+                 Corner& corner, uint8_t& relative)
+{
+    int v = 0, t = 0, n = 0;
+    if (!parseInt(p, end, v))
+        return false;
+    if (p < end && *p == '/')
+    {
+        ++p;
+        if (p < end && *p != '/' && !parseInt(p, end, t))
+            return false;
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (!parseInt(p, end, n))
+                return false;
+        }
+    }
+
+    relative = 0;
+    corner.position = toIndex(v, chunk.positions.size(),
+                              RelativePosition, relative);
+    corner.texCoord = toIndex(t, chunk.texCoords.size(),
+                              RelativeTexCoord, relative);
+    corner.normal   = toIndex(n, chunk.normals.size(),
+                              RelativeNormal, relative);
+    // OBJ indices start from 1.
+    return v != 0;
+}
+
+/* ---------------------------------------------------------------- *
+   Parses the lines of the chunk.
+ * ---------------------------------------------------------------- */
+void parseChunk(Chunk& chunk)
+{
+    Run first;
+    first.firstCorner = 0;
+    first.startsPart  = false;
+    chunk.runs.push_back(first);
+
+    std::vector<Corner> face;
+    std::vector<uint8_t> faceRelative;
+
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char* lineEnd = static_cast<const char*>(
+            std::memchr(p, '\n', size_t(chunk.end - p)));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+
+        skipSpaces(p, lineEnd);
+        const size_t length = size_t(lineEnd - p);
+        bool ok = true;
+
+        if (length > 1 && p[0] == 'v' && isSpace(p[1]))
+        {
+            glm::vec3 v;
+            p += 1;
+            ok = parseFloat(p, lineEnd, v.x) &&
+                 parseFloat(p, lineEnd, v.y) &&
+                 parseFloat(p, lineEnd, v.z);
+            chunk.positions.push_back(v);
+        }
+        else if (length > 2 && p[0] == 'v' && p[1] == 't' &&
+                 isSpace(p[2]))
+        {
+            glm::vec2 t;
+            p += 2;
+            ok = parseFloat(p, lineEnd, t.x);
+            // The v coordinate is optional.
+            if (ok && !parseFloat(p, lineEnd, t.y))
+                t.y = 0.0f;
+            chunk.texCoords.push_back(t);
+        }
+        else if (length > 2 && p[0] == 'v' && p[1] == 'n' &&
+                 isSpace(p[2]))
+        {
+            glm::vec3 n;
+            p += 2;
+            ok = parseFloat(p, lineEnd, n.x) &&
+                 parseFloat(p, lineEnd, n.y) &&
+                 parseFloat(p, lineEnd, n.z);
+            chunk.normals.push_back(n);
+        }
+        else if (length > 1 && p[0] == 'f' && isSpace(p[1]))
+        {
+            face.clear();
+            faceRelative.clear();
+            p += 1;
+            for (skipSpaces(p, lineEnd); ok && p < lineEnd;
+                 skipSpaces(p, lineEnd))
+            {
+                Corner corner;
+                uint8_t relative = 0;
+                ok = parseCorner(p, lineEnd, chunk, corner, relative);
+                face.push_back(corner);
+                faceRelative.push_back(relative);
+            }
+
+            ok = ok && face.size() >= 3;
+            for (size_t i = 1; ok && i + 1 < face.size(); ++i)
+            {
+                const size_t fan[] = { 0, i, i + 1 };
+                for (size_t c : fan)
+                {
+                    chunk.corners.push_back(face[c]);
+                    chunk.relative.push_back(faceRelative[c]);
+                }
+            }
+        }
+        else if (length > 0 && (p[0] == 'o' || p[0] == 'g') &&
+                 (length == 1 || isSpace(p[1])))
+        {
+            Run run;
+            run.firstCorner = chunk.corners.size();
+            run.startsPart  = true;
+            chunk.runs.push_back(run);
+        }
+
+        if (!ok)
+            chunk.malformedLines++;
+        p = lineEnd + 1;
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Splits the data into chunks at line boundaries.
+ * ---------------------------------------------------------------- */
+std::vector<Chunk> split(const char* data, size_t size, int count)
+{
+    std::vector<Chunk> chunks;
+    const char* end = data + size;
+    const char* p   = data;
+    for (int i = 0; i < count && p < end; ++i)
+    {
+        const char* chunkEnd =
+            i == count - 1 ? end : data + size * (i + 1) / count;
+        if (chunkEnd < p)
+            chunkEnd = p;
+        const char* newline = static_cast<const char*>(
+            std::memchr(chunkEnd, '\n', size_t(end - chunkEnd)));
+        chunkEnd = newline ? newline + 1 : end;
+
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end   = chunkEnd;
+        chunks.push_back(chunk);
+        p = chunkEnd;
+    }
+    return chunks;
+}
+
+/* ---------------------------------------------------------------- *
+   Runs the function for each chunk in a thread of its own.
+ * ---------------------------------------------------------------- */
+template<typename F>
+void forEachChunk(std::vector<Chunk>& chunks, F f)
+{
+    std::vector<std::thread> threads;
+    for (Chunk& chunk : chunks)
+        threads.push_back(std::thread([&chunk, f]() { f(chunk); }));
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Resolves the chunk-relative index into the file index. Returns -1
+   if the index is missing or out of range.
+ * ---------------------------------------------------------------- */
+int resolve(int index, bool relative, int base, size_t count)
+{
+    if (relative)
+        index += base;
+    else if (index == -1)
+        return -1;
+    return index >= 0 && size_t(index) < count ? index : -1;
+}
+
+/* ---------------------------------------------------------------- *
+   Builds the de-duplicated vertices and the indices of the runs of
+   the chunk.
+ * ---------------------------------------------------------------- */
+void buildVertices(Chunk& chunk,
+                   const Attributes& attributes,
+                   const Layout& layout)
+{
+    std::unordered_map<Corner, uint32_t, CornerHash> vertices;
+    for (size_t r = 0; r < chunk.runs.size(); ++r)
+    {
+        Run& run = chunk.runs[r];
+        const size_t last = r + 1 < chunk.runs.size()
+                          ? chunk.runs[r + 1].firstCorner
+                          : chunk.corners.size();
+
+        vertices.clear();
+        for (size_t i = run.firstCorner; i + 3 <= last; i += 3)
+        {
+            // Resolve the triangle and skip it if invalid.
+            Corner triangle[3];
+            bool valid = true;
+            for (int c = 0; c < 3; ++c)
+            {
+                const Corner& in = chunk.corners[i + c];
+                const uint8_t rel = chunk.relative[i + c];
+                Corner& out = triangle[c];
+                out.position = resolve(in.position,
+                                       rel & RelativePosition,
+                                       chunk.positionBase,
+                                       attributes.positions.size());
+                out.texCoord = resolve(in.texCoord,
+                                       rel & RelativeTexCoord,
+                                       chunk.texCoordBase,
+                                       attributes.texCoords.size());
+                out.normal   = resolve(in.normal,
+                                       rel & RelativeNormal,
+                                       chunk.normalBase,
+                                       attributes.normals.size());
+                valid = valid && out.position != -1;
+            }
+
+            if (!valid)
+            {
+                chunk.invalidTriangles++;
+                continue;
+            }
+
+            for (const Corner& corner : triangle)
+            {
+                auto inserted = vertices.insert(
+                    std::make_pair(corner, uint32_t(run.vertexCount)));
+                if (inserted.second)
+                {
+                    // Write the new vertex.
+                    const size_t offset = run.vertices.size();
+                    run.vertices.resize(offset + layout.stride, 0);
+                    uint8_t* v = run.vertices.data() + offset;
+
+                    const glm::vec3& position =
+                        attributes.positions[corner.position];
+                    std::memcpy(v, &position, sizeof(position));
+
+                    if (layout.hasNormals && corner.normal != -1)
+                    {
+                        const uint32_t normal = vertex::packSnorm10x3(
+                            glm::normalize(
+                                attributes.normals[corner.normal]));
+                        std::memcpy(v + layout.normalOffset, &normal,
+                                    sizeof(normal));
+                    }
+
+                    if (layout.hasTexCoords && corner.texCoord != -1)
+                    {
+                        const glm::vec2& texCoord =
+                            attributes.texCoords[corner.texCoord];
+                        std::memcpy(v + layout.texCoordOffset,
+                                    &texCoord, sizeof(texCoord));
+                    }
+                    run.vertexCount++;
+                }
+                run.indices.push_back(inserted.first->second);
+            }
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the OBJ data into the mesh file content. The vertex and
+   index data are stored into the given vectors.
+ * ---------------------------------------------------------------- */
+bool convert(const char* data, size_t size, int threadCount,
+             MeshFile::Content& content,
+             std::vector<uint8_t>& vertexData,
+             std::vector<uint32_t>& indexData)
+{
+    std::vector<Chunk> chunks = split(data, size, threadCount);
+    forEachChunk(chunks, parseChunk);
+
+    // Concatenate the attributes of the chunks.
+    Attributes attributes;
+    int malformedLines = 0;
+    for (Chunk& chunk : chunks)
+    {
+        chunk.positionBase = int(attributes.positions.size());
+        chunk.texCoordBase = int(attributes.texCoords.size());
+        chunk.normalBase   = int(attributes.normals.size());
+        attributes.positions.insert(attributes.positions.end(),
+                                    chunk.positions.begin(),
+                                    chunk.positions.end());
+        attributes.texCoords.insert(attributes.texCoords.end(),
+                                    chunk.texCoords.begin(),
+                                    chunk.texCoords.end());
+        attributes.normals.insert(attributes.normals.end(),
+                                  chunk.normals.begin(),
+                                  chunk.normals.end());
+        malformedLines += chunk.malformedLines;
+    }
+
+    if (malformedLines > 0)
+        std::cerr << "Skipped " << malformedLines
+                  << " malformed lines" << std::endl;
+
+    Layout layout;
+    layout.hasNormals   = !attributes.normals.empty();
+    layout.hasTexCoords = !attributes.texCoords.empty();
+    layout.stride       = vertex::Float3::size;
+    if (layout.hasNormals)
+    {
+        layout.normalOffset = layout.stride;
+        layout.stride += vertex::SNorm10x3::size;
+    }
+    if (layout.hasTexCoords)
+    {
+        layout.texCoordOffset = layout.stride;
+        layout.stride += vertex::Float2::size;
+    }
+
+    forEachChunk(chunks, [&attributes, &layout](Chunk& chunk)
+    {
+        buildVertices(chunk, attributes, layout);
+    });
+
+    // Concatenate the runs into parts. The indices are made relative
+    // to the first vertex of the file.
+    // A run without faces still starts a part, e.g. a g line at the
+    // end of a chunk starts the part of the next chunk's first run,
+    // so the parts do not depend on the chunking.
+    int invalidTriangles = 0;
+    bool startsPart = false;
+    for (Chunk& chunk : chunks)
+    {
+        invalidTriangles += chunk.invalidTriangles;
+        for (Run& run : chunk.runs)
+        {
+            startsPart |= run.startsPart;
+            if (run.indices.empty())
+                continue;
+
+            const uint32_t baseVertex =
+                uint32_t(vertexData.size() / layout.stride);
+            if (startsPart || content.parts.empty())
+            {
+                MeshFile::Part part;
+                part.baseVertex = int(baseVertex);
+                part.firstIndex = int(indexData.size());
+                content.parts.push_back(part);
+            }
+            startsPart = false;
+
+            vertexData.insert(vertexData.end(),
+                              run.vertices.begin(),
+                              run.vertices.end());
+            for (uint32_t index : run.indices)
+                indexData.push_back(baseVertex + index);
+
+            MeshFile::Part& part = content.parts.back();
+            part.vertexCount += run.vertexCount;
+            part.indexCount  += int(run.indices.size());
+
+            // Free the memory of the run.
+            std::vector<uint8_t>().swap(run.vertices);
+            std::vector<uint32_t>().swap(run.indices);
+        }
+    }
+
+    if (invalidTriangles > 0)
+        std::cerr << "Skipped " << invalidTriangles
+                  << " triangles with invalid indices" << std::endl;
+
+    if (indexData.empty())
+    {
+        std::cerr << "No triangles found" << std::endl;
+        return false;
+    }
+
+    MeshFile::Attribute position;
+    position.location  = 0;
+    position.tupleSize = vertex::Float3::tupleSize;
+    position.type      = vertex::Float3::type;
+    content.attributes.push_back(position);
+
+    if (layout.hasNormals)
+    {
+        MeshFile::Attribute normal;
+        normal.location   = 1;
+        normal.tupleSize  = vertex::SNorm10x3::tupleSize;
+        normal.type       = vertex::SNorm10x3::type;
+        normal.normalized = vertex::SNorm10x3::normalized;
+        normal.offset     = layout.normalOffset;
+        content.attributes.push_back(normal);
+    }
+
+    if (layout.hasTexCoords)
+    {
+        MeshFile::Attribute texCoord;
+        texCoord.location  = 2;
+        texCoord.tupleSize = vertex::Float2::tupleSize;
+        texCoord.type      = vertex::Float2::type;
+        texCoord.offset    = layout.texCoordOffset;
+        content.attributes.push_back(texCoord);
+    }
+
+    content.vertexStride = layout.stride;
+    content.vertexCount  = int(vertexData.size() / layout.stride);
+    content.vertexData   = vertexData.data();
+    content.indexType    = GL_UNSIGNED_INT;
+    content.indexCount   = int(indexData.size());
+    content.indexData    = indexData.data();
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Reorders the triangles and the vertices of each part for the
+   vertex caches.
+ * ---------------------------------------------------------------- */
+void optimize(const MeshFile::Content& content,
+              std::vector<uint8_t>& vertexData,
+              std::vector<uint32_t>& indexData)
+{
+    for (const MeshFile::Part& part : content.parts)
+    {
+        // The optimizer takes indices relative to the part.
+        uint32_t* indices = indexData.data() + part.firstIndex;
+        for (int i = 0; i < part.indexCount; ++i)
+            indices[i] -= uint32_t(part.baseVertex);
+
+        MeshOptimizer::optimizeVertexCache(indices,
+                                           part.indexCount,
+                                           part.vertexCount);
+        MeshOptimizer::optimizeVertexFetch(
+            vertexData.data() +
+                size_t(part.baseVertex) * content.vertexStride,
+            part.vertexCount,
+            content.vertexStride,
+            indices,
+            part.indexCount);
+
+        for (int i = 0; i < part.indexCount; ++i)
+            indices[i] += uint32_t(part.baseVertex);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the milliseconds since the time point.
+ * ---------------------------------------------------------------- */
+double millisecondsSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The entry point of the mesh converter.
+ * ---------------------------------------------------------------- */
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qopenglwidget-meshconv");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Converts a Wavefront OBJ file into a binary mesh file.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "The OBJ file.");
+    parser.addPositionalArgument("output", "The mesh file.");
+    QCommandLineOption threadsOption(
+        "threads", "Count of parser threads, 0 for all cores.",
+        "count", "0");
+    parser.addOption(threadsOption);
+    QCommandLineOption noOptimizeOption(
+        "no-optimize",
+        "Keep the triangle and vertex order of the OBJ file.");
+    parser.addOption(noOptimizeOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2)
+        parser.showHelp(EXIT_FAILURE);
+
+    int threadCount = parser.value(threadsOption).toInt();
+    if (threadCount <= 0)
+        threadCount = int(std::thread::hardware_concurrency());
+    threadCount = std::max(threadCount, 1);
+
+    const Clock::time_point start = Clock::now();
+
+    QFile file(args[0]);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        std::cerr << "Failed to open " << args[0].toStdString()
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data)
+    {
+        std::cerr << "Failed to map " << args[0].toStdString()
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    MeshFile::Content content;
+    std::vector<uint8_t> vertexData;
+    std::vector<uint32_t> indexData;
+    if (!convert(reinterpret_cast<const char*>(data), size_t(size),
+                 threadCount, content, vertexData, indexData))
+    {
+        return EXIT_FAILURE;
+    }
+
+    const double acmrBefore = MeshOptimizer::acmr(
+        indexData.data(), content.indexCount, content.vertexCount);
+    if (!parser.isSet(noOptimizeOption))
+        optimize(content, vertexData, indexData);
+    const double acmrAfter = MeshOptimizer::acmr(
+        indexData.data(), content.indexCount, content.vertexCount);
+
+    std::vector<uint16_t> shortIndexData;
+    if (content.vertexCount <= 0x10000)
+    {
+        shortIndexData.assign(indexData.begin(), indexData.end());
+        content.indexType = GL_UNSIGNED_SHORT;
+        content.indexData = shortIndexData.data();
+    }
+    const double convertTime = millisecondsSince(start);
+
+    if (!MeshFile::write(args[1], content))
+        return EXIT_FAILURE;
+
+    std::cout << "Converted " << args[0].toStdString()
+              << " in " << convertTime << " ms with "
+              << threadCount << " threads: "
+              << content.vertexCount << " vertices, "
+              << content.indexCount / 3 << " triangles, "
+              << content.parts.size() << " parts, "
+              << content.vertexStride << " bytes per vertex, "
+              << (content.indexType == GL_UNSIGNED_SHORT ? 16 : 32)
+              << "-bit indices, ACMR " << acmrBefore << " -> "
+              << acmrAfter << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/**
+    @file   mesh_optimizer.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::MeshOptimizer class.
+ **/
+
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace kuu
+{
+
+namespace
+{
+
+// The size of the simulated LRU cache of the optimizer.
+const int CacheSize = 32;
+// Vertices with more remaining triangles than this get the same
+// valence score.
+const int MaxValence = 32;
+
+/* ---------------------------------------------------------------- *
+   The vertex scores of the Forsyth optimizer, indexed by the cache
+   position and by the count of remaining triangles.
+ * ---------------------------------------------------------------- */
+struct ScoreTable
+{
+    ScoreTable()
+    {
+        const float CacheDecayPower   = 1.5f;
+        const float LastTriangleScore = 0.75f;
+        const float ValenceBoostScale = 2.0f;
+        const float ValenceBoostPower = 0.5f;
+
+        // The vertices of the last triangle get a fixed score so
+        // that the next triangle is not chosen only because it
+        // shares the vertices of the last one.
+        for (int i = 0; i < CacheSize; ++i)
+        {
+            if (i < 3)
+            {
+                cache[i] = LastTriangleScore;
+                continue;
+            }
+            const float scale = 1.0f / (CacheSize - 3);
+            cache[i] = std::pow(1.0f - (i - 3) * scale,
+                                CacheDecayPower);
+        }
+
+        // Vertices with few remaining triangles are boosted so that
+        // they are finished and do not need to be loaded again.
+        valence[0] = 0.0f;
+        for (int i = 1; i <= MaxValence; ++i)
+            valence[i] = ValenceBoostScale *
+                         std::pow(float(i), -ValenceBoostPower);
+    }
+
+    // Returns the score of the vertex.
+    float score(int cachePosition, int remaining) const
+    {
+        if (remaining == 0)
+            return -1.0f;
+
+        float s = valence[std::min(remaining, MaxValence)];
+        if (cachePosition >= 0)
+            s += cache[cachePosition];
+        return s;
+    }
+
+    float cache[CacheSize];
+    float valence[MaxValence + 1];
+};
+
+/* ---------------------------------------------------------------- *
+   Returns true if the indices are less than the vertex count.
+ * ---------------------------------------------------------------- */
+bool validIndices(const unsigned int* indices,
+                  int indexCount,
+                  int vertexCount)
+{
+    for (int i = 0; i < indexCount; ++i)
+    {
+        if (indices[i] >= unsigned(vertexCount))
+        {
+            std::cerr << "Mesh index " << indices[i]
+                      << " is out of range of " << vertexCount
+                      << " vertices" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+void MeshOptimizer::optimizeVertexCache(unsigned int* indices,
+                                        int indexCount,
+                                        int vertexCount)
+{
+    const int triangleCount = indexCount / 3;
+    if (triangleCount < 2 ||
+        !validIndices(indices, triangleCount * 3, vertexCount))
+    {
+        return;
+    }
+
+    static const ScoreTable table;
+
+    // The triangles of each vertex. The first 'remaining' triangles
+    // of the list of a vertex are not yet emitted.
+    std::vector<int> remaining(vertexCount, 0);
+    for (int i = 0; i < triangleCount * 3; ++i)
+        remaining[indices[i]]++;
+
+    std::vector<int> first(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        first[v + 1] = first[v] + remaining[v];
+
+    std::vector<int> triangles(triangleCount * 3);
+    std::vector<int> fill(first.begin(), first.end() - 1);
+    for (int i = 0; i < triangleCount * 3; ++i)
+        triangles[fill[indices[i]]++] = i / 3;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        vertexScore[v] = table.score(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    int best = 0;
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        const unsigned int* tri = indices + t * 3;
+        triangleScore[t] = vertexScore[tri[0]] +
+                           vertexScore[tri[1]] +
+                           vertexScore[tri[2]];
+        if (triangleScore[t] > triangleScore[best])
+            best = t;
+    }
+
+    std::vector<unsigned int> output(triangleCount * 3);
+    std::vector<int> cache;
+    std::vector<int> newCache;
+    cache.reserve(CacheSize + 3);
+    newCache.reserve(CacheSize + 3);
+    int nextUnemitted = 0;
+
+    for (int i = 0; i < triangleCount; ++i)
+    {
+        // Continue from the first triangle in the input order if
+        // none of the cached vertices has triangles left.
+        if (best < 0)
+        {
+            while (emitted[nextUnemitted])
+                nextUnemitted++;
+            best = nextUnemitted;
+        }
+
+        const unsigned int* tri = indices + best * 3;
+        std::copy(tri, tri + 3, output.begin() + i * 3);
+        emitted[best] = true;
+
+        // Remove the triangle from the lists of its vertices and put
+        // the vertices to the front of the cache.
+        newCache.clear();
+        for (int c = 0; c < 3; ++c)
+        {
+            const int v = int(tri[c]);
+            int* list = triangles.data() + first[v];
+            int* last = list + remaining[v] - 1;
+            std::iter_swap(std::find(list, last, best), last);
+            remaining[v]--;
+
+            if (std::find(newCache.begin(), newCache.end(), v) ==
+                newCache.end())
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        for (int v : cache)
+        {
+            if (v != int(tri[0]) && v != int(tri[1]) &&
+                v != int(tri[2]))
+                newCache.push_back(v);
+        }
+
+        // Update the scores of the cached vertices and of the
+        // vertices that were pushed out of the cache.
+        for (size_t c = 0; c < newCache.size(); ++c)
+        {
+            const int v = newCache[c];
+            cachePosition[v] = int(c) < CacheSize ? int(c) : -1;
+            vertexScore[v] =
+                table.score(cachePosition[v], remaining[v]);
+        }
+
+        // Choose the best triangle of the cached vertices.
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t c = 0; c < newCache.size(); ++c)
+        {
+            const int v = newCache[c];
+            for (int n = 0; n < remaining[v]; ++n)
+            {
+                const int t = triangles[first[v] + n];
+                const unsigned int* other = indices + t * 3;
+                triangleScore[t] = vertexScore[other[0]] +
+                                   vertexScore[other[1]] +
+                                   vertexScore[other[2]];
+                if (int(c) < CacheSize && triangleScore[t] > bestScore)
+                {
+                    best = t;
+                    bestScore = triangleScore[t];
+                }
+            }
+        }
+
+        if (int(newCache.size()) > CacheSize)
+            newCache.resize(CacheSize);
+        cache.swap(newCache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+/* ---------------------------------------------------------------- */
+
+void MeshOptimizer::optimizeVertexFetch(void* vertices,
+                                        int vertexCount,
+                                        int vertexStride,
+                                        unsigned int* indices,
+                                        int indexCount)
+{
+    if (!validIndices(indices, indexCount, vertexCount))
+        return;
+
+    // The new index of each vertex.
+    const unsigned int Unused = ~0u;
+    std::vector<unsigned int> remap(vertexCount, Unused);
+    unsigned int next = 0;
+    for (int i = 0; i < indexCount; ++i)
+    {
+        unsigned int& index = remap[indices[i]];
+        if (index == Unused)
+            index = next++;
+        indices[i] = index;
+    }
+
+    for (unsigned int& index : remap)
+        if (index == Unused)
+            index = next++;
+
+    const size_t byteSize = size_t(vertexCount) * vertexStride;
+    std::vector<unsigned char> source(byteSize);
+    unsigned char* data = static_cast<unsigned char*>(vertices);
+    std::memcpy(source.data(), data, byteSize);
+    for (int v = 0; v < vertexCount; ++v)
+        std::memcpy(data + size_t(remap[v]) * vertexStride,
+                    source.data() + size_t(v) * vertexStride,
+                    vertexStride);
+}
+
+/* ---------------------------------------------------------------- */
+
+double MeshOptimizer::acmr(const unsigned int* indices,
+                           int indexCount,
+                           int vertexCount,
+                           int cacheSize)
+{
+    const int triangleCount = indexCount / 3;
+    if (triangleCount == 0 ||
+        !validIndices(indices, triangleCount * 3, vertexCount))
+    {
+        return 0.0;
+    }
+
+    // A vertex is in the FIFO cache if less than cache size misses
+    // have happened since it was loaded.
+    std::vector<int> loaded(vertexCount, 0);
+    int misses = 0;
+    int time = cacheSize;
+    for (int i = 0; i < triangleCount * 3; ++i)
+    {
+        const unsigned int v = indices[i];
+        if (time - loaded[v] >= cacheSize)
+        {
+            loaded[v] = time++;
+            misses++;
+        }
+    }
+    return double(misses) / triangleCount;
+}
+
+} // namespace kuu
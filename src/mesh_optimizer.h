@@ -0,0 +1,118 @@
+/**
+    @file   mesh_optimizer.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::MeshOptimizer class.
+ **/
+
+#pragma once
+
+#include <vector>
+
+namespace kuu
+{
+
+/**
+    @brief   Reorders the triangles and vertices of a triangle mesh for
+             the GPU caches.
+
+    @details The GPU keeps the recently transformed vertices in a
+             small post-transform cache so a vertex shared by
+             triangles that are rendered close to each other is
+             transformed only once. @ref optimizeVertexCache reorders
+             the triangles so that the shared vertices are re-used
+             while they are still in the cache. The ordering is done
+             with the linear-speed vertex cache optimisation by Tom
+             Forsyth.
+
+             @ref optimizeVertexFetch then reorders the vertices into
+             the order of their first use, so the vertex data is read
+             from memory mostly sequentially. It should be called
+             after the triangles have been reordered.
+
+             The efficiency of the order is measured with the average
+             cache miss ratio (ACMR), the count of transformed
+             vertices per triangle. It is between 0.5 and 3.0 and the
+             smaller is better.
+
+             The indices are relative to the first vertex and the
+             mesh is a triangle list.
+
+    @code
+    MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+    MeshOptimizer::optimizeVertexFetch(vertices, indices);
+    @endcode
+ **/
+class MeshOptimizer
+{
+public:
+    /**
+        Reorders the triangles for the post-transform vertex cache.
+        @param indices     The indices of the triangles.
+        @param indexCount  The count of indices.
+        @param vertexCount The count of vertices.
+     **/
+    static void optimizeVertexCache(unsigned int* indices,
+                                    int indexCount,
+                                    int vertexCount);
+
+    /**
+        Reorders the triangles for the post-transform vertex cache.
+     **/
+    static void optimizeVertexCache(std::vector<unsigned int>& indices,
+                                    int vertexCount)
+    {
+        optimizeVertexCache(indices.data(), int(indices.size()),
+                            vertexCount);
+    }
+
+    /**
+        Reorders the vertices into the order of their first use and
+        remaps the indices. The unused vertices are moved to the end.
+        @param vertices     The vertex data.
+        @param vertexCount  The count of vertices.
+        @param vertexStride The byte size of a vertex.
+        @param indices      The indices of the triangles.
+        @param indexCount   The count of indices.
+     **/
+    static void optimizeVertexFetch(void* vertices,
+                                    int vertexCount,
+                                    int vertexStride,
+                                    unsigned int* indices,
+                                    int indexCount);
+
+    /**
+        Reorders the vertices into the order of their first use and
+        remaps the indices.
+     **/
+    template<typename Vertex>
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices,
+                                    std::vector<unsigned int>& indices)
+    {
+        optimizeVertexFetch(vertices.data(), int(vertices.size()),
+                            int(sizeof(Vertex)),
+                            indices.data(), int(indices.size()));
+    }
+
+    /**
+        Returns the average cache miss ratio of the triangles with a
+        FIFO cache of the size.
+     **/
+    static double acmr(const unsigned int* indices,
+                       int indexCount,
+                       int vertexCount,
+                       int cacheSize = 32);
+
+    /**
+        Returns the average cache miss ratio of the triangles with a
+        FIFO cache of the size.
+     **/
+    static double acmr(const std::vector<unsigned int>& indices,
+                       int vertexCount,
+                       int cacheSize = 32)
+    {
+        return acmr(indices.data(), int(indices.size()), vertexCount,
+                    cacheSize);
+    }
+};
+
+} // namespace kuu
@@ -8,6 +8,11 @@
 
 #ifdef _WIN32
     #include "glew/glew.h"
-#else
+#elif defined(__APPLE__)
     #include <gl3.h>
+#else
+    // GL_GLEXT_PROTOTYPES is defined by the build so that the
+    // prototypes are available also when Qt includes GL/gl.h first.
+    #include <GL/gl.h>
+    #include <GL/glext.h>
 #endif
@@ -0,0 +1,43 @@
+/**
+    @file   opengl_capabilities.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of the OpenGL capability queries.
+ **/
+
+#include "opengl_capabilities.h"
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/* ---------------------------------------------------------------- */
+
+bool hasVersion(int major, int minor)
+{
+    GLint contextMajor = 0;
+    GLint contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor >  major ||
+          (contextMajor == major && contextMinor >= minor);
+}
+
+/* ---------------------------------------------------------------- */
+
+bool hasExtension(const std::string& name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, i);
+        if (extension && name == (const char*) extension)
+            return true;
+    }
+    return false;
+}
+
+} // namespace opengl
+} // namespace kuu
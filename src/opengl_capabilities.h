@@ -0,0 +1,29 @@
+/**
+    @file   opengl_capabilities.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Queries of the OpenGL capabilities of the current context.
+ **/
+
+#pragma once
+
+#include <string>
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    Returns true if the OpenGL version of the current context is at
+    least the given version.
+ **/
+bool hasVersion(int major, int minor);
+
+/**
+    Returns true if the current context supports the extension, e.g.
+    @c GL_ARB_get_program_binary.
+ **/
+bool hasExtension(const std::string& name);
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,107 @@
+/**
+    @file   opengl_framebuffer_pool.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::FramebufferPool class.
+ **/
+
+#include "opengl_framebuffer_pool.h"
+#include <algorithm>
+#include <deque>
+#include <QtGui/QOpenGLFramebufferObject>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Rounds the value up to the next multiple of step.
+ * ---------------------------------------------------------------- */
+int roundUp(int value, int step)
+{
+    value = std::max(value, 1);
+    return ((value + step - 1) / step) * step;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the framebuffer pool.
+ * ---------------------------------------------------------------- */
+struct FramebufferPool::Data
+{
+    Data(int bucketSize, int capacity)
+        : bucketSize(std::max(bucketSize, 1))
+        , capacity(std::max(capacity, 0))
+    {}
+
+    int bucketSize;
+    int capacity;
+    // Released framebuffers, the least recently released first.
+    std::deque<std::shared_ptr<QOpenGLFramebufferObject>> released;
+};
+
+/* ---------------------------------------------------------------- */
+
+FramebufferPool::FramebufferPool(int bucketSize, int capacity)
+    : d(std::make_shared<Data>(bucketSize, capacity))
+{}
+
+/* ---------------------------------------------------------------- */
+
+QSize FramebufferPool::bucket(const QSize& size) const
+{
+    return QSize(roundUp(size.width(),  d->bucketSize),
+                 roundUp(size.height(), d->bucketSize));
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<QOpenGLFramebufferObject>
+    FramebufferPool::acquire(const QSize& size)
+{
+    const QSize bucketSize = bucket(size);
+
+    // Reuse the most recently released framebuffer of the bucket.
+    for (auto it = d->released.rbegin(); it != d->released.rend(); ++it)
+    {
+        if ((*it)->size() == bucketSize)
+        {
+            std::shared_ptr<QOpenGLFramebufferObject> fbo = *it;
+            d->released.erase(std::next(it).base());
+            return fbo;
+        }
+    }
+
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(
+        QOpenGLFramebufferObject::CombinedDepthStencil);
+    return std::make_shared<QOpenGLFramebufferObject>(
+        bucketSize, format);
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramebufferPool::release(
+    std::shared_ptr<QOpenGLFramebufferObject> fbo)
+{
+    if (!fbo)
+        return;
+
+    d->released.push_back(fbo);
+    while (int(d->released.size()) > d->capacity)
+        d->released.pop_front();
+}
+
+/* ---------------------------------------------------------------- */
+
+void FramebufferPool::clear()
+{
+    d->released.clear();
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,78 @@
+/**
+    @file   opengl_framebuffer_pool.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::FramebufferPool class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QSize>
+
+class QOpenGLFramebufferObject;
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   A size-bucketed pool of framebuffer objects.
+
+    @details The requested framebuffer sizes are rounded up to the
+             next multiple of the bucket size. A framebuffer that is
+             given back to pool with @ref release can then be reused
+             for any size that falls into the same bucket. This way a
+             drag-resize of the widget only allocates a new framebuffer
+             when the size crosses a bucket boundary.
+
+             The caller renders only into the requested area of the
+             framebuffer, starting from the bottom-left corner.
+
+             The pool keeps a limited count of released framebuffers,
+             the least recently released ones are destroyed first.
+             The pool must only be used while the OpenGL context that
+             owns the framebuffers is current.
+ **/
+class FramebufferPool
+{
+public:
+    /**
+        @brief Constructs the framebuffer pool.
+        @param bucketSize The size granularity of framebuffers in
+                          pixels.
+        @param capacity   The maximum count of released framebuffers
+                          that are kept for reuse.
+     **/
+    FramebufferPool(int bucketSize = 64, int capacity = 4);
+
+    /**
+        Returns the size of the framebuffer that would be used for
+        the given in size.
+     **/
+    QSize bucket(const QSize& size) const;
+
+    /**
+        Returns a framebuffer that is large enough for the given in
+        size. A released framebuffer of the same bucket is reused if
+        there is one, otherwise a new framebuffer is created.
+     **/
+    std::shared_ptr<QOpenGLFramebufferObject> acquire(const QSize& size);
+
+    /**
+        Gives the framebuffer back to pool.
+     **/
+    void release(std::shared_ptr<QOpenGLFramebufferObject> fbo);
+
+    /**
+        Destroys the released framebuffers.
+     **/
+    void clear();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
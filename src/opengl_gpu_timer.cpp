@@ -0,0 +1,115 @@
+/**
+    @file   opengl_gpu_timer.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::GpuTimer class.
+ **/
+
+#include "opengl_gpu_timer.h"
+#include <algorithm>
+#include <vector>
+
+namespace kuu
+{
+namespace opengl
+{
+
+/* ---------------------------------------------------------------- *
+   The data of the GPU timer.
+ * ---------------------------------------------------------------- */
+struct GpuTimer::Data
+{
+    // Constructs the GPU timer data.
+    Data(int stageCount, int latency)
+        : stageCount(std::max(stageCount, 1))
+        , latency(std::max(latency, 2))
+        , queries(this->stageCount * this->latency, 0)
+        , issued(queries.size(), false)
+        , elapsed(this->stageCount, 0.0)
+    {
+        glGenQueries(GLsizei(queries.size()), queries.data());
+    }
+
+    // Destroys the GPU timer data. OpenGL resources are freed.
+    ~Data()
+    {
+        glDeleteQueries(GLsizei(queries.size()), queries.data());
+    }
+
+    // Reads the results of the frame in the ring if available.
+    void read(int frame)
+    {
+        for (int stage = 0; stage < stageCount; ++stage)
+        {
+            const int i = frame * stageCount + stage;
+            if (!issued[i])
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i],
+                               GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+            if (available)
+            {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+                elapsed[stage] = double(ns) / 1000000.0;
+            }
+            issued[i] = false;
+        }
+    }
+
+    int stageCount;
+    int latency;
+    int frame = 0;
+    std::vector<GLuint> queries; // [frame][stage]
+    std::vector<bool> issued;    // true if query is issued
+    std::vector<double> elapsed; // latest results in milliseconds
+};
+
+/* ---------------------------------------------------------------- */
+
+GpuTimer::GpuTimer(int stageCount, int latency)
+    : d(std::make_shared<Data>(stageCount, latency))
+{}
+
+/* ---------------------------------------------------------------- */
+
+void GpuTimer::beginFrame()
+{
+    // The oldest frame of the ring is reused by this frame.
+    d->frame = (d->frame + 1) % d->latency;
+    d->read(d->frame);
+}
+
+/* ---------------------------------------------------------------- */
+
+void GpuTimer::begin(int stage)
+{
+    if (stage < 0 || stage >= d->stageCount)
+        return;
+
+    const int i = d->frame * d->stageCount + stage;
+    glBeginQuery(GL_TIME_ELAPSED, d->queries[i]);
+    d->issued[i] = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void GpuTimer::end(int stage)
+{
+    if (stage < 0 || stage >= d->stageCount)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+/* ---------------------------------------------------------------- */
+
+double GpuTimer::elapsed(int stage) const
+{
+    if (stage < 0 || stage >= d->stageCount)
+        return 0.0;
+    return d->elapsed[stage];
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,83 @@
+/**
+    @file   opengl_gpu_timer.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::GpuTimer class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   Measures the GPU time of frame stages.
+
+    @details Each stage is measured with a @c GL_TIME_ELAPSED query.
+             The queries are kept in a ring of frames so that the
+             results are read a few frames after they were issued,
+             when they are already available. Reading the results
+             never stalls the pipeline: if a result is still not
+             available when its query is about to be reused then the
+             sample is dropped.
+
+             Stages must not overlap as only one elapsed time query
+             can be active at a time.
+
+    @code
+    GpuTimer timer(2);
+    ...
+    timer.beginFrame();
+    timer.begin(0);
+    ...
+    timer.end(0);
+    timer.begin(1);
+    ...
+    timer.end(1);
+    double milliseconds = timer.elapsed(1);
+    @endcode
+ **/
+class GpuTimer
+{
+public:
+    /**
+        @brief Constructs the GPU timer.
+        @note  OpenGL context must be valid.
+        @param stageCount Count of stages in a frame.
+        @param latency    Count of frames in the query ring.
+     **/
+    GpuTimer(int stageCount, int latency = 4);
+
+    /**
+        Begins a new frame. The results of the oldest frame in the
+        ring are read if they are available.
+     **/
+    void beginFrame();
+
+    /**
+        Begins to measure the stage.
+     **/
+    void begin(int stage);
+
+    /**
+        Ends to measure the stage.
+     **/
+    void end(int stage);
+
+    /**
+        Returns the most recent available GPU time of the stage in
+        milliseconds.
+     **/
+    double elapsed(int stage) const;
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -5,6 +5,8 @@
  **/
 
 #include "opengl_mesh.h"
+#include "opengl_state_cache.h"
+#include "opengl_streaming_buffer.h"
 #include <iostream>
 
 namespace kuu
@@ -16,36 +18,90 @@ namespace
 {
 
 /* ---------------------------------------------------------------- *
-   Returns true if the given in vertex array object is currently
-   bound into OpenGL context.
+   A vertex attribute definition.
  * ---------------------------------------------------------------- */
-bool isVertexArrayCurrent(GLuint vao)
+struct Attribute
 {
-    GLint current = 0;
-    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current);
-    return current == vao;
+    int index;
+    int tupleSize;
+    int stride;
+    int offset;
+    GLenum type;
+    bool normalized;
+};
+
+/* ---------------------------------------------------------------- *
+   Adds the attribute definition or replaces the definition with the
+   same index.
+ * ---------------------------------------------------------------- */
+void setAttribute(std::vector<Attribute>& attributes,
+                  const Attribute& attribute)
+{
+    for (Attribute& a : attributes)
+    {
+        if (a.index == attribute.index)
+        {
+            a = attribute;
+            return;
+        }
+    }
+    attributes.push_back(attribute);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the index type of the byte size of an index, 0 if there
+   is no such type.
+ * ---------------------------------------------------------------- */
+GLenum indexTypeOfSize(int indexSize)
+{
+    switch (indexSize)
+    {
+        case 1:  return GL_UNSIGNED_BYTE;
+        case 2:  return GL_UNSIGNED_SHORT;
+        case 4:  return GL_UNSIGNED_INT;
+        default: return 0;
+    }
 }
 
 /* ---------------------------------------------------------------- *
-   Returns true if the given in vertex buffer object is currently
-   bound into OpenGL context.
+   Returns the byte size of an index of the index type.
  * ---------------------------------------------------------------- */
-bool isVertexBufferCurrent(GLuint vbo)
+int indexSizeOfType(GLenum indexType)
 {
-    GLint current = 0;
-    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &current);
-    return current == vbo;
+    switch (indexType)
+    {
+        case GL_UNSIGNED_BYTE:  return 1;
+        case GL_UNSIGNED_SHORT: return 2;
+        default:                return 4;
+    }
 }
 
 /* ---------------------------------------------------------------- *
-   Returns true if the given in index buffer object is currently
-   bound into OpenGL context.
+   Returns the index at the position of the index data.
  * ---------------------------------------------------------------- */
-bool isIndexBufferCurrent(GLuint ibo)
+GLuint indexAt(const void* indexData, int indexSize, int i)
 {
-    GLint current = 0;
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &current);
-    return current == ibo;
+    switch (indexSize)
+    {
+        case 1:  return static_cast<const GLubyte*>(indexData)[i];
+        case 2:  return static_cast<const GLushort*>(indexData)[i];
+        default: return static_cast<const GLuint*>(indexData)[i];
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Narrows the 32-bit indices into 16-bit indices. Returns false if
+   an index does not fit into 16 bits.
+ * ---------------------------------------------------------------- */
+bool narrowIndices(const GLuint* indices, int count,
+                   std::vector<GLushort>& narrowed)
+{
+    for (int i = 0; i < count; ++i)
+        if (indices[i] > 0xFFFFu)
+            return false;
+
+    narrowed.assign(indices, indices + count);
+    return true;
 }
 
 } // anonymous namespace
@@ -56,7 +112,10 @@ bool isIndexBufferCurrent(GLuint ibo)
 struct Mesh::Data
 {
     // Constructs the mesh data.
-    Data()
+    Data(Usage vertexUsage, Usage indexUsage, Usage instanceUsage)
+        : vertexUsage(vertexUsage)
+        , indexUsage(indexUsage)
+        , instanceUsage(instanceUsage)
     { createData(); }
 
     // Destroys the mesh data
@@ -71,42 +130,148 @@ struct Mesh::Data
         if (vao == 0)
             std::cerr << "Failed to generate VAO" << std::endl;
 
+        // Streaming buffers allocate their buffers on the first
+        // write. The static instance buffer is created when the
+        // instance data is first written.
+        if (instanceUsage == Usage::Streaming)
+            instanceStream = std::make_shared<StreamingBuffer>();
+
         // Create vertex buffer object.
-        glGenBuffers(1, &vbo);
-        if (vbo == 0)
-            std::cerr << "Failed to generate VBO" << std::endl;
+        if (vertexUsage == Usage::Streaming)
+            vertexStream = std::make_shared<StreamingBuffer>();
+        else
+        {
+            glGenBuffers(1, &vbo);
+            if (vbo == 0)
+                std::cerr << "Failed to generate VBO" << std::endl;
+        }
 
         // Create index buffer object
-        glGenBuffers(1, &ibo);
-        if (ibo == 0)
-            std::cerr << "Failed to generate IBO" << std::endl;
+        if (indexUsage == Usage::Streaming)
+            indexStream = std::make_shared<StreamingBuffer>();
+        else
+        {
+            glGenBuffers(1, &ibo);
+            if (ibo == 0)
+                std::cerr << "Failed to generate IBO" << std::endl;
+        }
     }
 
     // Destroys the mesh. OpenGL resources are freed.
     void destroyData()
     {
-        // Destroy vertex and index buffers
-        glDeleteBuffers(1, &ibo);
-        glDeleteBuffers(1, &vbo);
+        StateCache& cache = StateCache::current();
+        // Destroy instance, vertex and index buffers
+        if (instanceVbo)
+            cache.deleteBuffer(instanceVbo);
+        if (ibo)
+            cache.deleteBuffer(ibo);
+        if (vbo)
+            cache.deleteBuffer(vbo);
         // Destroy vertex array
-        glDeleteVertexArrays(1, &vao);
+        cache.deleteVertexArray(vao);
+    }
+
+    // Points the attributes to the data at the offset of the buffer.
+    void pointAttributes(const std::vector<Attribute>& attributes,
+                         GLuint buffer,
+                         int bufferOffset)
+    {
+        if (buffer == 0 || attributes.empty())
+            return;
+
+        // The attribute takes the buffer that is bound to the array
+        // buffer target when the attribute pointer is set.
+        StateCache& cache = StateCache::current();
+        cache.bindVertexArray(vao);
+        cache.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (const Attribute& a : attributes)
+            glVertexAttribPointer(
+                a.index, a.tupleSize, a.type,
+                a.normalized ? GL_TRUE : GL_FALSE,
+                a.stride,
+                (const GLvoid*) size_t(a.offset + bufferOffset));
     }
 
+    // Reads the data at the offset of the buffer.
+    void read(GLuint buffer, int bufferOffset, int byteCount,
+              void* data)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, bufferOffset,
+                           byteCount, data);
+    }
+
+    // Returns the vertex buffer object name.
+    GLuint vertexBuffer() const
+    { return vertexStream ? vertexStream->buffer() : vbo; }
+
+    // Returns the index buffer object name.
+    GLuint indexBuffer() const
+    { return indexStream ? indexStream->buffer() : ibo; }
+
+    // Returns the instance buffer object name.
+    GLuint instanceBuffer() const
+    {
+        return instanceStream ? instanceStream->buffer()
+                              : instanceVbo;
+    }
+
+    Usage vertexUsage;
+    Usage indexUsage;
+    Usage instanceUsage;
     GLuint vbo = 0; // vertex buffer object name
     GLuint ibo = 0; // index buffer object name
     GLuint vao = 0; // vertex array object name
+    GLuint instanceVbo = 0; // instance buffer object name
     GLuint indexCount  = 0;
+    GLenum indexType   = GL_UNSIGNED_INT;
     GLuint vertexCount = 0;
+    GLuint instanceCount = 0;
+
+    // Streaming buffers, null for the buffers of static usage.
+    std::shared_ptr<StreamingBuffer> vertexStream;
+    std::shared_ptr<StreamingBuffer> indexStream;
+    std::shared_ptr<StreamingBuffer> instanceStream;
+    // Byte offsets of the data in the buffers.
+    int vertexOffset   = 0;
+    int indexOffset    = 0;
+    int instanceOffset = 0;
+
+    // Attribute definitions, re-applied when the data moves.
+    std::vector<Attribute> attributes;
+    std::vector<Attribute> instanceAttributes;
+
+    // 16-bit copy of the written 32-bit indices.
+    std::vector<GLushort> narrowedIndices;
 };
 
 /* ---------------------------------------------------------------- */
 
-Mesh::Mesh()
-    : d(std::make_shared<Data>())
+Mesh::Mesh(Usage usage)
+    : d(std::make_shared<Data>(usage, usage, usage))
+{}
+
+/* ---------------------------------------------------------------- */
+
+Mesh::Mesh(Usage vertexUsage, Usage indexUsage, Usage instanceUsage)
+    : d(std::make_shared<Data>(vertexUsage, indexUsage, instanceUsage))
 {}
 
 /* ---------------------------------------------------------------- */
 
+Mesh::Usage Mesh::usage(Buffer buffer) const
+{
+    switch (buffer)
+    {
+        case Buffer::Vertex: return d->vertexUsage;
+        case Buffer::Index:  return d->indexUsage;
+        default:             return d->instanceUsage;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
 int Mesh::vertexCount() const
 { return d->vertexCount; }
 
@@ -117,37 +282,41 @@ int Mesh::indexCount() const
 
 /* ---------------------------------------------------------------- */
 
+GLenum Mesh::indexType() const
+{ return d->indexType; }
+
+/* ---------------------------------------------------------------- */
+
 void Mesh::writeVertexData(int byteSize,
                            int count,
                            const void* vertexData)
 {
-    glBindVertexArray(d->vao);
-    if (!isVertexArrayCurrent(d->vao))
-        std::cerr << "Failed to bind VAO" << std::endl;
-
-    glBindBuffer(GL_ARRAY_BUFFER, d->vbo);
-    if (!isVertexBufferCurrent(d->vbo))
-        std::cerr << "Failed to bind VBO" << std::endl;
-
     d->vertexCount = count;
+    if (d->vertexStream)
+    {
+        // The previous data was rendered with the commands issued so
+        // far.
+        d->vertexStream->fence();
+        d->vertexOffset = d->vertexStream->write(vertexData, byteSize);
+        d->pointAttributes(d->attributes, d->vertexStream->buffer(),
+                           d->vertexOffset);
+        return;
+    }
+
+    // The array buffer binding is not a part of the vertex array
+    // state so the VAO does not need to be bound.
+    StateCache::current().bindBuffer(GL_ARRAY_BUFFER, d->vbo);
     glBufferData(GL_ARRAY_BUFFER,
                  byteSize,
                  vertexData,
                  GL_STATIC_DRAW);
-
-    glBindVertexArray(0); // VAO before VBO!
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 /* ---------------------------------------------------------------- */
 
 void Mesh::readVertexData(int byteCount, void* data)
 {
-    glBindBuffer(GL_ARRAY_BUFFER, d->vbo);
-    if (!isVertexBufferCurrent(d->vbo))
-        std::cerr << "Failed to bind VBO" << std::endl;
-    glGetBufferSubData(GL_ARRAY_BUFFER, 0, byteCount, data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    d->read(d->vertexBuffer(), d->vertexOffset, byteCount, data);
 }
 
 /* ---------------------------------------------------------------- */
@@ -156,33 +325,82 @@ void Mesh::writeIndexData(int byteSize,
                           int count,
                           const void* indexData)
 {
-    glBindVertexArray(d->vao);
-    if (!isVertexArrayCurrent(d->vao))
-        std::cerr << "Failed to bind VAO" << std::endl;
+    GLenum type = indexTypeOfSize(count > 0 ? byteSize / count : 4);
+    if (type == 0)
+    {
+        std::cerr << "Unsupported index size of "
+                  << byteSize / count << " bytes" << std::endl;
+        return;
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->ibo);
-    if (!isIndexBufferCurrent(d->ibo))
-        std::cerr << "Failed to bind IBO" << std::endl;
+    // Indices of a mesh with at most 65536 vertices fit into 16
+    // bits, which halves the index data read by the GPU.
+    if (type == GL_UNSIGNED_INT &&
+        narrowIndices(static_cast<const GLuint*>(indexData), count,
+                      d->narrowedIndices))
+    {
+        type      = GL_UNSIGNED_SHORT;
+        byteSize  = count * int(sizeof(GLushort));
+        indexData = d->narrowedIndices.data();
+    }
 
     d->indexCount = count;
+    d->indexType  = type;
+    if (d->indexStream)
+    {
+        d->indexStream->fence();
+        d->indexOffset = d->indexStream->write(indexData, byteSize);
+    }
+
+    // The index buffer binding is stored into the VAO.
+    StateCache::current().bindVertexArray(d->vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->indexBuffer());
+    if (d->indexStream)
+        return;
+
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  byteSize,
                  indexData,
                  GL_STATIC_DRAW);
-
-    glBindVertexArray(0); // VAO before IBO!
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    std::vector<GLushort>().swap(d->narrowedIndices);
 }
 
 /* ---------------------------------------------------------------- */
 
 void Mesh::readIndexData(int byteCount, void* data)
 {
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->ibo);
-    if (!isIndexBufferCurrent(d->ibo))
-        std::cerr << "Failed to bind IBO" << std::endl;
-    glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, byteCount, data);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    d->read(d->indexBuffer(), d->indexOffset, byteCount, data);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Mesh::readIndexData(int count, int indexSize, void* data)
+{
+    const int storedSize = indexSizeOfType(d->indexType);
+    if (indexSize == storedSize)
+    {
+        readIndexData(count * indexSize, data);
+        return;
+    }
+
+    std::vector<unsigned char> stored(size_t(count) * storedSize);
+    readIndexData(int(stored.size()), stored.data());
+    for (int i = 0; i < count; ++i)
+    {
+        const GLuint index = indexAt(stored.data(), storedSize, i);
+        switch (indexSize)
+        {
+            case 1:
+                static_cast<GLubyte*>(data)[i] = GLubyte(index);
+                break;
+            case 2:
+                static_cast<GLushort*>(data)[i] = GLushort(index);
+                break;
+            default:
+                static_cast<GLuint*>(data)[i] = index;
+                break;
+        }
+    }
 }
 
 /* ---------------------------------------------------------------- */
@@ -191,52 +409,117 @@ void Mesh::setAttributeDefinition(int index,
                                   int tupleSize,
                                   int stride,
                                   int offset,
-                                  GLenum type)
+                                  GLenum type,
+                                  bool normalized)
 {
-    glBindVertexArray(d->vao);
-    if (!isVertexArrayCurrent(d->vao))
-        std::cerr << "Failed to bind VAO" << std::endl;
+    const Attribute attribute = { index, tupleSize, stride, offset,
+                                  type, normalized };
+    setAttribute(d->attributes, attribute);
 
-    glBindBuffer(GL_ARRAY_BUFFER, d->vbo);
-    if (!isVertexBufferCurrent(d->vbo))
-        std::cerr << "Failed to bind VBO" << std::endl;
+    StateCache::current().bindVertexArray(d->vao);
+    glEnableVertexAttribArray(index);
+    d->pointAttributes(std::vector<Attribute>(1, attribute),
+                       d->vertexBuffer(), d->vertexOffset);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, d->ibo);
-    if (!isIndexBufferCurrent(d->ibo))
-        std::cerr << "Failed to bind IBO" << std::endl;
+/* ---------------------------------------------------------------- */
 
-    glEnableVertexAttribArray(index);
-    glVertexAttribPointer(
-        index, tupleSize, type, GL_FALSE,
-        stride,
-        (const GLvoid*) offset);
+void Mesh::writeInstanceData(int byteSize,
+                             int count,
+                             const void* instanceData)
+{
+    d->instanceCount = count;
+    if (d->instanceStream)
+    {
+        d->instanceStream->fence();
+        d->instanceOffset =
+            d->instanceStream->write(instanceData, byteSize);
+        d->pointAttributes(d->instanceAttributes,
+                           d->instanceStream->buffer(),
+                           d->instanceOffset);
+        return;
+    }
+
+    // The instance buffer is created when it is first needed.
+    bool created = false;
+    if (d->instanceVbo == 0)
+    {
+        glGenBuffers(1, &d->instanceVbo);
+        if (d->instanceVbo == 0)
+            std::cerr << "Failed to generate instance VBO"
+                      << std::endl;
+        created = true;
+    }
 
-    glBindVertexArray(0); // VAO before VBO and IBO!
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // The data is written on every frame, re-specifying the whole
+    // buffer lets the driver give new storage instead of waiting for
+    // the previous draw to finish.
+    StateCache::current().bindBuffer(GL_ARRAY_BUFFER, d->instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 byteSize,
+                 instanceData,
+                 GL_STREAM_DRAW);
+
+    if (created)
+        d->pointAttributes(d->instanceAttributes, d->instanceVbo, 0);
+}
+
+/* ---------------------------------------------------------------- */
+
+int Mesh::instanceCount() const
+{ return d->instanceCount; }
+
+/* ---------------------------------------------------------------- */
+
+void Mesh::setInstanceAttributeDefinition(int index,
+                                          int tupleSize,
+                                          int stride,
+                                          int offset,
+                                          int divisor,
+                                          GLenum type,
+                                          bool normalized)
+{
+    const Attribute attribute = { index, tupleSize, stride, offset,
+                                  type, normalized };
+    setAttribute(d->instanceAttributes, attribute);
+
+    StateCache::current().bindVertexArray(d->vao);
+    glEnableVertexAttribArray(index);
+    glVertexAttribDivisor(index, divisor);
+    d->pointAttributes(std::vector<Attribute>(1, attribute),
+                       d->instanceBuffer(), d->instanceOffset);
 }
 
 /* ---------------------------------------------------------------- */
 
 void Mesh::bind()
 {
-    glBindVertexArray(d->vao);
-    if (!isVertexArrayCurrent(d->vao))
-        std::cerr << "Failed to bind VAO" << std::endl;
+    StateCache::current().bindVertexArray(d->vao);
 }
 
 /* ---------------------------------------------------------------- */
 
 void Mesh::release()
 {
-    glBindVertexArray(0);
+    StateCache::current().bindVertexArray(0);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Mesh::render(GLenum drawStyle)
+{
+    glDrawElements(drawStyle, d->indexCount, d->indexType,
+                   (const GLvoid*) size_t(d->indexOffset));
 }
 
 /* ---------------------------------------------------------------- */
 
-void Mesh::render(GLenum drawStyle, GLenum indexDataType)
+void Mesh::renderInstanced(int instanceCount,
+                           GLenum drawStyle)
 {
-    glDrawElements(drawStyle, d->indexCount, indexDataType, 0);
+    glDrawElementsInstanced(drawStyle, d->indexCount, d->indexType,
+                            (const GLvoid*) size_t(d->indexOffset),
+                            instanceCount);
 }
 
 } // namespace opengl
@@ -9,6 +9,7 @@
 #include <memory>
 #include <vector>
 #include "opengl.h"
+#include "opengl_vertex_format.h"
 
 namespace kuu
 {
@@ -56,14 +57,87 @@ namespace opengl
     mesh->setAttributeDefinition(1, 3, 6 * sizeof(float),
                                  3 * sizeof(float));
     @endcode
+
+    The vertices can also be typed with a @ref VertexFormat that
+    derives the attribute definitions at compile time:
+
+    @code
+    typedef VertexFormat<vertex::Float3, vertex::UNorm8x4> Format;
+    const std::vector<Format::Vertex> vertices =
+    {
+        Format::Vertex(glm::vec3(-w, -h, 0.0f),
+                       glm::u8vec4(255, 0, 0, 255)),
+        ...
+    };
+
+    mesh->writeVertices(vertices);
+    mesh->writeIndexData(indexData);
+    mesh->setVertexFormat<Format>();
+    @endcode
+
+    A mesh whose data changes on every frame should be constructed
+    with @ref Usage::Streaming. The vertex, index and instance data
+    are then written into @ref StreamingBuffer rings instead of being
+    re-specified, so a write never waits for the draws of the
+    previous frames. Each write of streaming data starts a new frame
+    of that data: the data written previously must not be rendered
+    after the write.
+
+    The usage can also be given per buffer, e.g. an instanced mesh
+    keeps its vertices and indices in static buffers and streams
+    only the instance data:
+
+    @code
+    Mesh mesh(Mesh::Usage::Static,     // vertices
+              Mesh::Usage::Static,     // indices
+              Mesh::Usage::Streaming); // instances
+    @endcode
+
+    The objects are bound through the @ref StateCache of the current
+    context. The write, read and definition functions leave the
+    vertex array bound, call @ref release before giving the context
+    to code that does not use the cache.
  **/
 class Mesh
 {
 public:
+    /**
+        How often the data of the mesh is written.
+     **/
+    enum class Usage
+    {
+        Static,   // written once and rendered many times
+        Streaming // written on every frame
+    };
+
+    /**
+        The buffers of the mesh.
+     **/
+    enum class Buffer
+    {
+        Vertex,
+        Index,
+        Instance
+    };
+
     /**
         Constructs the mesh without vertices.
+        @param usage How often the data of the mesh is written.
+     **/
+    explicit Mesh(Usage usage = Usage::Static);
+
+    /**
+        Constructs the mesh without vertices with a usage per buffer.
+        @param vertexUsage   How often the vertices are written.
+        @param indexUsage    How often the indices are written.
+        @param instanceUsage How often the instance data is written.
      **/
-    Mesh();
+    Mesh(Usage vertexUsage, Usage indexUsage, Usage instanceUsage);
+
+    /**
+        Returns how often the data of the buffer is written.
+     **/
+    Usage usage(Buffer buffer) const;
 
     /**
        Writes a vector of vertex data into device.
@@ -90,6 +164,33 @@ public:
     void writeVertexData(int byteSize, int count,
                          const void* vertexData);
 
+    /**
+       Writes a vector of vertices of a @ref VertexFormat into device.
+
+       @note The existing data is overwritten.
+       @param vertices The vertices.
+     */
+    template<typename Vertex>
+    void writeVertices(const std::vector<Vertex>& vertices)
+    {
+        writeVertices(vertices.data(), int(vertices.size()));
+    }
+
+    /**
+       Writes vertices of a @ref VertexFormat into device.
+
+       @param vertices The vertices. The pointer must be valid.
+       @param count    The count of vertices.
+     */
+    template<typename Vertex>
+    void writeVertices(const Vertex* vertices, int count)
+    {
+        typedef typename Vertex::Format Format;
+        static_assert(sizeof(Vertex) == Format::stride,
+                      "Vertex does not match its format");
+        writeVertexData(count * Format::stride, count, vertices);
+    }
+
     /**
        Reads the vector of vertex data from the device.
 
@@ -139,6 +240,11 @@ public:
     /**
        Writes the index data into device.
 
+       The index type is chosen by the byte size of an index. The
+       32-bit indices are narrowed into 16-bit indices when all of
+       them fit, so the data read by the GPU is halved for meshes of
+       at most 65536 vertices. The type is returned by @ref indexType.
+
        @note The existing data is overwritten.
 
        @param byteSize  The size of the indexData in bytes.
@@ -158,12 +264,24 @@ public:
     void readIndexData(std::vector<T>& indexData)
     {
         indexData.resize(indexCount());
-        readIndexData(indexData.size() * sizeof(T),
+        readIndexData(int(indexData.size()), int(sizeof(T)),
                       indexData.data());
     }
 
     /**
-       Reads the index data from the device.
+       Reads the indices from the device and converts them into the
+       index size.
+
+       @param count     The count of indices to read.
+       @param indexSize The byte size of an index in data.
+       @param data      The index data. The pointer must be valid and
+                        contain enough memory to hold the indices.
+    **/
+    void readIndexData(int count, int indexSize, void* data);
+
+    /**
+       Reads the index data from the device. The data is in the
+       format of the @ref indexType.
 
        @note The @ref data must be pre-allocated.
 
@@ -180,6 +298,47 @@ public:
      **/
     int indexCount() const;
 
+    /**
+       Returns the type of the written index data, e.g. @c
+       GL_UNSIGNED_SHORT.
+     **/
+    GLenum indexType() const;
+
+    /**
+       Writes a vector of per-instance data into device.
+
+       @note The existing data is overwritten.
+       @param instanceData The instance data vector.
+     */
+    template<typename T>
+    void writeInstanceData(const std::vector<T>& instanceData)
+    {
+        writeInstanceData(instanceData.size() * sizeof(T),
+                          instanceData.size(),
+                          instanceData.data());
+    }
+
+    /**
+       Writes per-instance data into device.
+
+       The instance data is stored into a separate buffer that is
+       created on the first write. With the static usage the buffer
+       is re-specified on each write so it can be written on every
+       frame.
+
+       @param byteSize     The size of instance data in bytes.
+       @param count        The count of instances in the data.
+       @param instanceData Unmutable instance data pointer. The
+                           pointer must be valid.
+     */
+    void writeInstanceData(int byteSize, int count,
+                           const void* instanceData);
+
+    /**
+        Returns the count of written instances.
+     **/
+    int instanceCount() const;
+
     /**
         Sets the vertex attribute definition.
 
@@ -200,14 +359,60 @@ public:
                         this in memory: @c [x][y]|z][u][v][nx][ny][nz]
                         then when settings normal attribute the offset
                         would be @c 6*sizeof(float).
-        @param type     The data type of the attribute.
+        @param type       The data type of the attribute.
+        @param normalized True if integer data is normalized into
+                          [0, 1] or [-1, 1] when the shader reads it.
      **/
     void setAttributeDefinition(
         int index,
         int tupleSize,
         int stride,
         int offset,
-        GLenum type = GL_FLOAT);
+        GLenum type = GL_FLOAT,
+        bool normalized = false);
+
+    /**
+        Sets the vertex attribute definitions of the @ref
+        VertexFormat. The attributes are set into locations from 0
+        onwards in the order of the format.
+     **/
+    template<typename Format>
+    void setVertexFormat()
+    {
+        Format::forEachAttribute(
+            [this](int index, int tupleSize, GLenum type,
+                   bool normalized, int offset)
+            {
+                setAttributeDefinition(index, tupleSize,
+                                       Format::stride, offset,
+                                       type, normalized);
+            });
+    }
+
+    /**
+        Sets the per-instance attribute definition.
+
+        The attribute is read from the instance buffer written with
+        @ref writeInstanceData. A matrix attribute takes a location
+        per column.
+
+        @param index     The attribute index.
+        @param tupleSize The count of components in attribute.
+        @param stride    The byte size of single instance.
+        @param offset    The offset of attribute from the start of the
+                         instance.
+        @param divisor   The count of instances that share the value.
+        @param type      The data type of the attribute.
+        @param normalized True if integer data is normalized.
+     **/
+    void setInstanceAttributeDefinition(
+        int index,
+        int tupleSize,
+        int stride,
+        int offset,
+        int divisor = 1,
+        GLenum type = GL_FLOAT,
+        bool normalized = false);
 
     /**
         Binds the mesh into OpenGL context.
@@ -222,25 +427,29 @@ public:
     /**
         Renders the mesh.
 
-        Renders the mesh with the given in drawing style and index
-        data type. The type must be the same that was used when the
-        index data was set with @ref writeIndexData function.
+        Renders the mesh with the given in drawing style. The indices
+        are read with the @ref indexType of the written index data.
 
         The mesh must be bound into OpenGL context by calling @ref
         bind before the mesh can be rendered.
 
-        @param drawStyleThe  OpenGL primitive type of the mesh, e.g.
-                             for triangle mesh this would be @c
-                             GL_TRIANGLES, for points @c GL_POINTS
-                             etc.
+        @param drawStyle The OpenGL primitive type of the mesh, e.g.
+                         for triangle mesh this would be @c
+                         GL_TRIANGLES, for points @c GL_POINTS etc.
+     **/
+    void render(GLenum drawStyle = GL_TRIANGLES);
+
+    /**
+        Renders the instances of the mesh with a single draw call.
+
+        The mesh must be bound into OpenGL context by calling @ref
+        bind before the mesh can be rendered.
 
-        @param indexDataType Index data type which was used with @ref
-                             @ref setIndexData function, e.g. with @c
-                             uint data type this would be @c
-                             GL_UNSIGNED_INT.
+        @param instanceCount The count of instances to render.
+        @param drawStyle     The OpenGL primitive type of the mesh.
      **/
-    void render(GLenum drawStyle = GL_TRIANGLES,
-                GLenum indexDataType = GL_UNSIGNED_INT);
+    void renderInstanced(int instanceCount,
+                         GLenum drawStyle = GL_TRIANGLES);
 
 private:
     struct Data;
@@ -0,0 +1,431 @@
+/**
+    @file   opengl_mesh_arena.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::MeshArena class.
+ **/
+
+#include "opengl_mesh_arena.h"
+#include "opengl_state_cache.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   A first-fit free-list of element ranges. The free ranges are kept
+   ordered by their offsets so that the neighbours can be merged.
+ * ---------------------------------------------------------------- */
+class FreeList
+{
+public:
+    // Adds the range into free-list.
+    void add(int offset, int size)
+    {
+        if (size <= 0)
+            return;
+
+        Ranges::iterator next = ranges_.lower_bound(offset);
+
+        // Merge with the following range.
+        if (next != ranges_.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = ranges_.erase(next);
+        }
+
+        // Merge with the preceding range.
+        if (next != ranges_.begin())
+        {
+            Ranges::iterator prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+
+        ranges_[offset] = size;
+    }
+
+    // Takes a range of the size from the free-list. Returns the
+    // offset of the range or -1 if there is no large enough range.
+    int take(int size)
+    {
+        for (Ranges::iterator it = ranges_.begin();
+             it != ranges_.end(); ++it)
+        {
+            if (it->second < size)
+                continue;
+
+            const int offset = it->first;
+            const int left   = it->second - size;
+            ranges_.erase(it);
+            if (left > 0)
+                ranges_[offset + size] = left;
+            return offset;
+        }
+        return -1;
+    }
+
+private:
+    // Free ranges as offset -> size.
+    typedef std::map<int, int> Ranges;
+    Ranges ranges_;
+};
+
+/* ---------------------------------------------------------------- *
+   A vertex attribute definition.
+ * ---------------------------------------------------------------- */
+struct Attribute
+{
+    int index;
+    int tupleSize;
+    int offset;
+    GLenum type;
+    bool normalized;
+};
+
+/* ---------------------------------------------------------------- *
+   A buffer of the arena and its free-list.
+ * ---------------------------------------------------------------- */
+struct ArenaBuffer
+{
+    // Creates the buffer with the capacity of elements.
+    void create(int elementSize, int elementCapacity)
+    {
+        size     = elementSize;
+        capacity = std::max(elementCapacity, 1);
+
+        glGenBuffers(1, &buffer);
+        if (buffer == 0)
+            std::cerr << "Failed to generate arena buffer"
+                      << std::endl;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER,
+                     GLsizeiptr(capacity) * size,
+                     nullptr, GL_STATIC_DRAW);
+        freeList.add(0, capacity);
+    }
+
+    // Allocates the count of elements, grows the buffer if needed.
+    // Returns true if the buffer object was replaced.
+    bool allocate(int count, int& offset)
+    {
+        offset = freeList.take(count);
+        if (offset >= 0)
+            return false;
+
+        grow(std::max(capacity * 2, capacity + count));
+        offset = freeList.take(count);
+        return true;
+    }
+
+    // Grows the buffer into the new capacity. The contents are
+    // copied into the new buffer.
+    void grow(int newCapacity)
+    {
+        GLuint newBuffer = 0;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER,
+                     GLsizeiptr(newCapacity) * size,
+                     nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            0, 0, GLsizeiptr(capacity) * size);
+
+        StateCache::current().deleteBuffer(buffer);
+        buffer = newBuffer;
+        freeList.add(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+
+    // Writes the elements at the offset.
+    void write(int offset, int count, const void* data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER,
+                        GLintptr(offset) * size,
+                        GLsizeiptr(count) * size,
+                        data);
+    }
+
+    // Copies the elements from the start of the source buffer at
+    // the offset.
+    void copy(int offset, int count, GLuint source)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            0, GLintptr(offset) * size,
+                            GLsizeiptr(count) * size);
+    }
+
+    GLuint buffer = 0; // buffer object name
+    int size = 0;      // byte size of an element
+    int capacity = 0;  // count of elements
+    FreeList freeList;
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the mesh arena.
+ * ---------------------------------------------------------------- */
+struct MeshArena::Data
+{
+    // Constructs the mesh arena data.
+    Data(int vertexStride,
+         GLenum indexType,
+         int vertexCapacity,
+         int indexCapacity)
+        : indexType(indexType)
+    {
+        glGenVertexArrays(1, &vao);
+        if (vao == 0)
+            std::cerr << "Failed to generate VAO" << std::endl;
+
+        vertices.create(vertexStride, vertexCapacity);
+        indices.create(indexType == GL_UNSIGNED_SHORT
+                           ? sizeof(GLushort) : sizeof(GLuint),
+                       indexCapacity);
+        bindIndexBuffer();
+    }
+
+    // Destroys the mesh arena data. OpenGL resources are freed.
+    ~Data()
+    {
+        StateCache& cache = StateCache::current();
+        cache.deleteBuffer(indices.buffer);
+        cache.deleteBuffer(vertices.buffer);
+        cache.deleteVertexArray(vao);
+    }
+
+    // Binds the index buffer into vertex array.
+    void bindIndexBuffer()
+    {
+        StateCache::current().bindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.buffer);
+    }
+
+    // Allocates the ranges of a mesh.
+    MeshHandle allocate(int vertexCount, int indexCount)
+    {
+        MeshHandle mesh;
+        if (vertexCount <= 0 || indexCount <= 0)
+            return mesh;
+
+        // A new buffer object needs to be bound into the vertex
+        // array.
+        if (vertices.allocate(vertexCount, mesh.baseVertex))
+            pointAttributes();
+        if (indices.allocate(indexCount, mesh.firstIndex))
+            bindIndexBuffer();
+
+        mesh.vertexCount = vertexCount;
+        mesh.indexCount  = indexCount;
+        return mesh;
+    }
+
+    // Points the attributes into the vertex buffer.
+    void pointAttributes()
+    {
+        StateCache& cache = StateCache::current();
+        cache.bindVertexArray(vao);
+        cache.bindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+        for (const Attribute& a : attributes)
+            glVertexAttribPointer(
+                a.index, a.tupleSize, a.type,
+                a.normalized ? GL_TRUE : GL_FALSE,
+                vertices.size,
+                (const GLvoid*) size_t(a.offset));
+    }
+
+    GLuint vao = 0; // vertex array object name
+    GLenum indexType;
+    ArenaBuffer vertices;
+    ArenaBuffer indices;
+    std::vector<Attribute> attributes;
+
+    // Arguments of the multi-draw, kept to avoid allocations.
+    std::vector<GLsizei> counts;
+    std::vector<const GLvoid*> offsets;
+    std::vector<GLint> baseVertices;
+};
+
+/* ---------------------------------------------------------------- */
+
+MeshArena::MeshArena(int vertexStride,
+                     GLenum indexType,
+                     int vertexCapacity,
+                     int indexCapacity)
+{
+    if (indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT)
+    {
+        std::cerr << "Mesh arena index type " << indexType
+                  << " is not supported, using 32-bit indices"
+                  << std::endl;
+        indexType = GL_UNSIGNED_INT;
+    }
+    d = std::make_shared<Data>(vertexStride, indexType,
+                               vertexCapacity, indexCapacity);
+}
+
+/* ---------------------------------------------------------------- */
+
+int MeshArena::vertexStride() const
+{ return d->vertices.size; }
+
+/* ---------------------------------------------------------------- */
+
+GLenum MeshArena::indexType() const
+{ return d->indexType; }
+
+/* ---------------------------------------------------------------- */
+
+int MeshArena::indexSize() const
+{ return d->indices.size; }
+
+/* ---------------------------------------------------------------- */
+
+void MeshArena::setAttributeDefinition(int index,
+                                       int tupleSize,
+                                       int offset,
+                                       GLenum type,
+                                       bool normalized)
+{
+    const Attribute attribute = { index, tupleSize, offset, type,
+                                  normalized };
+    std::vector<Attribute>::iterator it =
+        std::find_if(d->attributes.begin(), d->attributes.end(),
+                     [index](const Attribute& a)
+                     { return a.index == index; });
+    if (it != d->attributes.end())
+        *it = attribute;
+    else
+        d->attributes.push_back(attribute);
+
+    StateCache& cache = StateCache::current();
+    cache.bindVertexArray(d->vao);
+    cache.bindBuffer(GL_ARRAY_BUFFER, d->vertices.buffer);
+    glEnableVertexAttribArray(index);
+    glVertexAttribPointer(
+        index, tupleSize, type,
+        normalized ? GL_TRUE : GL_FALSE,
+        d->vertices.size,
+        (const GLvoid*) size_t(offset));
+}
+
+/* ---------------------------------------------------------------- */
+
+MeshHandle MeshArena::allocate(const void* vertices,
+                               int vertexCount,
+                               const void* indices,
+                               int indexCount)
+{
+    const MeshHandle mesh = d->allocate(vertexCount, indexCount);
+    if (!mesh.isValid())
+        return mesh;
+
+    d->vertices.write(mesh.baseVertex, vertexCount, vertices);
+    d->indices.write(mesh.firstIndex, indexCount, indices);
+    return mesh;
+}
+
+/* ---------------------------------------------------------------- */
+
+MeshHandle MeshArena::allocateFromBuffers(GLuint vertexBuffer,
+                                          int vertexCount,
+                                          GLuint indexBuffer,
+                                          int indexCount)
+{
+    const MeshHandle mesh = d->allocate(vertexCount, indexCount);
+    if (!mesh.isValid())
+        return mesh;
+
+    d->vertices.copy(mesh.baseVertex, vertexCount, vertexBuffer);
+    d->indices.copy(mesh.firstIndex, indexCount, indexBuffer);
+    return mesh;
+}
+
+/* ---------------------------------------------------------------- */
+
+void MeshArena::free(const MeshHandle& mesh)
+{
+    if (!mesh.isValid())
+        return;
+    d->vertices.freeList.add(mesh.baseVertex, mesh.vertexCount);
+    d->indices.freeList.add(mesh.firstIndex, mesh.indexCount);
+}
+
+/* ---------------------------------------------------------------- */
+
+int MeshArena::vertexCapacity() const
+{ return d->vertices.capacity; }
+
+/* ---------------------------------------------------------------- */
+
+int MeshArena::indexCapacity() const
+{ return d->indices.capacity; }
+
+/* ---------------------------------------------------------------- */
+
+void MeshArena::bind()
+{
+    StateCache::current().bindVertexArray(d->vao);
+}
+
+/* ---------------------------------------------------------------- */
+
+void MeshArena::render(const MeshHandle& mesh, GLenum drawStyle)
+{
+    if (!mesh.isValid())
+        return;
+
+    glDrawElementsBaseVertex(
+        drawStyle, mesh.indexCount, d->indexType,
+        (const GLvoid*) (size_t(mesh.firstIndex) * d->indices.size),
+        mesh.baseVertex);
+}
+
+/* ---------------------------------------------------------------- */
+
+void MeshArena::render(const std::vector<MeshHandle>& meshes,
+                       GLenum drawStyle)
+{
+    d->counts.clear();
+    d->offsets.clear();
+    d->baseVertices.clear();
+    for (const MeshHandle& mesh : meshes)
+    {
+        if (!mesh.isValid())
+            continue;
+        d->counts.push_back(mesh.indexCount);
+        d->offsets.push_back((const GLvoid*)
+            (size_t(mesh.firstIndex) * d->indices.size));
+        d->baseVertices.push_back(mesh.baseVertex);
+    }
+
+    if (d->counts.empty())
+        return;
+
+    glMultiDrawElementsBaseVertex(
+        drawStyle,
+        d->counts.data(),
+        d->indexType,
+        d->offsets.data(),
+        GLsizei(d->counts.size()),
+        d->baseVertices.data());
+}
+
+} // namespace opengl
+} // namespace kuu
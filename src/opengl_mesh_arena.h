@@ -0,0 +1,205 @@
+/**
+    @file   opengl_mesh_arena.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::MeshArena class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "opengl.h"
+#include "opengl_vertex_format.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    A handle of a mesh allocated from a @ref MeshArena.
+ **/
+struct MeshHandle
+{
+    int baseVertex  = -1; // index of the first vertex in the arena
+    int vertexCount = 0;
+    int firstIndex  = -1; // index of the first index in the arena
+    int indexCount  = 0;
+
+    /**
+        Returns true if the handle refers to an allocated mesh.
+     **/
+    bool isValid() const
+    { return firstIndex >= 0; }
+};
+
+/**
+    @brief   Many meshes in a single vertex and index buffer.
+
+    @details The meshes of the arena are sub-allocated from one vertex
+             buffer and one index buffer that are bound into one
+             vertex array, so rendering many meshes needs no buffer
+             or vertex array switches. The indices of a mesh are
+             relative to its first vertex and the draw calls add the
+             base vertex of the mesh to them. The meshes can be
+             rendered with a single @c glMultiDrawElementsBaseVertex
+             call.
+
+             The free ranges of the buffers are kept in free-lists and
+             the neighbouring free ranges are merged when a mesh is
+             freed. If there is no free range large enough then the
+             buffer is grown and the existing data is copied into it.
+             The handles stay valid when a buffer grows.
+
+             All the meshes of the arena have the same vertex format
+             and index type. The indices are written and drawn with
+             the type of the arena, 16-bit indices are not widened.
+
+    @code
+    typedef VertexFormat<vertex::Float3, vertex::UNorm8x4> Format;
+    MeshArena arena(Format::stride);
+    arena.setVertexFormat<Format>();
+
+    MeshHandle a = arena.allocate(verticesA, indicesA);
+    MeshHandle b = arena.allocate(verticesB, indicesB);
+    ...
+    arena.bind();
+    arena.render({ a, b });
+    @endcode
+ **/
+class MeshArena
+{
+public:
+    /**
+        @brief Constructs the arena.
+        @note  OpenGL context must be valid.
+        @param vertexStride   The byte size of a vertex.
+        @param indexType      GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+        @param vertexCapacity The initial count of vertices.
+        @param indexCapacity  The initial count of indices.
+     **/
+    explicit MeshArena(int vertexStride,
+                       GLenum indexType   = GL_UNSIGNED_INT,
+                       int vertexCapacity = 65536,
+                       int indexCapacity  = 3 * 65536);
+
+    /**
+        Returns the byte size of a vertex.
+     **/
+    int vertexStride() const;
+
+    /**
+        Returns the type of the indices.
+     **/
+    GLenum indexType() const;
+
+    /**
+        Sets the vertex attribute definition. The offset is the byte
+        offset of the attribute from the start of the vertex.
+     **/
+    void setAttributeDefinition(int index,
+                                int tupleSize,
+                                int offset,
+                                GLenum type = GL_FLOAT,
+                                bool normalized = false);
+
+    /**
+        Sets the vertex attribute definitions of the @ref
+        VertexFormat. The stride of the format must be the vertex
+        stride of the arena.
+     **/
+    template<typename Format>
+    void setVertexFormat()
+    {
+        Format::forEachAttribute(
+            [this](int index, int tupleSize, GLenum type,
+                   bool normalized, int offset)
+            {
+                setAttributeDefinition(index, tupleSize, offset,
+                                       type, normalized);
+            });
+    }
+
+    /**
+        @brief  Allocates a mesh and writes its vertices and indices.
+        @param  vertices    The vertex data.
+        @param  vertexCount The count of vertices.
+        @param  indices     The indices of the arena index type,
+                            relative to the first vertex.
+        @param  indexCount  The count of indices.
+        @return The handle of the mesh.
+     **/
+    MeshHandle allocate(const void* vertices, int vertexCount,
+                        const void* indices, int indexCount);
+
+    /**
+        Allocates a mesh and writes its vertices and indices. The
+        size of the index must match the arena index type.
+     **/
+    template<typename Vertex, typename Index>
+    MeshHandle allocate(const std::vector<Vertex>& vertices,
+                        const std::vector<Index>& indices)
+    {
+        if (int(sizeof(Index)) != indexSize())
+            return MeshHandle();
+        return allocate(vertices.data(), int(vertices.size()),
+                        indices.data(),  int(indices.size()));
+    }
+
+    /**
+        @brief  Allocates a mesh and copies its vertices and indices
+                from buffer objects, e.g. buffers written in another
+                context that shares objects with the current context.
+                The data is copied on the GPU.
+        @param  vertexBuffer The buffer of the vertices.
+        @param  vertexCount  The count of vertices.
+        @param  indexBuffer  The buffer of the indices of the arena
+                             index type.
+        @param  indexCount   The count of indices.
+        @return The handle of the mesh.
+     **/
+    MeshHandle allocateFromBuffers(GLuint vertexBuffer,
+                                   int vertexCount,
+                                   GLuint indexBuffer,
+                                   int indexCount);
+
+    /**
+        Frees the mesh. The handle must not be used after this.
+     **/
+    void free(const MeshHandle& mesh);
+
+    /**
+        Returns the count of vertices and indices that the buffers can
+        hold without growing.
+     **/
+    int vertexCapacity() const;
+    int indexCapacity() const;
+
+    /**
+        Binds the vertex array of the arena.
+     **/
+    void bind();
+
+    /**
+        Renders the mesh. The arena must be bound.
+     **/
+    void render(const MeshHandle& mesh,
+                GLenum drawStyle = GL_TRIANGLES);
+
+    /**
+        Renders the meshes with a single draw call. The arena must be
+        bound.
+     **/
+    void render(const std::vector<MeshHandle>& meshes,
+                GLenum drawStyle = GL_TRIANGLES);
+
+private:
+    // Returns the byte size of an index.
+    int indexSize() const;
+
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,415 @@
+/**
+    @file   opengl_mesh_file.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::MeshFile class.
+ **/
+
+#include "opengl_mesh_file.h"
+#include "opengl_mesh.h"
+#include "opengl_vertex_format.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Header of a mesh file. The header is followed by the attribute
+   and part tables and the vertex and index data.
+ * ---------------------------------------------------------------- */
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t attributeCount;
+    uint32_t partCount;
+    uint64_t vertexOffset; // byte offset of the vertex data
+    uint64_t indexOffset;  // byte offset of the index data
+};
+
+/* ---------------------------------------------------------------- *
+   A vertex attribute in the file.
+ * ---------------------------------------------------------------- */
+struct FileAttribute
+{
+    uint32_t location;
+    uint32_t tupleSize;
+    uint32_t type;
+    uint32_t normalized;
+    uint32_t offset;
+};
+
+/* ---------------------------------------------------------------- *
+   A part in the file.
+ * ---------------------------------------------------------------- */
+struct FilePart
+{
+    uint32_t baseVertex;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+const char     Magic[4]      = { 'K', 'U', 'U', 'M' };
+const uint32_t Version       = 1;
+const uint32_t MaxAttributes = 16;
+// The vertex and index data are aligned to the page size.
+const uint64_t DataAlignment = 4096;
+
+/* ---------------------------------------------------------------- *
+   Returns the byte size of the index type, 0 if not supported.
+ * ---------------------------------------------------------------- */
+int indexSize(GLenum type)
+{
+    switch (type)
+    {
+        case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT:   return 4;
+        default:                return 0;
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the byte size of an attribute, 0 if the type or the count
+   of components is not supported.
+ * ---------------------------------------------------------------- */
+int attributeSize(GLenum type, uint32_t tupleSize)
+{
+    if (vertex::isPacked(type))
+        return tupleSize == 4 ? 4 : 0;
+    if (tupleSize < 1 || tupleSize > 4)
+        return 0;
+    return int(tupleSize) * vertex::componentSize(type);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the offset rounded up to the data alignment.
+ * ---------------------------------------------------------------- */
+uint64_t alignData(uint64_t offset)
+{
+    return (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+}
+
+/* ---------------------------------------------------------------- *
+   Writes zeros into the file up to the offset.
+ * ---------------------------------------------------------------- */
+bool pad(QSaveFile& file, uint64_t offset)
+{
+    const qint64 count = qint64(offset) - file.pos();
+    if (count <= 0)
+        return true;
+    return file.write(QByteArray(int(count), '\0')) == count;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the mesh file.
+ * ---------------------------------------------------------------- */
+struct MeshFile::Data
+{
+    // Validates the mapped file and reads the tables.
+    bool read(qint64 size)
+    {
+        FileHeader header;
+        if (size < qint64(sizeof(header)))
+            return false;
+        std::memcpy(&header, mapping, sizeof(header));
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+            header.version != Version                            ||
+            header.vertexStride == 0                             ||
+            header.attributeCount > MaxAttributes                ||
+            indexSize(header.indexType) == 0)
+        {
+            return false;
+        }
+
+        // The data must be inside the file and aligned for the
+        // index type.
+        const uint64_t tablesEnd =
+            sizeof(FileHeader) +
+            uint64_t(header.attributeCount) * sizeof(FileAttribute) +
+            uint64_t(header.partCount)      * sizeof(FilePart);
+        const uint64_t vertexEnd =
+            header.vertexOffset +
+            uint64_t(header.vertexCount) * header.vertexStride;
+        const uint64_t indexEnd =
+            header.indexOffset +
+            uint64_t(header.indexCount) * indexSize(header.indexType);
+        if (tablesEnd > uint64_t(size)                      ||
+            header.vertexOffset < tablesEnd                 ||
+            vertexEnd > uint64_t(size)                      ||
+            header.indexOffset < vertexEnd                  ||
+            indexEnd > uint64_t(size)                       ||
+            header.indexOffset % indexSize(header.indexType) != 0)
+        {
+            return false;
+        }
+
+        content = Content();
+        content.vertexStride = int(header.vertexStride);
+        content.vertexCount  = int(header.vertexCount);
+        content.vertexData   = mapping + header.vertexOffset;
+        content.indexType    = header.indexType;
+        content.indexCount   = int(header.indexCount);
+        content.indexData    = mapping + header.indexOffset;
+
+        const uchar* table = mapping + sizeof(FileHeader);
+        for (uint32_t i = 0; i < header.attributeCount; ++i)
+        {
+            FileAttribute a;
+            std::memcpy(&a, table, sizeof(a));
+            table += sizeof(a);
+
+            // The attribute must be readable by OpenGL and inside the
+            // vertex.
+            const int bytes = attributeSize(a.type, a.tupleSize);
+            if (bytes == 0                                       ||
+                a.location >= MaxAttributes                      ||
+                uint64_t(a.offset) + bytes > header.vertexStride)
+            {
+                return false;
+            }
+
+            Attribute attribute;
+            attribute.location   = int(a.location);
+            attribute.tupleSize  = int(a.tupleSize);
+            attribute.type       = a.type;
+            attribute.normalized = a.normalized != 0;
+            attribute.offset     = int(a.offset);
+            content.attributes.push_back(attribute);
+        }
+
+        for (uint32_t i = 0; i < header.partCount; ++i)
+        {
+            FilePart p;
+            std::memcpy(&p, table, sizeof(p));
+            table += sizeof(p);
+
+            // The part must be inside the vertex and index data.
+            if (uint64_t(p.baseVertex) + p.vertexCount >
+                    header.vertexCount                           ||
+                uint64_t(p.firstIndex) + p.indexCount >
+                    header.indexCount)
+            {
+                return false;
+            }
+
+            Part part;
+            part.baseVertex  = int(p.baseVertex);
+            part.vertexCount = int(p.vertexCount);
+            part.firstIndex  = int(p.firstIndex);
+            part.indexCount  = int(p.indexCount);
+            content.parts.push_back(part);
+        }
+        return true;
+    }
+
+    QFile file;
+    uchar* mapping = nullptr;
+    Content content;
+};
+
+/* ---------------------------------------------------------------- */
+
+MeshFile::MeshFile()
+    : d(std::make_shared<Data>())
+{}
+
+/* ---------------------------------------------------------------- */
+
+bool MeshFile::open(const QString& path)
+{
+    close();
+
+    d->file.setFileName(path);
+    if (!d->file.open(QIODevice::ReadOnly))
+    {
+        std::cerr << "Failed to open mesh file "
+                  << path.toStdString() << std::endl;
+        return false;
+    }
+
+    const qint64 size = d->file.size();
+    d->mapping = d->file.map(0, size);
+    if (!d->mapping)
+    {
+        std::cerr << "Failed to map mesh file "
+                  << path.toStdString() << std::endl;
+        close();
+        return false;
+    }
+
+    if (!d->read(size))
+    {
+        std::cerr << "Invalid mesh file "
+                  << path.toStdString() << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void MeshFile::close()
+{
+    if (d->mapping)
+        d->file.unmap(d->mapping);
+    d->mapping = nullptr;
+    d->file.close();
+    d->content = Content();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool MeshFile::isOpen() const
+{ return d->mapping != nullptr; }
+
+/* ---------------------------------------------------------------- */
+
+const MeshFile::Content& MeshFile::content() const
+{ return d->content; }
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<Mesh> MeshFile::createMesh() const
+{
+    if (!isOpen())
+        return nullptr;
+
+    // OpenGL reads the data straight from the mapped pages.
+    const Content& c = d->content;
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+    mesh->writeVertexData(c.vertexCount * c.vertexStride,
+                          c.vertexCount,
+                          c.vertexData);
+    mesh->writeIndexData(c.indexCount * indexSize(c.indexType),
+                         c.indexCount,
+                         c.indexData);
+    for (const Attribute& a : c.attributes)
+        mesh->setAttributeDefinition(a.location, a.tupleSize,
+                                     c.vertexStride, a.offset,
+                                     a.type, a.normalized);
+    return mesh;
+}
+
+/* ---------------------------------------------------------------- */
+
+MeshHandle MeshFile::upload(MeshArena& arena) const
+{
+    const Content& c = d->content;
+    if (!isOpen())
+        return MeshHandle();
+
+    if (arena.vertexStride() != c.vertexStride)
+    {
+        std::cerr << "Mesh arena stride " << arena.vertexStride()
+                  << " does not match mesh file stride "
+                  << c.vertexStride << std::endl;
+        return MeshHandle();
+    }
+
+    if (arena.indexType() != c.indexType)
+    {
+        std::cerr << "Mesh arena index type " << arena.indexType()
+                  << " does not match mesh file index type "
+                  << c.indexType << std::endl;
+        return MeshHandle();
+    }
+
+    // The arena reads the data straight from the mapped pages.
+    return arena.allocate(c.vertexData, c.vertexCount,
+                          c.indexData,  c.indexCount);
+}
+
+/* ---------------------------------------------------------------- */
+
+bool MeshFile::write(const QString& path, const Content& content)
+{
+    if (indexSize(content.indexType) == 0 ||
+        content.attributes.size() > MaxAttributes)
+    {
+        std::cerr << "Invalid mesh file content" << std::endl;
+        return false;
+    }
+
+    const uint64_t vertexSize =
+        uint64_t(content.vertexCount) * content.vertexStride;
+    const uint64_t indexBytes =
+        uint64_t(content.indexCount) * indexSize(content.indexType);
+
+    FileHeader header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version        = Version;
+    header.vertexStride   = uint32_t(content.vertexStride);
+    header.vertexCount    = uint32_t(content.vertexCount);
+    header.indexType      = content.indexType;
+    header.indexCount     = uint32_t(content.indexCount);
+    header.attributeCount = uint32_t(content.attributes.size());
+    header.partCount      = uint32_t(content.parts.size());
+    header.vertexOffset   = alignData(
+        sizeof(FileHeader) +
+        content.attributes.size() * sizeof(FileAttribute) +
+        content.parts.size()      * sizeof(FilePart));
+    header.indexOffset    = alignData(header.vertexOffset + vertexSize);
+
+    // The file is written into a temporary file and renamed so that
+    // a reader never maps a partial file.
+    QSaveFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly);
+    ok = ok && file.write(reinterpret_cast<const char*>(&header),
+                          sizeof(header)) == sizeof(header);
+
+    for (const Attribute& a : content.attributes)
+    {
+        FileAttribute attribute;
+        attribute.location   = uint32_t(a.location);
+        attribute.tupleSize  = uint32_t(a.tupleSize);
+        attribute.type       = a.type;
+        attribute.normalized = a.normalized ? 1 : 0;
+        attribute.offset     = uint32_t(a.offset);
+        ok = ok && file.write(reinterpret_cast<const char*>(&attribute),
+                              sizeof(attribute)) == sizeof(attribute);
+    }
+
+    for (const Part& p : content.parts)
+    {
+        FilePart part;
+        part.baseVertex  = uint32_t(p.baseVertex);
+        part.vertexCount = uint32_t(p.vertexCount);
+        part.firstIndex  = uint32_t(p.firstIndex);
+        part.indexCount  = uint32_t(p.indexCount);
+        ok = ok && file.write(reinterpret_cast<const char*>(&part),
+                              sizeof(part)) == sizeof(part);
+    }
+
+    ok = ok && pad(file, header.vertexOffset);
+    ok = ok && file.write(static_cast<const char*>(content.vertexData),
+                          qint64(vertexSize)) == qint64(vertexSize);
+    ok = ok && pad(file, header.indexOffset);
+    ok = ok && file.write(static_cast<const char*>(content.indexData),
+                          qint64(indexBytes)) == qint64(indexBytes);
+    ok = ok && file.commit();
+
+    if (!ok)
+        std::cerr << "Failed to write mesh file "
+                  << path.toStdString() << std::endl;
+    return ok;
+}
+
+} // namespace opengl
+} // namespace kuu
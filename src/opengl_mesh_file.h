@@ -0,0 +1,149 @@
+/**
+    @file   opengl_mesh_file.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::MeshFile class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QString>
+#include "opengl.h"
+#include "opengl_mesh_arena.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+class Mesh;
+
+/**
+    @brief   A binary mesh file that is read through a memory mapping.
+
+    @details The file contains a header, the vertex attribute
+             definitions, the parts of the mesh and the vertex and
+             index data. The vertex and index data are aligned to the
+             page size so they are uploaded into the buffer objects
+             straight from the mapped pages without copying them
+             into memory first.
+
+             The indices are relative to the first vertex of the file
+             so all the parts are rendered with a single draw call.
+             The parts tell the vertex and index ranges of e.g. the
+             objects of the source file. The values are stored in the
+             byte order of the machine that wrote the file.
+
+             The files are written by the @c qopenglwidget-meshconv
+             tool that converts Wavefront OBJ files.
+
+    @code
+    MeshFile file;
+    if (file.open("model.kmesh"))
+    {
+        std::shared_ptr<Mesh> mesh = file.createMesh();
+        ...
+        mesh->bind();
+        mesh->render();
+    }
+    @endcode
+ **/
+class MeshFile
+{
+public:
+    /**
+        A vertex attribute definition.
+     **/
+    struct Attribute
+    {
+        int location   = 0; // shader location of the attribute
+        int tupleSize  = 0;
+        GLenum type    = GL_FLOAT;
+        bool normalized = false;
+        int offset     = 0; // byte offset from the start of vertex
+    };
+
+    /**
+        A part of the mesh, e.g. an object of the OBJ file.
+     **/
+    struct Part
+    {
+        int baseVertex  = 0;
+        int vertexCount = 0;
+        int firstIndex  = 0;
+        int indexCount  = 0;
+    };
+
+    /**
+        The contents of the mesh file. The data pointers of an opened
+        file point into the mapping and are valid until the file is
+        closed.
+     **/
+    struct Content
+    {
+        int vertexStride = 0;
+        int vertexCount  = 0;
+        const void* vertexData = nullptr;
+        // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        GLenum indexType = GL_UNSIGNED_INT;
+        int indexCount   = 0;
+        const void* indexData = nullptr;
+        std::vector<Attribute> attributes;
+        std::vector<Part> parts;
+    };
+
+    /**
+        Constructs the mesh file without opening a file.
+     **/
+    MeshFile();
+
+    /**
+        Opens and maps the file. Returns false if the file could not
+        be opened or is not a valid mesh file.
+     **/
+    bool open(const QString& path);
+
+    /**
+        Unmaps and closes the file.
+     **/
+    void close();
+
+    /**
+        Returns true if the file is open.
+     **/
+    bool isOpen() const;
+
+    /**
+        Returns the contents of the opened file.
+     **/
+    const Content& content() const;
+
+    /**
+        @brief Creates a mesh of the file.
+        @note  OpenGL context must be valid.
+     **/
+    std::shared_ptr<Mesh> createMesh() const;
+
+    /**
+        @brief  Allocates the mesh of the file from the arena. The
+                vertex stride and the index type of the arena must
+                be the ones of the file.
+        @note   OpenGL context must be valid.
+        @return The handle of the mesh, invalid if the stride or the
+                index type does not match.
+     **/
+    MeshHandle upload(MeshArena& arena) const;
+
+    /**
+        Writes the contents into a mesh file.
+     **/
+    static bool write(const QString& path, const Content& content);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,215 @@
+/**
+    @file   opengl_model.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::Model class.
+ **/
+
+#include "opengl_model.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "damage_region.h"
+#include "opengl.h"
+#include "opengl_mesh_arena.h"
+#include "opengl_shader.h"
+#include "opengl_shader_compiler.h"
+#include "opengl_upload_queue.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/* ---------------------------------------------------------------- *
+   The data of the model.
+ * ---------------------------------------------------------------- */
+struct Model::Data
+{
+    // Constructs the model data.
+    Data(std::shared_ptr<UploadQueue> uploadQueue,
+         const QString& path,
+         std::shared_ptr<ShaderCompiler> compiler)
+    {
+        upload = uploadQueue->uploadMesh(path);
+
+        // The normal is zero if the mesh has no normals and the
+        // model is rendered unlit.
+        const std::string vshSource =
+            "#version 330 core\r\n" // note linebreak
+            "layout (location = 0) in vec3 position;"
+            "layout (location = 1) in vec3 normal;"
+            "uniform mat4 cameraMatrix;"
+            "out vec3 normalIn;"
+            "void main(void)"
+            "{"
+               " gl_Position = cameraMatrix * vec4(position, 1.0);"
+                "normalIn = normal;"
+            "}";
+
+        const std::string fshSource =
+            "#version 330 core\r\n" // note linebreak
+            "in vec3 normalIn;"
+            "out vec4 colorOut;"
+            "void main(void)"
+            "{"
+                "const vec3 color = vec3(0.8, 0.8, 0.75);"
+                "const vec3 light = vec3(0.267, 0.535, 0.802);"
+                "float shade = 1.0;"
+                "if (dot(normalIn, normalIn) > 0.01)"
+                "    shade = 0.2 + 0.8 * max(dot("
+                "        normalize(normalIn), light), 0.0);"
+                "colorOut = vec4(color * shade, 1.0);"
+            "}";
+
+        shaderHandle = compiler->compile(vshSource, fshSource);
+    }
+
+    // Takes the uploaded mesh into use once the upload is complete.
+    // Returns true if the mesh was taken into use.
+    bool takeMesh()
+    {
+        if (arena || !upload.isComplete())
+            return false;
+
+        arena = upload.arena();
+        mesh  = upload.mesh();
+        parts = upload.parts();
+        if (parts.empty())
+            parts.push_back(mesh);
+
+        // Fit the bounding box into the unit sphere at the origo.
+        glm::vec3 min, max;
+        if (upload.bounds(min, max))
+        {
+            boundsMin = min;
+            boundsMax = max;
+            const float radius = glm::length(max - min) * 0.5f;
+            const float scale = radius > 0.0f ? 1.0f / radius : 1.0f;
+            model = glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+            model = glm::translate(model, -(min + max) * 0.5f);
+        }
+        upload = UploadHandle();
+        return true;
+    }
+
+    // Looks up the uniforms of the shader when it has been compiled.
+    std::shared_ptr<Shader> currentShader()
+    {
+        std::shared_ptr<Shader> s = shaderHandle.shader();
+        if (s && shaderGeneration != shaderHandle.generation())
+        {
+            shaderGeneration = shaderHandle.generation();
+            cameraMatrix = s->uniform<glm::mat4>("cameraMatrix");
+        }
+        return s;
+    }
+
+    // Handle of the mesh upload, reset when the mesh is taken.
+    UploadHandle upload;
+    bool failed = false;
+
+    // The mesh and its parts in the arena.
+    std::shared_ptr<MeshArena> arena;
+    MeshHandle mesh;
+    std::vector<MeshHandle> parts;
+
+    // Bounding box of the positions and the transform from the model
+    // space into world space.
+    glm::vec3 boundsMin = glm::vec3(-1.0f);
+    glm::vec3 boundsMax = glm::vec3( 1.0f);
+    glm::mat4 model = glm::mat4(1.0f);
+
+    // Handle of the asynchronously compiled shader.
+    ShaderHandle shaderHandle;
+    Shader::Uniform<glm::mat4> cameraMatrix;
+    uint64_t shaderGeneration = 0;
+    // Generation of the shader that was rendered last.
+    uint64_t renderedGeneration = 0;
+};
+
+/* ---------------------------------------------------------------- */
+
+Model::Model(std::shared_ptr<UploadQueue> uploadQueue,
+             const QString& path,
+             std::shared_ptr<ShaderCompiler> compiler)
+    : d(std::make_shared<Data>(uploadQueue, path, compiler))
+{}
+
+/* ---------------------------------------------------------------- */
+
+Model::~Model()
+{
+    if (d->arena)
+        d->arena->free(d->mesh);
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Model::update()
+{
+    if (d->upload.isFailed())
+    {
+        d->failed = true;
+        d->upload = UploadHandle();
+    }
+    if (d->failed)
+        return false;
+
+    // Render again until the mesh and the compiled shader have been
+    // rendered.
+    bool changed = d->takeMesh();
+    d->currentShader();
+    if (d->arena && d->shaderGeneration != d->renderedGeneration)
+        changed = true;
+    return changed;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Model::isFailed() const
+{ return d->failed; }
+
+/* ---------------------------------------------------------------- */
+
+QRect Model::screenBounds(const glm::mat4& view,
+                          const glm::mat4& projection,
+                          const QSize& viewport) const
+{
+    if (!d->arena)
+        return QRect();
+
+    const glm::vec3& a = d->boundsMin;
+    const glm::vec3& b = d->boundsMax;
+    const glm::vec3 corners[8] =
+    {
+        glm::vec3(a.x, a.y, a.z), glm::vec3(b.x, a.y, a.z),
+        glm::vec3(a.x, b.y, a.z), glm::vec3(b.x, b.y, a.z),
+        glm::vec3(a.x, a.y, b.z), glm::vec3(b.x, a.y, b.z),
+        glm::vec3(a.x, b.y, b.z), glm::vec3(b.x, b.y, b.z)
+    };
+    return DamageRegion::project(projection * view * d->model,
+                                 corners, 8, viewport);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Model::render(const glm::mat4& view,
+                   const glm::mat4& projection)
+{
+    // Skip rendering until the mesh is uploaded and the shader is
+    // compiled.
+    std::shared_ptr<Shader> shader = d->currentShader();
+    if (!d->arena || !shader)
+        return;
+
+    d->arena->bind();
+    shader->bind();
+    shader->setUniform(d->cameraMatrix, projection * view * d->model);
+    d->arena->render(d->parts);
+    d->renderedGeneration = d->shaderGeneration;
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,108 @@
+/**
+    @file   opengl_model.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::Model class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <glm/mat4x4.hpp>
+
+namespace kuu
+{
+namespace opengl
+{
+
+class ShaderCompiler;
+class UploadQueue;
+
+/**
+    A model of a mesh file.
+
+    The mesh file is uploaded with the upload queue and the model is
+    not rendered until the mesh is in its arena and the shader is
+    compiled. The parts of the mesh are rendered with a single multi-
+    draw call. The model is scaled and moved so that its bounding
+    box fits into the unit sphere at the origo.
+
+    The positions are read from the attribute location 0 and the
+    normals, if any, from the location 1. A model without normals is
+    rendered unlit.
+
+    @code
+
+    Model model(uploadQueue, "model.kmesh", shaderCompiler);
+    ...
+    // On each frame after the queue is polled
+    bool changed = model.update();
+    model.render(view, projection);
+
+    @endcode
+ **/
+class Model
+{
+public:
+    /**
+        Starts the upload of the mesh file.
+
+        @param uploadQueue The queue that uploads the mesh.
+        @param path        The path of the mesh file written by the @c
+                           qopenglwidget-meshconv tool.
+        @param compiler    The shader compiler.
+     **/
+    Model(std::shared_ptr<UploadQueue> uploadQueue,
+          const QString& path,
+          std::shared_ptr<ShaderCompiler> compiler);
+
+    /**
+        @brief Frees the mesh from its arena.
+        @note  The context that polls the upload queue must be
+               current.
+     **/
+    ~Model();
+
+    /**
+        Returns true if the model must be rendered again: the upload
+        has completed or the shader has been compiled since the model
+        was rendered.
+     **/
+    bool update();
+
+    /**
+        Returns true if the upload of the mesh failed.
+     **/
+    bool isFailed() const;
+
+    /**
+        Returns the bounding rectangle of the model on the viewport in
+        pixels with the origin at the bottom-left corner. Empty if the
+        mesh is not yet uploaded.
+
+        @param view       The view matrix.
+        @param projection The projection matrix.
+        @param viewport   The size of the viewport.
+     **/
+    QRect screenBounds(const glm::mat4& view,
+                       const glm::mat4& projection,
+                       const QSize& viewport) const;
+
+    /**
+        Renders the model.
+
+        @param view       The view matrix.
+        @param projection The projection matrix.
+     **/
+    void render(const glm::mat4& view,
+                const glm::mat4& projection);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
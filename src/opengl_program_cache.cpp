@@ -0,0 +1,223 @@
+/**
+    @file   opengl_program_cache.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::ProgramCache class.
+ **/
+
+#include "opengl_program_cache.h"
+#include "opengl_capabilities.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Header of a binary file.
+ * ---------------------------------------------------------------- */
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+};
+
+const char     Magic[4] = { 'K', 'U', 'U', 'P' };
+const uint32_t Version  = 1;
+
+/* ---------------------------------------------------------------- *
+   Directory of the binaries, guarded by the mutex.
+ * ---------------------------------------------------------------- */
+std::mutex directoryMutex;
+QString cacheDirectory;
+
+/* ---------------------------------------------------------------- *
+   Hashes the data with 64-bit FNV-1a.
+ * ---------------------------------------------------------------- */
+void fnv1a(uint64_t& hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= uint64_t(uint8_t(data[i]));
+        hash *= 1099511628211ull;
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Hashes the OpenGL string.
+ * ---------------------------------------------------------------- */
+void fnv1a(uint64_t& hash, GLenum name)
+{
+    const char* str = (const char*) glGetString(name);
+    if (str)
+        fnv1a(hash, str, std::strlen(str) + 1);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the file path of the key.
+ * ---------------------------------------------------------------- */
+QString filePath(const std::string& key)
+{
+    return QDir(ProgramCache::directory()).filePath(
+        QString::fromStdString(key) + ".bin");
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+bool ProgramCache::isSupported()
+{
+    // The driver is the same for every context of the process.
+    static const bool supported = []()
+    {
+        if (qgetenv("KUU_PROGRAM_CACHE") == "0")
+            return false;
+
+        if (!hasVersion(4, 1) &&
+            !hasExtension("GL_ARB_get_program_binary"))
+        {
+            return false;
+        }
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }();
+    return supported;
+}
+
+/* ---------------------------------------------------------------- */
+
+void ProgramCache::setDirectory(const QString& directory)
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    cacheDirectory = directory;
+}
+
+/* ---------------------------------------------------------------- */
+
+QString ProgramCache::directory()
+{
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    if (cacheDirectory.isEmpty())
+        cacheDirectory = QStandardPaths::writableLocation(
+                             QStandardPaths::CacheLocation) +
+                         "/programs";
+    return cacheDirectory;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::string ProgramCache::key(const std::vector<std::string>& sources)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const std::string& source : sources)
+        fnv1a(hash, source.c_str(), source.size() + 1);
+    fnv1a(hash, GL_VENDOR);
+    fnv1a(hash, GL_RENDERER);
+    fnv1a(hash, GL_VERSION);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string key(16, '0');
+    for (int i = 15; i >= 0; --i, hash >>= 4)
+        key[i] = digits[hash & 0xf];
+    return key;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool ProgramCache::load(GLuint program, const std::string& key)
+{
+    if (!isSupported())
+        return false;
+
+    QFile file(filePath(key));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray data = file.readAll();
+    file.close();
+
+    Header header;
+    if (size_t(data.size()) <= sizeof(header))
+        return false;
+    std::memcpy(&header, data.constData(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 ||
+        header.version != Version)
+    {
+        return false;
+    }
+
+    glProgramBinary(program, header.format,
+                    data.constData() + sizeof(header),
+                    GLsizei(data.size() - sizeof(header)));
+
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        // The driver did not accept the binary.
+        QFile::remove(filePath(key));
+        return false;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void ProgramCache::store(GLuint program, const std::string& key)
+{
+    if (!isSupported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    Header header;
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.format  = 0;
+
+    QByteArray data(int(sizeof(header) + length), '\0');
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format,
+                       data.data() + sizeof(header));
+    header.format = format;
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    const QString dirPath = directory();
+    if (!QDir().mkpath(dirPath))
+    {
+        std::cerr << "Failed to create program cache directory "
+                  << dirPath.toStdString() << std::endl;
+        return;
+    }
+
+    // The file is written into a temporary file and renamed so that
+    // the other processes never read a partial binary.
+    QSaveFile file(filePath(key));
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(data) != data.size() ||
+        !file.commit())
+    {
+        std::cerr << "Failed to write program binary "
+                  << file.fileName().toStdString() << std::endl;
+    }
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,92 @@
+/**
+    @file   opengl_program_cache.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::ProgramCache class.
+ **/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <QtCore/QString>
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   An on-disk cache of linked shader program binaries.
+
+    @details The binaries are read with @c glGetProgramBinary after a
+             program is linked from the sources and loaded with @c
+             glProgramBinary the next time a program with the same
+             sources is linked. A binary is valid only for the driver
+             that created it so the cache key is a hash of the sources
+             and of the OpenGL vendor, renderer and version strings.
+             If the driver rejects a binary, e.g. after an update that
+             did not change the version string, the binary is removed
+             and the program is compiled from the sources.
+
+             The cache requires OpenGL 4.1 or @c
+             GL_ARB_get_program_binary and at least one binary format
+             from the driver. The binaries are stored into the Qt
+             cache location by default. The cache can be disabled by
+             setting the environment variable @c KUU_PROGRAM_CACHE to
+             0.
+
+             The functions can be called from any thread that has a
+             current context.
+
+    @code
+    const std::string key = ProgramCache::key({ vsh, fsh });
+    if (!ProgramCache::load(program, key))
+    {
+        // Compile and link the program.
+        ...
+        ProgramCache::store(program, key);
+    }
+    @endcode
+ **/
+class ProgramCache
+{
+public:
+    /**
+        Returns true if the cache is enabled and the current context
+        supports program binaries.
+     **/
+    static bool isSupported();
+
+    /**
+        Sets the directory of the binaries.
+     **/
+    static void setDirectory(const QString& directory);
+
+    /**
+        Returns the directory of the binaries.
+     **/
+    static QString directory();
+
+    /**
+        Returns the cache key of the program sources for the driver
+        of the current context.
+     **/
+    static std::string key(const std::vector<std::string>& sources);
+
+    /**
+        @brief  Loads the program binary of the key into the program.
+        @return True if the binary was found and the program is linked.
+     **/
+    static bool load(GLuint program, const std::string& key);
+
+    /**
+        Stores the binary of the linked program with the key. The @c
+        GL_PROGRAM_BINARY_RETRIEVABLE_HINT should be set before the
+        program was linked.
+     **/
+    static void store(GLuint program, const std::string& key);
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -11,56 +11,85 @@
 #include <vector>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include "damage_region.h"
 #include "opengl.h"
 #include "opengl_mesh.h"
 #include "opengl_shader.h"
+#include "opengl_shader_compiler.h"
+#include "opengl_texture.h"
+#include "opengl_vertex_format.h"
+#include <QtCore/QDir>
 
 namespace kuu
 {
 namespace opengl
 {
 
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   The vertex format of the quad: position, color and the texture
+   coordinate inside the image of the texture.
+ * ---------------------------------------------------------------- */
+typedef VertexFormat<vertex::Float3,
+                     vertex::UNorm8x4,
+                     vertex::Half2> QuadFormat;
+
+} // anonymous namespace
+
 /* ---------------------------------------------------------------- *
    The data of the quad.
  * ---------------------------------------------------------------- */
 struct Quad::Data
 {
     // Constructs the quad data
-    Data(float width, float height)
+    Data(float width, float height,
+         std::shared_ptr<ShaderCompiler> compiler)
         : width(width)
         , height(height)
-    { createQuad(); }
+    { createQuad(compiler); }
 
     // Creates the quad. This will create a vertex buffer with two
-    // triangles where a single vertex contains position and color.
+    // triangles where a single vertex contains position, color and
+    // texture coordinate.
     // The vertices and triangle indices are written into OpenGL
     // buffers. Vertex array is used to store the vertex attribute
     // information.
     //
     // A simple shader is used to transform vertices from model space
     // into camera clip space. The shading is done with the vertex
-    // colors.
+    // colors or with the texture if the quad has one.
     //
     // If any of the OpenGL functions fails then the failed object
     // is written into standard error stream. One failure leads to
     // rendering to fail.
     //
-    void createQuad()
+    void createQuad(std::shared_ptr<ShaderCompiler> compiler)
     {
         // -----------------------------------------------------------
         // Create quad vertex data. The center of the quad is at the
         // origo. The vertex properties are packed where the first
-        // is vertes position and then color components.
+        // is vertes position, then color components as bytes and
+        // then the texture coordinate as half floats. The texture
+        // coordinate is relative to the image of the texture, the
+        // top-left corner is at the first row of the image.
 
+        typedef QuadFormat::Vertex Vertex;
+        typedef glm::u8vec4 Color;
+        using vertex::packHalf2;
         const float w = width  * 0.5f;
         const float h = height * 0.5f;
-        const std::vector<float> vertexData =
+        const std::vector<Vertex> vertexData =
         {
-          // x   y   z     r     g     b
-            -w, -h, 0.0f, 1.0f, 0.0f, 0.0f,
-             w, -h, 0.0f, 0.0f, 1.0f, 0.0f,
-             w,  h, 0.0f, 0.0f, 0.0f, 1.0f,
-            -w,  h, 0.0f, 1.0f, 1.0f, 0.0f
+            Vertex(glm::vec3(-w, -h, 0.0f), Color(255,   0,   0, 255),
+                   packHalf2(glm::vec2(0.0f, 1.0f))),
+            Vertex(glm::vec3( w, -h, 0.0f), Color(  0, 255,   0, 255),
+                   packHalf2(glm::vec2(1.0f, 1.0f))),
+            Vertex(glm::vec3( w,  h, 0.0f), Color(  0,   0, 255, 255),
+                   packHalf2(glm::vec2(1.0f, 0.0f))),
+            Vertex(glm::vec3(-w,  h, 0.0f), Color(255, 255,   0, 255),
+                   packHalf2(glm::vec2(0.0f, 0.0f)))
         };
 
         // -----------------------------------------------------------
@@ -73,11 +102,9 @@ struct Quad::Data
         };
 
         mesh = std::make_shared<Mesh>();
-        mesh->writeVertexData(vertexData);
+        mesh->writeVertices(vertexData);
         mesh->writeIndexData(indexData);
-        mesh->setAttributeDefinition(0, 3, 6 * sizeof(float), 0);
-        mesh->setAttributeDefinition(1, 3, 6 * sizeof(float),
-                                     3 * sizeof(float));
+        mesh->setVertexFormat<QuadFormat>();
 
         // -----------------------------------------------------------
         // Create the shader
@@ -86,53 +113,193 @@ struct Quad::Data
             "#version 330 core\r\n" // note linebreak
             "layout (location = 0) in vec3 position;"
             "layout (location = 1) in vec3 color;"
+            "layout (location = 2) in vec2 texCoord;"
             "uniform mat4 cameraMatrix;"
+            "uniform vec4 uvRect;"
             "out vec4 colorIn;"
+            "out vec2 texCoordIn;"
             "void main(void)"
             "{"
                " gl_Position = cameraMatrix * vec4(position, 1.0);"
                 "colorIn = vec4(color, 1.0);"
+                "texCoordIn = mix(uvRect.xy, uvRect.zw, texCoord);"
             "}";
 
         const std::string fshSource =
             "#version 330 core\r\n" // note linebreak
             "in vec4 colorIn;"
+            "in vec2 texCoordIn;"
+            "uniform sampler2D colorTexture;"
+            "uniform int textured;"
             "out vec4 colorOut;"
             "void main(void)"
             "{"
-                "colorOut = colorIn;"
+                "if (textured != 0)"
+                "    colorOut = texture(colorTexture, texCoordIn);"
+                "else"
+                "    colorOut = colorIn;"
             "}";
 
+        if (compiler)
+        {
+            // Compile the shader from the files if the shader
+            // directory is set so that the shader can be edited
+            // while the application is running.
+            const QString shaderDir =
+                QString::fromLocal8Bit(qgetenv("KUU_SHADER_DIR"));
+            if (shaderDir.isEmpty())
+                shaderHandle = compiler->compile(vshSource, fshSource);
+            else
+                shaderHandle = compiler->compileFiles(
+                    QDir(shaderDir).filePath("quad.vert"),
+                    QDir(shaderDir).filePath("quad.frag"));
+            return;
+        }
+
         shader = std::make_shared<Shader>();
         shader->setVertexShader(vshSource);
         shader->setFragmentShader(fshSource);
         shader->link();
+        findUniforms(*shader);
+    }
+
+    // Looks up the uniforms of the shader.
+    void findUniforms(const Shader& s)
+    {
+        cameraMatrix = s.uniform<glm::mat4>("cameraMatrix");
+        uvRectUniform = s.uniform<glm::vec4>("uvRect");
+        colorTexture = s.uniform<int>("colorTexture");
+        textured = s.uniform<int>("textured");
+    }
+
+    // Returns the current shader or nullptr if the shader is not yet
+    // compiled.
+    std::shared_ptr<Shader> currentShader()
+    {
+        if (!shaderHandle.isValid())
+            return shader;
+
+        // Look up the uniforms when the shader has been (re)compiled.
+        std::shared_ptr<Shader> s = shaderHandle.shader();
+        if (s && shaderGeneration != shaderHandle.generation())
+        {
+            shaderGeneration = shaderHandle.generation();
+            findUniforms(*s);
+        }
+        return s;
     }
 
     float width  = 1.0f; // width of the quad
     float height = 1.0f; // height of the quad
 
     glm::quat yaw; // rotation around y-axis
+    bool rotating = true;
+    // True if the quad has changed outside of update.
+    bool changed = true;
 
     std::shared_ptr<Mesh> mesh;
     std::shared_ptr<Shader> shader;
+    Shader::Uniform<glm::mat4> cameraMatrix;
+    Shader::Uniform<glm::vec4> uvRectUniform;
+    Shader::Uniform<int> colorTexture;
+    Shader::Uniform<int> textured;
+
+    // Texture sampled instead of the vertex colors and the texture
+    // coordinates of the image.
+    std::shared_ptr<Texture> texture;
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+    // Handle of the asynchronously compiled shader.
+    ShaderHandle shaderHandle;
+    uint64_t shaderGeneration = 0;
+    // Generation of the shader that was rendered last.
+    uint64_t renderedGeneration = 0;
 };
 
 /* ---------------------------------------------------------------- */
 
-Quad::Quad(float width, float height)
-    : d(std::make_shared<Data>(width, height))
+Quad::Quad(float width, float height,
+           std::shared_ptr<ShaderCompiler> compiler)
+    : d(std::make_shared<Data>(width, height, compiler))
 {}
 
 /* ---------------------------------------------------------------- */
 
-void Quad::update(float elapsed)
+bool Quad::update(float elapsed)
+{
+    bool changed = d->changed;
+    d->changed = false;
+
+    if (d->rotating)
+    {
+        const float angleChange = rotationSpeed() * elapsed / 1000.0f;
+        d->yaw *= glm::angleAxis(
+                        angleChange,
+                        glm::vec3(0.0f, 1.0f, 0.0f));
+        changed = true;
+    }
+
+    // Render again until the compiled shader has been rendered,
+    // this includes the shaders compiled again after a file change.
+    // A failed first compile has nothing to render.
+    if (d->shaderHandle.isValid())
+    {
+        d->currentShader();
+        if (d->shaderGeneration == 0)
+            changed |= !d->shaderHandle.isFailed();
+        else if (d->shaderGeneration != d->renderedGeneration)
+            changed = true;
+    }
+    return changed;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Quad::setRotating(bool rotating)
+{
+    d->rotating = rotating;
+    d->changed  = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+float Quad::rotationSpeed() const
+{ return glm::radians(180.0f); }
+
+/* ---------------------------------------------------------------- */
+
+void Quad::setOrientation(const glm::quat& orientation)
+{
+    d->yaw     = orientation;
+    d->changed = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Quad::setTexture(std::shared_ptr<Texture> texture,
+                      const glm::vec4& uvRect)
 {
-    const float angleChangePerMillisecond = 180.0f/1000.0f;
-    const float angleChange = angleChangePerMillisecond * elapsed;
-    d->yaw *= glm::angleAxis(
-                    glm::radians(angleChange),
-                    glm::vec3(0.0f, 1.0f, 0.0f));
+    d->texture = texture;
+    d->uvRect  = uvRect;
+    d->changed = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+QRect Quad::screenBounds(const glm::mat4& view,
+                         const glm::mat4& projection,
+                         const QSize& viewport) const
+{
+    const float w = d->width  * 0.5f;
+    const float h = d->height * 0.5f;
+    const glm::vec3 corners[4] =
+    {
+        glm::vec3(-w, -h, 0.0f), glm::vec3( w, -h, 0.0f),
+        glm::vec3( w,  h, 0.0f), glm::vec3(-w,  h, 0.0f)
+    };
+    const glm::mat4 model = glm::mat4_cast(d->yaw);
+    return DamageRegion::project(projection * view * model,
+                                 corners, 4, viewport);
 }
 
 /* ---------------------------------------------------------------- */
@@ -144,12 +311,25 @@ void Quad::render(const glm::mat4& view,
     const glm::mat4 model = glm::mat4_cast(d->yaw);
     const glm::mat4 cameraMatrix = projection * view * model;
 
+    // Skip rendering until the shader is compiled.
+    std::shared_ptr<Shader> shader = d->currentShader();
+    if (!shader)
+        return;
+
+    // The mesh and shader are left bound, the state cache skips
+    // binding them again on the next frame.
     d->mesh->bind();
-    d->shader->bind();
-    d->shader->setUniform("cameraMatrix", cameraMatrix);
+    shader->bind();
+    shader->setUniform(d->cameraMatrix, cameraMatrix);
+    shader->setUniform(d->textured, d->texture ? 1 : 0);
+    if (d->texture)
+    {
+        d->texture->bind(0);
+        shader->setUniform(d->colorTexture, 0);
+        shader->setUniform(d->uvRectUniform, d->uvRect);
+    }
     d->mesh->render(GL_TRIANGLES);
-    d->shader->release();
-    d->mesh->release();
+    d->renderedGeneration = d->shaderGeneration;
 }
 
 } // namespace opengl
@@ -7,13 +7,20 @@
 #pragma once
 
 #include <memory>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
 #include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 namespace kuu
 {
 namespace opengl
 {
 
+class ShaderCompiler;
+class Texture;
+
 /**
     A quad mesh.
 
@@ -28,8 +35,8 @@ namespace opengl
     // Create quad
     Quad::Ptr quad = std::make_shared<Quad>(3.0f, 4.0f);
     ...
-    // update the quad rotation
-    quad.update(10); // 10 milliseconds
+    // update the quad rotation, true if the quad has changed
+    bool changed = quad.update(10); // 10 milliseconds
     ...
     // render the quad into currently bound framebuffer.
     glm::mat4 cameraViewMatrix       = getCameraViewMatrix();
@@ -44,17 +51,72 @@ class Quad
 public:
     /**
         Constructs the quad from the width and height dimensions.
-        @param width  The width of the quad.
-        @param height The height of the quad.
+
+        If a shader compiler is given then the shader is compiled
+        asynchronously and the quad is not rendered until the shader
+        is available. If the environment variable @c KUU_SHADER_DIR
+        is set then the shader is compiled from the files quad.vert
+        and quad.frag of that directory and compiled again when the
+        files change.
+
+        @param width    The width of the quad.
+        @param height   The height of the quad.
+        @param compiler The shader compiler, nullptr to compile the
+                        shader synchronously.
      **/
-    Quad(float width = 1.0f, float height = 1.0f);
+    Quad(float width = 1.0f, float height = 1.0f,
+         std::shared_ptr<ShaderCompiler> compiler = nullptr);
 
     /**
         Updates the quad rotation around Y-axis.
-        @param elapsed Time in milliseconds since the function was
-                       called last time.
+        @param  elapsed Time in milliseconds since the function was
+                        called last time.
+        @return True if the quad must be rendered again: it rotates,
+                its texture was set or its shader is compiled or
+                being compiled.
+     **/
+    bool update(float elapsed);
+
+    /**
+        Sets the quad rotating. Default is true.
+     **/
+    void setRotating(bool rotating);
+
+    /**
+        Returns the rotation speed around Y-axis in radians per
+        second.
+     **/
+    float rotationSpeed() const;
+
+    /**
+        Sets the orientation of the quad, e.g. from a simulation. The
+        quad should not be rotating.
+     **/
+    void setOrientation(const glm::quat& orientation);
+
+    /**
+        Sets the texture that the quad samples instead of its vertex
+        colors.
+
+        @param texture The texture, nullptr to use the vertex colors.
+        @param uvRect  The texture coordinates (u0, v0, u1, v1) of
+                       the image, e.g. @ref TextureAtlas::uvRect. The
+                       top-left corner of the quad samples (u0, v0).
+     **/
+    void setTexture(std::shared_ptr<Texture> texture,
+                    const glm::vec4& uvRect = glm::vec4(0, 0, 1, 1));
+
+    /**
+        Returns the bounding rectangle of the quad on the viewport in
+        pixels with the origin at the bottom-left corner.
+
+        @param view       The view matrix.
+        @param projection The projection matrix.
+        @param viewport   The size of the viewport.
      **/
-    void update(float elapsed);
+    QRect screenBounds(const glm::mat4& view,
+                       const glm::mat4& projection,
+                       const QSize& viewport) const;
 
     /**
         Renders the quad.
@@ -0,0 +1,515 @@
+/**
+    @file   opengl_quad_batch.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::QuadBatch class.
+ **/
+
+#include "opengl_quad_batch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/common.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include "damage_region.h"
+#include "job_system.h"
+#include "opengl.h"
+#include "opengl_mesh.h"
+#include "opengl_shader.h"
+#include "opengl_shader_compiler.h"
+#include "opengl_texture.h"
+#include "opengl_vertex_format.h"
+#include "scene.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Per-instance data of a quad.
+ * ---------------------------------------------------------------- */
+struct Instance
+{
+    glm::mat4 model;
+    glm::vec4 uvRect; // texture coordinates of the image
+    glm::u8vec4 color;
+};
+
+/* ---------------------------------------------------------------- *
+   The vertex format of the quad: position, color and the texture
+   coordinate inside the image.
+ * ---------------------------------------------------------------- */
+typedef VertexFormat<vertex::Float3,
+                     vertex::UNorm8x4,
+                     vertex::Half2> QuadFormat;
+
+/* ---------------------------------------------------------------- *
+   Returns a saturated color of the hue in range [0, 1].
+ * ---------------------------------------------------------------- */
+glm::u8vec4 hueColor(float hue)
+{
+    const float h = hue * 6.0f;
+    const float r = std::abs(h - 3.0f) - 1.0f;
+    const float g = 2.0f - std::abs(h - 2.0f);
+    const float b = 2.0f - std::abs(h - 4.0f);
+    return vertex::packUnorm8x4(glm::vec4(r, g, b, 1.0f));
+}
+
+// Count of quads updated in a job.
+const int QuadsPerJob = 1024;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the quad batch.
+ * ---------------------------------------------------------------- */
+struct QuadBatch::Data
+{
+    // Constructs the quad batch data
+    Data(int count, std::shared_ptr<ShaderCompiler> compiler)
+    {
+        // The IDs are registered before the mesh and the shader exist.
+        meshId   = scene.addMesh(nullptr);
+        shaderId = scene.addShader(nullptr);
+        createObjects(std::max(count, 1));
+        buildInstances();
+        createMesh();
+        createShader(compiler);
+    }
+
+    // Lays out the quads into a grid that covers the area from -1 to
+    // 1 on the XY-plane.
+    void createObjects(int count)
+    {
+        const int columns = int(std::ceil(std::sqrt(float(count))));
+        const float cell = 2.0f / columns;
+
+        scene.reserve(count);
+        handles.reserve(count);
+        Scene::Object object;
+        object.scale  = cell * 0.8f;
+        object.mesh   = meshId;
+        object.shader = shaderId;
+        for (int i = 0; i < count; ++i)
+        {
+            const int column = i % columns;
+            const int row    = i / columns;
+            object.position =
+                glm::vec3(-1.0f + (column + 0.5f) * cell,
+                           1.0f - (row    + 0.5f) * cell,
+                           0.0f);
+            // Vary the speed between 90 and 270 degrees per second.
+            const float t = count > 1 ? float(i) / (count - 1) : 0.5f;
+            object.rotationRate = glm::radians(90.0f + 180.0f * t);
+            object.color = hueColor(t);
+            handles.push_back(scene.create(object));
+        }
+    }
+
+    // Creates the shared quad mesh and the instance attributes.
+    void createMesh()
+    {
+        typedef QuadFormat::Vertex Vertex;
+        typedef glm::u8vec4 Color;
+        using vertex::packHalf2;
+        const float w = 0.5f;
+        const float h = 0.5f;
+        const std::vector<Vertex> vertexData =
+        {
+            Vertex(glm::vec3(-w, -h, 0.0f), Color(255,   0,   0, 255),
+                   packHalf2(glm::vec2(0.0f, 1.0f))),
+            Vertex(glm::vec3( w, -h, 0.0f), Color(  0, 255,   0, 255),
+                   packHalf2(glm::vec2(1.0f, 1.0f))),
+            Vertex(glm::vec3( w,  h, 0.0f), Color(  0,   0, 255, 255),
+                   packHalf2(glm::vec2(1.0f, 0.0f))),
+            Vertex(glm::vec3(-w,  h, 0.0f), Color(255, 255,   0, 255),
+                   packHalf2(glm::vec2(0.0f, 0.0f)))
+        };
+
+        const std::vector<unsigned int> indexData =
+        {
+            0u, 1u, 2u,
+            2u, 3u, 0u
+        };
+
+        // Only the instance data is written on every frame, the
+        // vertices and indices are written once.
+        std::shared_ptr<Mesh> mesh =
+            std::make_shared<Mesh>(Mesh::Usage::Static,
+                                   Mesh::Usage::Static,
+                                   Mesh::Usage::Streaming);
+        mesh->writeVertices(vertexData);
+        mesh->writeIndexData(indexData);
+        mesh->setVertexFormat<QuadFormat>();
+
+        // The model matrix takes a location per column.
+        mesh->writeInstanceData(instances);
+        const int stride = sizeof(Instance);
+        for (int column = 0; column < 4; ++column)
+            mesh->setInstanceAttributeDefinition(
+                3 + column, 4, stride,
+                column * sizeof(glm::vec4));
+        mesh->setInstanceAttributeDefinition(
+            7, 4, stride, offsetof(Instance, uvRect));
+        mesh->setInstanceAttributeDefinition(
+            8, 4, stride, offsetof(Instance, color), 1,
+            GL_UNSIGNED_BYTE, true);
+        scene.setMesh(meshId, mesh);
+    }
+
+    // Creates the shader.
+    void createShader(std::shared_ptr<ShaderCompiler> compiler)
+    {
+        const std::string vshSource =
+            "#version 330 core\r\n" // note linebreak
+            "layout (location = 0) in vec3 position;"
+            "layout (location = 1) in vec3 color;"
+            "layout (location = 2) in vec2 texCoord;"
+            "layout (location = 3) in mat4 model;"
+            "layout (location = 7) in vec4 uvRect;"
+            "layout (location = 8) in vec4 instanceColor;"
+            "uniform mat4 viewProjection;"
+            "out vec4 colorIn;"
+            "out vec2 texCoordIn;"
+            "void main(void)"
+            "{"
+               " gl_Position = viewProjection * model * "
+               "               vec4(position, 1.0);"
+                "colorIn = vec4(color, 1.0) * instanceColor;"
+                "texCoordIn = mix(uvRect.xy, uvRect.zw, texCoord);"
+            "}";
+
+        const std::string fshSource =
+            "#version 330 core\r\n" // note linebreak
+            "in vec4 colorIn;"
+            "in vec2 texCoordIn;"
+            "uniform sampler2D colorTexture;"
+            "uniform int textured;"
+            "out vec4 colorOut;"
+            "void main(void)"
+            "{"
+                "if (textured != 0)"
+                "    colorOut = texture(colorTexture, texCoordIn);"
+                "else"
+                "    colorOut = colorIn;"
+            "}";
+
+        if (compiler)
+        {
+            shaderHandle = compiler->compile(vshSource, fshSource);
+            return;
+        }
+
+        std::shared_ptr<Shader> shader = std::make_shared<Shader>();
+        shader->setVertexShader(vshSource);
+        shader->setFragmentShader(fshSource);
+        shader->link();
+        findUniforms(*shader);
+        scene.setShader(shaderId, shader);
+    }
+
+    // Looks up the uniforms of the shader.
+    void findUniforms(Shader& shader)
+    {
+        viewProjection = shader.uniform<glm::mat4>("viewProjection");
+        colorTexture = shader.uniform<int>("colorTexture");
+        textured = shader.uniform<int>("textured");
+    }
+
+    // Returns the current shader or nullptr if the shader is not yet
+    // compiled.
+    std::shared_ptr<Shader> currentShader()
+    {
+        std::shared_ptr<Shader> shader = scene.shader(shaderId);
+        if (shader || !shaderHandle.isValid())
+            return shader;
+
+        shader = shaderHandle.shader();
+        if (shader)
+        {
+            findUniforms(*shader);
+            scene.setShader(shaderId, shader);
+        }
+        return shader;
+    }
+
+    // Calls the function with the ranges of quads, in parallel if
+    // the batch has a job system.
+    void forEachRange(const std::function<void(int, int)>& function)
+    {
+        const int count = scene.size();
+        if (jobs)
+            jobs->parallelFor(0, count, QuadsPerJob, function);
+        else
+            function(0, count);
+    }
+
+    // Rotates the quads and updates their transforms in a single
+    // pass.
+    void update(float elapsed)
+    {
+        const float seconds = elapsed / 1000.0f;
+        Scene* s = &scene;
+        forEachRange([s, seconds](int begin, int end)
+        {
+            s->rotate(seconds, begin, end);
+            s->updateTransforms(begin, end);
+        });
+    }
+
+    // Gathers the instance data of the visible quads from the scene
+    // arrays.
+    void buildInstances()
+    {
+        const int count = scene.size();
+        const int visibleCount = scene.visibleCount();
+        instances.resize(visibleCount);
+
+        const glm::mat4* transforms = scene.transforms();
+        const glm::vec4* uvRects = scene.uvRects();
+        const glm::u8vec4* colors = scene.colors();
+        Instance* out = instances.data();
+        if (visibleCount == count)
+        {
+            // Every quad is visible, the indices match.
+            forEachRange([=](int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                {
+                    out[i].model  = transforms[i];
+                    out[i].uvRect = uvRects[i];
+                    out[i].color  = colors[i];
+                }
+            });
+            return;
+        }
+
+        const uint8_t* visibility = scene.visibility();
+        for (int i = 0; i < count; ++i)
+        {
+            if (!visibility[i])
+                continue;
+            out->model  = transforms[i];
+            out->uvRect = uvRects[i];
+            out->color  = colors[i];
+            ++out;
+        }
+    }
+
+    // The quads. The batch never adds or removes quads, the handles
+    // map the quad indices to the objects.
+    Scene scene;
+    std::vector<Scene::Handle> handles;
+    Scene::MeshId meshId = Scene::InvalidId;
+    Scene::ShaderId shaderId = Scene::InvalidId;
+    // Instance data of the visible quads.
+    std::vector<Instance> instances;
+
+    // Updates the transforms in parallel, nullptr if none.
+    std::shared_ptr<JobSystem> jobs;
+
+    bool rotating = true;
+    // True if the batch has changed outside of update or has not
+    // yet been rendered with its shader.
+    bool changed = true;
+
+    Shader::Uniform<glm::mat4> viewProjection;
+    Shader::Uniform<int> colorTexture;
+    Shader::Uniform<int> textured;
+    // Texture sampled instead of the colors.
+    std::shared_ptr<Texture> texture;
+    // Handle of the asynchronously compiled shader.
+    ShaderHandle shaderHandle;
+};
+
+/* ---------------------------------------------------------------- */
+
+QuadBatch::QuadBatch(int count,
+                     std::shared_ptr<ShaderCompiler> compiler)
+    : d(std::make_shared<Data>(count, compiler))
+{}
+
+/* ---------------------------------------------------------------- */
+
+int QuadBatch::count() const
+{ return d->scene.size(); }
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::setVisible(int index, bool visible)
+{
+    if (index < 0 || index >= int(d->handles.size()))
+        return;
+    d->scene.setVisible(d->handles[index], visible);
+    d->changed = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool QuadBatch::isVisible(int index) const
+{
+    if (index < 0 || index >= int(d->handles.size()))
+        return false;
+    const int i = d->scene.indexOf(d->handles[index]);
+    return i >= 0 && d->scene.visibility()[i] != 0;
+}
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::setJobSystem(std::shared_ptr<JobSystem> jobs)
+{ d->jobs = jobs; }
+
+/* ---------------------------------------------------------------- */
+
+bool QuadBatch::update(float elapsed)
+{
+    bool changed = d->changed;
+    if (d->rotating)
+    {
+        d->update(elapsed);
+        changed = true;
+    }
+
+    // Render again until the compiled shader has been rendered. A
+    // failed compile has nothing to render.
+    if (!d->currentShader() && !d->shaderHandle.isFailed())
+        changed = true;
+    return changed;
+}
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::setRotating(bool rotating)
+{
+    d->rotating = rotating;
+    d->changed  = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::vector<float> QuadBatch::rotationSpeeds() const
+{
+    const float* rates = d->scene.rotationRates();
+    return std::vector<float>(rates, rates + d->scene.size());
+}
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::setOrientations(
+        const std::vector<glm::quat>& orientations)
+{
+    const int count = std::min(d->scene.size(),
+                               int(orientations.size()));
+    Scene* scene = &d->scene;
+    d->forEachRange([scene, count, &orientations](int begin, int end)
+    {
+        end = std::min(end, count);
+        std::copy(orientations.begin() + std::min(begin, end),
+                  orientations.begin() + end,
+                  scene->orientations() + std::min(begin, end));
+        scene->updateTransforms(begin, end);
+    });
+    d->changed = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::setTexture(std::shared_ptr<Texture> texture,
+                           const std::vector<glm::vec4>& uvRects)
+{
+    d->texture = texture;
+    d->changed = true;
+    glm::vec4* rects = d->scene.uvRects();
+    for (int i = 0; i < d->scene.size(); ++i)
+        rects[i] = uvRects.empty() ? glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)
+                                   : uvRects[i % uvRects.size()];
+}
+
+/* ---------------------------------------------------------------- */
+
+QRect QuadBatch::screenBounds(const glm::mat4& view,
+                              const glm::mat4& projection,
+                              const QSize& viewport) const
+{
+    // Project the corners of the quads in world space, each range
+    // into its own rectangle.
+    const glm::mat4 viewProjection = projection * view;
+    const int count = d->scene.size();
+    const int rangeCount = (count + QuadsPerJob - 1) / QuadsPerJob;
+    std::vector<QRect> rects(rangeCount);
+    const glm::mat4* transforms = d->scene.transforms();
+    const uint8_t* visibility = d->scene.visibility();
+    const std::function<void(int, int)> project = [&](int begin, int end)
+    {
+        const glm::vec4 corners[4] =
+        {
+            glm::vec4(-0.5f, -0.5f, 0.0f, 1.0f),
+            glm::vec4( 0.5f, -0.5f, 0.0f, 1.0f),
+            glm::vec4( 0.5f,  0.5f, 0.0f, 1.0f),
+            glm::vec4(-0.5f,  0.5f, 0.0f, 1.0f)
+        };
+        std::vector<glm::vec3> points;
+        points.reserve((end - begin) * 4);
+        for (int i = begin; i < end; ++i)
+        {
+            if (!visibility[i])
+                continue;
+            for (const glm::vec4& corner : corners)
+                points.push_back(glm::vec3(transforms[i] * corner));
+        }
+
+        rects[begin / QuadsPerJob] =
+            DamageRegion::project(viewProjection, points.data(),
+                                  int(points.size()), viewport);
+    };
+    if (d->jobs)
+        d->jobs->parallelFor(0, count, QuadsPerJob, project);
+    else
+        for (int begin = 0; begin < count; begin += QuadsPerJob)
+            project(begin, std::min(begin + QuadsPerJob, count));
+
+    QRect bounds;
+    for (const QRect& r : rects)
+        bounds = bounds.united(r);
+    return bounds;
+}
+
+/* ---------------------------------------------------------------- */
+
+void QuadBatch::render(const glm::mat4& view,
+                       const glm::mat4& projection)
+{
+    // Skip rendering until the shader is compiled.
+    std::shared_ptr<Shader> shader = d->currentShader();
+    std::shared_ptr<Mesh> mesh = d->scene.mesh(d->meshId);
+    if (!shader || !mesh)
+        return;
+
+    d->buildInstances();
+    d->changed = false;
+    if (d->instances.empty())
+        return;
+
+    mesh->writeInstanceData(d->instances);
+    mesh->bind();
+    shader->bind();
+    shader->setUniform(d->viewProjection, projection * view);
+    shader->setUniform(d->textured, d->texture ? 1 : 0);
+    if (d->texture)
+    {
+        d->texture->bind(0);
+        shader->setUniform(d->colorTexture, 0);
+    }
+    mesh->renderInstanced(int(d->instances.size()), GL_TRIANGLES);
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,160 @@
+/**
+    @file   opengl_quad_batch.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::QuadBatch class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace kuu
+{
+
+class JobSystem;
+
+namespace opengl
+{
+
+class ShaderCompiler;
+class Texture;
+
+/**
+    A batch of rotating quads rendered with a single instanced draw
+    call.
+
+    The quads share a single mesh and shader. The quads are stored in
+    a @ref Scene, one array per property. The model transform, the
+    texture coordinates and the color of each visible quad are
+    gathered from the arrays into a per-instance buffer on every
+    frame. The quads are laid out in a grid that covers the area of a
+    single 2x2 @ref Quad at the origo and each quad rotates around its
+    Y-axis with its own speed.
+
+    The quads can sample images of a single texture, e.g. of a @ref
+    TextureAtlas. The texture coordinates of the image are a part of
+    the instance data so the quads are still drawn in a single batch.
+
+    @code
+    QuadBatch batch(10000);
+    ...
+    batch.update(10); // 10 milliseconds
+    batch.render(view, projection);
+    @endcode
+ **/
+class QuadBatch
+{
+public:
+    /**
+        Constructs the quad batch.
+
+        @param count    The count of quads.
+        @param compiler The shader compiler, nullptr to compile the
+                        shader synchronously. With a compiler the
+                        batch is not rendered until the shader is
+                        available.
+     **/
+    explicit QuadBatch(int count,
+                       std::shared_ptr<ShaderCompiler> compiler = nullptr);
+
+    /**
+        Returns the count of quads.
+     **/
+    int count() const;
+
+    /**
+        Shows or hides the quad. A hidden quad keeps rotating but it
+        is not rendered. The quads are visible by default.
+        @param index   The index of the quad in [0, count).
+        @param visible True to show the quad.
+     **/
+    void setVisible(int index, bool visible);
+
+    /**
+        Returns true if the quad at the index is visible.
+     **/
+    bool isVisible(int index) const;
+
+    /**
+        Sets the job system that updates the transforms of the quads
+        in parallel. With nullptr the transforms are updated on the
+        calling thread, this is the default.
+     **/
+    void setJobSystem(std::shared_ptr<JobSystem> jobs);
+
+    /**
+        Updates the rotations of all the quads in a single pass.
+        @param  elapsed Time in milliseconds since the function was
+                        called last time.
+        @return True if the quads must be rendered again: they
+                rotate, their texture was set or their shader is
+                being compiled.
+     **/
+    bool update(float elapsed);
+
+    /**
+        Sets the quads rotating. Default is true.
+     **/
+    void setRotating(bool rotating);
+
+    /**
+        Returns the rotation speeds of the quads around their Y-axis
+        in radians per second.
+     **/
+    std::vector<float> rotationSpeeds() const;
+
+    /**
+        Sets the orientations of the quads, e.g. from a simulation.
+        The quads should not be rotating.
+        @param orientations The orientation of each quad.
+     **/
+    void setOrientations(const std::vector<glm::quat>& orientations);
+
+    /**
+        Sets the texture that the quads sample instead of their
+        colors.
+
+        @param texture The texture, nullptr to use the colors.
+        @param uvRects The texture coordinates (u0, v0, u1, v1) of the
+                       images. The images are assigned to the quads
+                       in turn. If empty then every quad samples the
+                       whole texture.
+     **/
+    void setTexture(std::shared_ptr<Texture> texture,
+                    const std::vector<glm::vec4>& uvRects =
+                        std::vector<glm::vec4>());
+
+    /**
+        Returns the bounding rectangle of all the quads on the viewport
+        in pixels with the origin at the bottom-left corner.
+
+        @param view       The view matrix.
+        @param projection The projection matrix.
+        @param viewport   The size of the viewport.
+     **/
+    QRect screenBounds(const glm::mat4& view,
+                       const glm::mat4& projection,
+                       const QSize& viewport) const;
+
+    /**
+        Writes the instance data and renders all the quads with a
+        single draw call.
+        @param view       The view matrix.
+        @param projection The projection matrix.
+     **/
+    void render(const glm::mat4& view,
+                const glm::mat4& projection);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -5,12 +5,26 @@
  **/
 
 #include "opengl_rendering_thread.h"
-#include "elapsed_timer.h"
+#include "damage_region.h"
+#include "frame_pacer.h"
+#include "job_system.h"
+#include "opengl_gpu_timer.h"
+#include "opengl_model.h"
 #include "opengl_quad.h"
-#include "opengl_widget.h"
-
+#include "opengl_quad_batch.h"
+#include "opengl_state_cache.h"
+#include "opengl_swap_chain.h"
+#include "opengl_texture_atlas.h"
+#include "simulation_thread.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <glm/gtx/transform.hpp>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
 #include <QtGui/QOffscreenSurface>
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QOpenGLFramebufferObject>
@@ -20,51 +34,234 @@ namespace kuu
 namespace opengl
 {
 
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Interval in milliseconds to poll the pending uploads in the
+// render-on-demand mode.
+const unsigned long PollInterval = 50;
+
+// Count of simulation steps per second.
+const double SimulationRate = 120.0;
+
+// Size of the texture atlas of the quads.
+const QSize AtlasSize(2048, 2048);
+
+/* ---------------------------------------------------------------- *
+   Locks the mutex for the lifetime of the scope and records the time
+   spent waiting for the mutex into the trace.
+ * ---------------------------------------------------------------- */
+class TracedLocker
+{
+public:
+    explicit TracedLocker(QMutex* mutex)
+        : mutex_(mutex)
+    {
+        if (!Trace::isEnabled())
+        {
+            mutex_->lock();
+            return;
+        }
+
+        const Trace::Clock::time_point start = Trace::Clock::now();
+        mutex_->lock();
+        Trace::record("RenderingThread::mutexWait", start,
+                      Trace::Clock::now());
+    }
+
+    ~TracedLocker()
+    { mutex_->unlock(); }
+
+private:
+    TracedLocker(const TracedLocker&);
+    TracedLocker& operator=(const TracedLocker&);
+
+    QMutex* mutex_;
+};
+
+/* ---------------------------------------------------------------- *
+   GPU timer stages of a frame.
+ * ---------------------------------------------------------------- */
+enum GpuStage
+{
+    GpuStageClear,
+    GpuStageRender,
+    GpuStageCount
+};
+
+/* ---------------------------------------------------------------- *
+   Returns the duration in milliseconds.
+ * ---------------------------------------------------------------- */
+double milliseconds(Clock::duration elapsed)
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::milli>>(elapsed).count();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the size of the frame rendered with the resolution scale.
+ * ---------------------------------------------------------------- */
+QSize scaledSize(const QSize& size, double scale)
+{
+    return QSize(std::max(int(std::lround(size.width()  * scale)), 1),
+                 std::max(int(std::lround(size.height() * scale)), 1));
+}
+
+/* ---------------------------------------------------------------- *
+   Smooths the statistics value with an exponential moving average.
+ * ---------------------------------------------------------------- */
+void smooth(double& value, double sample)
+{
+    const double alpha = 0.1;
+    value = value == 0.0 ? sample : value + alpha * (sample - value);
+}
+
+} // anonymous namespace
+
 /* ---------------------------------------------------------------- */
 
 struct RenderingThread::Data
 {
-    Data(Widget* widget, const QSize& framebufferSize)
-        : widget(widget)
+    Data(const QSize& framebufferSize,
+         const std::function<void()>& frameReady)
+        : frameReady(frameReady)
         , framebufferSize(framebufferSize)
+        , requestedFramebufferSize(framebufferSize)
+        , swapChain(std::make_shared<SwapChain>(framebufferSize))
+        , framePacer(std::make_shared<FramePacer>())
+        , resolutionGovernor(std::make_shared<ResolutionGovernor>())
     {}
 
     // OpenGL context
     std::shared_ptr<QOpenGLContext> context;
     // Offscreen surface
     std::shared_ptr<QOffscreenSurface> surface;
-    // OpengL widget
-    Widget* widget;
+    // Called after a frame is rendered
+    std::function<void()> frameReady;
     // Size of framebuffers
     QSize framebufferSize;
+    // Size of framebuffers requested by the UI, guarded by mutex.
+    QSize requestedFramebufferSize;
 
-    // Rendering mutex
+    // Mutex for the thread state. This is not held while rendering.
     QMutex mutex;
+    // Wakes up the thread in the render-on-demand mode.
+    QWaitCondition wakeUp;
     // True if the application is exiting
     bool exiting = false;
+    // True if frames are rendered only when requested, guarded by
+    // mutex.
+    bool renderOnDemand = false;
+    // True if a frame has been requested, guarded by mutex.
+    bool frameRequested = true;
+    // True if the quads rotate, guarded by mutex.
+    bool animated = true;
+    // True if the simulation rotates the quads.
+    bool rotating = true;
+    // True if the scene changed in the previous update.
+    bool sceneChanged = true;
     // True if the OpenGL is initialized
     bool initialized = false;
-    // Timer for rotating the quad.
-    ElapsedTimer timer;
+    // Count of rendered quads.
+    int quadCount = 1;
+    // Count of job workers, negative to size by the hardware.
+    int jobWorkerCount = -1;
+    // Mesh file rendered with the quads and image file that
+    // textures the quads, empty if none.
+    QString meshPath;
+    QString texturePath;
+    // Image files packed into the atlas of the quads, empty if none.
+    QStringList atlasPaths;
+    // Updates the transforms of large quad batches in parallel.
+    std::shared_ptr<JobSystem> jobSystem;
     // Quad mesh
     std::shared_ptr<Quad> quad;
-
-    // Framebuffer texture ID for the UI thread.
-    GLuint tex = 0;
-    // Framebuffer for thread to render the rotating quad.
-    std::shared_ptr<QOpenGLFramebufferObject> renderFbo;
-    // Framebuffer for UI to display
-    std::shared_ptr<QOpenGLFramebufferObject> displayFbo;
+    // Instanced quads if more than one quad is rendered.
+    std::shared_ptr<QuadBatch> quadBatch;
+    // Model of the mesh file.
+    std::shared_ptr<Model> model;
+    // Upload of the quad texture, reset when the texture is set.
+    UploadHandle textureUpload;
+    // Simulates the rotations of the quads on its own thread.
+    std::shared_ptr<SimulationThread> simulation;
+    // Interpolated orientations of the quads.
+    std::vector<glm::quat> orientations;
+    // Screen bounds of the quads and the size of the previous frame.
+    QRect sceneBounds;
+    QSize previousSize;
+
+    // Swap chain of framebuffers between the thread and the UI.
+    std::shared_ptr<SwapChain> swapChain;
+    // Paces the rendering loop.
+    std::shared_ptr<FramePacer> framePacer;
+    // Scales the render resolution.
+    std::shared_ptr<ResolutionGovernor> resolutionGovernor;
+    // Compiles the shaders without blocking the rendering.
+    std::shared_ptr<ShaderCompiler> shaderCompiler;
+    // Uploads meshes and textures without blocking the rendering.
+    std::shared_ptr<UploadQueue> uploadQueue;
+
+    // GPU timer of the frame stages.
+    std::shared_ptr<GpuTimer> gpuTimer;
+    // Time when the previous frame was published.
+    Clock::time_point previousFrameTime;
+    // Timing statistics, guarded by mutex.
+    RenderingThread::Stats stats;
 };
 
 /* ---------------------------------------------------------------- */
 
+void createAtlas(std::shared_ptr<RenderingThread::Data> d)
+{
+    KUU_TRACE_SCOPE("createAtlas");
+
+    // Pack the images into the atlas and texture the quads with it.
+    TextureAtlas atlas(AtlasSize);
+    std::vector<glm::vec4> uvRects;
+    for (const QString& path : d->atlasPaths)
+    {
+        const QImage image(path);
+        if (image.isNull())
+        {
+            std::cerr << "Failed to read image "
+                      << path.toStdString() << std::endl;
+            continue;
+        }
+
+        const QRect rect = atlas.add(image);
+        if (rect.isNull())
+        {
+            std::cerr << "Image " << path.toStdString()
+                      << " does not fit into the atlas" << std::endl;
+            continue;
+        }
+        uvRects.push_back(atlas.uvRect(rect));
+    }
+
+    if (uvRects.empty())
+        return;
+    if (d->quadBatch)
+        d->quadBatch->setTexture(atlas.texture(), uvRects);
+    else
+        d->quad->setTexture(atlas.texture(), uvRects.front());
+}
+
+/* ---------------------------------------------------------------- */
+
 void initialize(std::shared_ptr<RenderingThread::Data> d)
 {
     // Initialize OpenGL if needed.
     if (d->initialized)
         return;
 
+    KUU_TRACE_SCOPE("initialize");
+
+    // Only this context is made current on the thread so the state
+    // cache stays valid between the frames.
+    StateCache::current().invalidate();
+
 #ifdef _WIN32
     glewExperimental = GL_TRUE;
     GLenum result = glewInit();
@@ -75,40 +272,104 @@ void initialize(std::shared_ptr<RenderingThread::Data> d)
         return;
     }
 #endif
-    // Create the rotating quad
-    d->quad = std::make_shared<Quad>(2.0f, 2.0f);
-
-    // Create the framebuffer objects. Two framebuffers is needed
-    // for double-buffering.
+    // Create the job workers that update the transforms, only the
+    // draw calls are made on this thread.
+    d->jobSystem = std::make_shared<JobSystem>(d->jobWorkerCount);
+
+    // Create the rotating quad. The framebuffers are created by the
+    // swap chain when the first frame is rendered. The quad is not
+    // rendered until the compiler has compiled its shader.
+    if (d->quadCount > 1)
+    {
+        d->quadBatch = std::make_shared<QuadBatch>(d->quadCount,
+                                                   d->shaderCompiler);
+        d->quadBatch->setJobSystem(d->jobSystem);
+    }
+    else
+        d->quad = std::make_shared<Quad>(2.0f, 2.0f, d->shaderCompiler);
+
+    // Upload the mesh and the texture on the upload queue, the
+    // frames are rendered without them until they are polled.
+    if (!d->meshPath.isEmpty())
+        d->model = std::make_shared<Model>(d->uploadQueue,
+                                           d->meshPath,
+                                           d->shaderCompiler);
+    if (!d->atlasPaths.isEmpty())
+        createAtlas(d);
+    else if (!d->texturePath.isEmpty())
+        d->textureUpload =
+            d->uploadQueue->uploadTexture(d->texturePath);
+
+    // Rotate the quads with the simulation thread. The simulation
+    // wakes up the thread when it has taken a step.
+    const std::vector<float> speeds = d->quadBatch
+        ? d->quadBatch->rotationSpeeds()
+        : std::vector<float>(1, d->quad->rotationSpeed());
+    RenderingThread::Data* data = d.get();
+    d->simulation = std::make_shared<SimulationThread>(
+        speeds, SimulationRate, [data]()
+    {
+        TracedLocker lock(&data->mutex);
+        data->frameRequested = true;
+        data->wakeUp.wakeAll();
+    });
+    d->simulation->setJobSystem(d->jobSystem);
+    d->simulation->setAnimated(d->rotating);
+    d->simulation->start();
+    if (d->quadBatch)
+        d->quadBatch->setRotating(false);
+    else
+        d->quad->setRotating(false);
+
+    // Create the GPU timer for the frame stages.
+    d->gpuTimer = std::make_shared<GpuTimer>(GpuStageCount);
 
-    QOpenGLFramebufferObjectFormat framebufferFormat;
-    framebufferFormat.setAttachment(
-        QOpenGLFramebufferObject::CombinedDepthStencil);
+    d->initialized = true;
+}
 
-    d->renderFbo  = std::make_shared<QOpenGLFramebufferObject>(
-        d->framebufferSize,
-        framebufferFormat);
+/* ---------------------------------------------------------------- */
 
-    d->displayFbo = std::make_shared<QOpenGLFramebufferObject>(
-        d->framebufferSize,
-        framebufferFormat);
+void deinitialize(std::shared_ptr<RenderingThread::Data> d)
+{
+    if (!d->initialized)
+        return;
 
-    d->initialized = true;
+    KUU_TRACE_SCOPE("deinitialize");
+
+    // Free the OpenGL resources while the context is still current.
+    d->simulation->stop();
+    d->simulation.reset();
+    d->uploadQueue->stop();
+    d->uploadQueue->clear();
+    d->model.reset();
+    d->textureUpload = UploadHandle();
+    d->quad.reset();
+    d->quadBatch.reset();
+    d->jobSystem.reset();
+    d->gpuTimer.reset();
+    d->swapChain->destroy();
+
+    d->initialized = false;
 }
 
 /* ---------------------------------------------------------------- */
 
-void renderFrame(std::shared_ptr<RenderingThread::Data> d)
+uint64_t renderFrame(std::shared_ptr<RenderingThread::Data> d,
+                     bool requested)
 {
-    // Bind the framebuffer for rendering.
-    d->renderFbo->bind();
+    KUU_TRACE_SCOPE("renderFrame");
 
-    // Set the viewport
-    const QSize size = d->framebufferSize;
-    glViewport(0, 0, size.width(), size.height());
+    const Clock::time_point frameStart = Clock::now();
+
+    // The frames are rendered with the scaled resolution.
+    const QSize size = scaledSize(d->framebufferSize,
+                                  d->resolutionGovernor->scale());
 
-    // Perspective projection matrix
-    const float aspect = float(size.width()) / float(size.height());
+    // Perspective projection matrix of the full size, the scaled
+    // size is rounded.
+    const QSize fullSize = d->framebufferSize;
+    const float aspect =
+        float(fullSize.width()) / float(fullSize.height());
     const glm::mat4 projection =
         glm::perspective(
             glm::radians(45.0f), aspect, 0.1f, 10.0f);
@@ -118,38 +379,187 @@ void renderFrame(std::shared_ptr<RenderingThread::Data> d)
         glm::translate(glm::mat4(1.0f),
                        glm::vec3(0.0f, 0.0f, -5.0f));
 
-    // Clear the color buffer
+    // Take the finished uploads into use and interpolate the quad
+    // orientations between the two newest simulation steps at the
+    // frame start. Skip the frame if nothing changed and no frame
+    // was requested.
+    const int uploads = d->uploadQueue->poll();
+    if (d->simulation->interpolate(frameStart, d->orientations))
+    {
+        if (d->quadBatch)
+            d->quadBatch->setOrientations(d->orientations);
+        else
+            d->quad->setOrientation(d->orientations.front());
+    }
+    if (d->textureUpload.isComplete())
+    {
+        if (d->quadBatch)
+            d->quadBatch->setTexture(d->textureUpload.texture());
+        else
+            d->quad->setTexture(d->textureUpload.texture());
+        d->textureUpload = UploadHandle();
+    }
+    else if (d->textureUpload.isFailed())
+        d->textureUpload = UploadHandle();
+
+    bool changed = uploads > 0;
+    if (d->quadBatch)
+        changed |= d->quadBatch->update(0.0f);
+    else
+        changed |= d->quad->update(0.0f);
+    const bool modelChanged = d->model && d->model->update();
+    changed |= modelChanged;
+    d->sceneChanged = changed;
+    if (!changed && !requested)
+        return 0;
+
+    // The damage of the frame is the area that the quads covered in
+    // the previous frame and cover now, and the model if it changed.
+    // A changed frame size or a finished upload damages the whole
+    // frame.
+    const QRect bounds = d->quadBatch
+        ? d->quadBatch->screenBounds(view, projection, size)
+        : d->quad->screenBounds(view, projection, size);
+    DamageRegion frameDamage(size);
+    if (size != d->previousSize || uploads > 0)
+        frameDamage.addAll();
+    else if (changed)
+    {
+        frameDamage.add(d->sceneBounds);
+        frameDamage.add(bounds);
+        if (modelChanged)
+            frameDamage.add(
+                d->model->screenBounds(view, projection, size));
+    }
+    d->sceneBounds  = bounds;
+    d->previousSize = size;
+    const Clock::time_point updateEnd = Clock::now();
+
+    d->gpuTimer->beginFrame();
+
+    // Take the next framebuffer from swap chain and bind it for
+    // rendering. The framebuffers are allocated for the full size
+    // and the frame is rendered with the scaled resolution, so the
+    // framebuffer can be larger than the frame.
+    d->swapChain->setSize(size, d->framebufferSize);
+    QOpenGLFramebufferObject* fbo = d->swapChain->beginFrame();
+    if (!fbo)
+        return 0;
+    fbo->bind();
+
+    // Set the viewport to the frame area
+    glViewport(0, 0, size.width(), size.height());
+
+    // The framebuffer holds the frame that was rendered into it a
+    // few frames ago. Repaint the damage of this frame and of the
+    // frames published after that one.
+    DamageRegion repaint(size);
+    repaint.add(frameDamage.rects());
+    std::vector<QRect> accumulated;
+    if (d->swapChain->accumulatedDamage(accumulated))
+        repaint.add(accumulated);
+    else
+        repaint.addAll();
+
+    // Clear the damaged rectangles
+    const Clock::time_point clearStart = Clock::now();
+    d->gpuTimer->begin(GpuStageClear);
+    glEnable(GL_SCISSOR_TEST);
     glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for (const QRect& r : repaint.rects())
+    {
+        glScissor(r.x(), r.y(), r.width(), r.height());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    d->gpuTimer->end(GpuStageClear);
 
     // Set rendering attributes
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
-    // Render the quad
-    d->quad->update(d->timer.elapsed());
-    d->quad->render(view, projection);
-
-    // Flush the pipeline
-    glFlush();
+    // Render the quad and the model once inside the bounding
+    // rectangle of the damage. The pixels outside of the damage are
+    // already up to date and fail the depth test against themselves.
+    const Clock::time_point renderStart = Clock::now();
+    d->gpuTimer->begin(GpuStageRender);
+    if (!repaint.isEmpty())
+    {
+        QRect scissor;
+        for (const QRect& r : repaint.rects())
+            scissor = scissor.united(r);
+        glScissor(scissor.x(), scissor.y(),
+                  scissor.width(), scissor.height());
+        if (d->quadBatch)
+            d->quadBatch->render(view, projection);
+        else
+            d->quad->render(view, projection);
+        if (d->model)
+            d->model->render(view, projection);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    d->gpuTimer->end(GpuStageRender);
 
     // Release the framebuffer
-    d->renderFbo->release();
-    // Take the current framebuffer texture ID
-    d->tex = d->renderFbo->texture();
+    fbo->release();
+
+    // Fence, flush and publish the frame for the UI.
+    const Clock::time_point publishStart = Clock::now();
+    const uint64_t frameNumber =
+        d->swapChain->endFrame(frameDamage.rects());
+    const Clock::time_point publishEnd = Clock::now();
+
+    // Pick the resolution of the next frame.
+    const double renderScale = d->resolutionGovernor->update(
+        milliseconds(publishEnd - frameStart),
+        d->gpuTimer->elapsed(GpuStageClear) +
+        d->gpuTimer->elapsed(GpuStageRender));
+
+    // Update the statistics.
+    {
+        TracedLocker lock(&d->mutex);
+        RenderingThread::Stats& stats = d->stats;
+        smooth(stats.cpuFrame,   milliseconds(publishEnd   - frameStart));
+        smooth(stats.cpuClear,   milliseconds(renderStart  - clearStart));
+        smooth(stats.cpuUpdate,  milliseconds(updateEnd    - frameStart));
+        smooth(stats.cpuRender,  milliseconds(publishStart - renderStart));
+        smooth(stats.cpuPublish, milliseconds(publishEnd   - publishStart));
+        smooth(stats.gpuClear,   d->gpuTimer->elapsed(GpuStageClear));
+        smooth(stats.gpuRender,  d->gpuTimer->elapsed(GpuStageRender));
+        stats.renderScale = renderScale;
+        const std::vector<JobSystem::WorkerStats> jobStats =
+            d->jobSystem->stats();
+        double utilization = 0.0;
+        for (const JobSystem::WorkerStats& worker : jobStats)
+            utilization += worker.utilization;
+        stats.jobWorkers = d->jobSystem->workerCount();
+        smooth(stats.jobUtilization, utilization / jobStats.size());
+        smooth(stats.damagedArea,
+               double(repaint.area()) /
+               (double(size.width()) * size.height()));
+        if (d->previousFrameTime != Clock::time_point())
+        {
+            const double interval =
+                milliseconds(publishEnd - d->previousFrameTime);
+            if (interval > 0.0)
+                smooth(stats.fps, 1000.0 / interval);
+        }
+    }
+    d->previousFrameTime = publishEnd;
 
-    // Swap the framebuffers for double-buffering.
-    std::swap(d->renderFbo, d->displayFbo);
+    return frameNumber;
 }
 
 /* ---------------------------------------------------------------- */
 
-RenderingThread::RenderingThread(Widget* widget)
-    : d(std::make_shared<Data>(widget, widget->size()))
+RenderingThread::RenderingThread(
+        QOpenGLContext* shareContext,
+        const QSize& framebufferSize,
+        const std::function<void()>& frameReady)
+    : d(std::make_shared<Data>(framebufferSize, frameReady))
 {
     d->context = std::make_shared<QOpenGLContext>();
-    d->context->setShareContext(widget->context());
-    d->context->setFormat(widget->context()->format());
+    d->context->setShareContext(shareContext);
+    d->context->setFormat(shareContext->format());
     d->context->create();
     d->context->moveToThread(this);
 
@@ -157,53 +567,230 @@ RenderingThread::RenderingThread(Widget* widget)
     d->surface->setFormat(d->context->format());
     d->surface->create();
     d->surface->moveToThread(this);
+
+    d->shaderCompiler = std::make_shared<ShaderCompiler>(shareContext);
+    d->uploadQueue    = std::make_shared<UploadQueue>(shareContext);
 }
 
 /* ---------------------------------------------------------------- */
 
 void RenderingThread::stop()
 {
-    d->mutex.lock();
-    d->exiting = true;
-    d->mutex.unlock();
+    {
+        TracedLocker lock(&d->mutex);
+        d->exiting = true;
+        d->wakeUp.wakeAll();
+    }
+
+    // Wake up the thread if it waits for the next frame.
+    d->framePacer->interrupt();
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setRenderOnDemand(bool onDemand)
+{
+    TracedLocker lock(&d->mutex);
+    d->renderOnDemand = onDemand;
+    d->frameRequested = true;
+    d->wakeUp.wakeAll();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool RenderingThread::isRenderOnDemand() const
+{
+    TracedLocker lock(&d->mutex);
+    return d->renderOnDemand;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::requestFrame()
+{
+    TracedLocker lock(&d->mutex);
+    d->frameRequested = true;
+    d->wakeUp.wakeAll();
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setAnimated(bool animated)
+{
+    TracedLocker lock(&d->mutex);
+    d->animated = animated;
+    d->frameRequested = true;
+    d->wakeUp.wakeAll();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool RenderingThread::isAnimated() const
+{
+    TracedLocker lock(&d->mutex);
+    return d->animated;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setFramebufferSize(const QSize& size)
+{
+    if (size.isEmpty())
+        return;
+
+    TracedLocker lock(&d->mutex);
+    d->requestedFramebufferSize = size;
+    d->frameRequested = true;
+    d->wakeUp.wakeAll();
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setQuadCount(int count)
+{
+    d->quadCount = count;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setJobWorkerCount(int count)
+{
+    d->jobWorkerCount = count;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setMeshFile(const QString& path)
+{
+    d->meshPath = path;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::setTextureFile(const QString& path)
+{
+    d->texturePath = path;
 }
 
 /* ---------------------------------------------------------------- */
 
-void RenderingThread::lock()
+void RenderingThread::setAtlasFiles(const QStringList& paths)
 {
-    d->mutex.lock();
+    d->atlasPaths = paths;
 }
 
 /* ---------------------------------------------------------------- */
 
-void RenderingThread::unlock()
+SwapChain::Frame RenderingThread::acquireFrame()
 {
-    d->mutex.unlock();
+    return d->swapChain->acquire();
 }
 
 /* ---------------------------------------------------------------- */
 
-GLuint RenderingThread::framebufferTexture() const
+void RenderingThread::releaseFrame()
 {
-    return d->tex;
+    d->swapChain->release();
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<FramePacer> RenderingThread::framePacer() const
+{
+    return d->framePacer;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<ResolutionGovernor>
+RenderingThread::resolutionGovernor() const
+{
+    return d->resolutionGovernor;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<ShaderCompiler> RenderingThread::shaderCompiler() const
+{
+    return d->shaderCompiler;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<UploadQueue> RenderingThread::uploadQueue() const
+{
+    return d->uploadQueue;
+}
+
+/* ---------------------------------------------------------------- */
+
+RenderingThread::Stats RenderingThread::stats() const
+{
+    TracedLocker lock(&d->mutex);
+    return d->stats;
+}
+
+/* ---------------------------------------------------------------- */
+
+void RenderingThread::reportPresentTime(double cpu, double gpu)
+{
+    TracedLocker lock(&d->mutex);
+    smooth(d->stats.cpuPresent, cpu);
+    smooth(d->stats.gpuPresent, gpu);
 }
 
 /* ---------------------------------------------------------------- */
 
 void RenderingThread::run()
 {
+    Trace::setThreadName("Rendering thread");
+
     for(;;)
     {
-        // Lock the rendering mutex.
-        QMutexLocker lock(&d->mutex);
+        KUU_TRACE_SCOPE("RenderingThread::run");
+
+        // Stops the thread if exit flag is set. The mutex is held
+        // only while reading the state so that the UI thread never
+        // waits for a frame to be rendered.
+        bool requested = true;
+        bool animated  = true;
+        {
+            TracedLocker lock(&d->mutex);
+
+            // In the render-on-demand mode sleep until a frame is
+            // requested or the scene changes. The pending uploads
+            // are polled periodically as their completion is not
+            // signaled to the thread.
+            if (d->renderOnDemand && !d->frameRequested &&
+                !d->sceneChanged && !d->exiting)
+            {
+                KUU_TRACE_SCOPE("RenderingThread::sleep");
+                if (d->uploadQueue->pendingCount() > 0)
+                    d->wakeUp.wait(&d->mutex, PollInterval);
+                else
+                    d->wakeUp.wait(&d->mutex);
+            }
+
+            if (d->exiting)
+                break;
+            d->framebufferSize = d->requestedFramebufferSize;
+            requested = !d->renderOnDemand || d->frameRequested;
+            animated  = d->animated;
+            d->frameRequested = false;
+        }
 
-        // Stops the thread if exit flag is set.
-        if (d->exiting)
-            break;
+        // Wait until the pacer allows to start the next frame.
+        {
+            KUU_TRACE_SCOPE("FramePacer::waitForNextFrame");
+            if (!d->framePacer->waitForNextFrame())
+                continue;
+        }
 
         // Make the OpenGL context current on offscreen surface.
-        d->context->makeCurrent(d->surface.get());
+        {
+            KUU_TRACE_SCOPE("makeCurrent");
+            d->context->makeCurrent(d->surface.get());
+        }
 
         // Initialize if not done.
         if (!d->initialized)
@@ -212,15 +799,35 @@ void RenderingThread::run()
             d->initialized = true;
         }
 
-        // Renders the frame
-        renderFrame(d);
+        // Start or stop the simulation.
+        if (animated != d->rotating)
+        {
+            d->simulation->setAnimated(animated);
+            d->rotating = animated;
+        }
+
+        // Renders the frame if it was requested or the scene changed
+        const uint64_t frameNumber = renderFrame(d, requested);
 
         // Release OpenGL context
-        d->context->doneCurrent();
+        {
+            KUU_TRACE_SCOPE("doneCurrent");
+            d->context->doneCurrent();
+        }
 
-        // Notify UI about new frame.
-        QMetaObject::invokeMethod(d->widget, "update");
+        if (frameNumber == 0)
+            continue;
+        d->framePacer->frameRendered(frameNumber);
+
+        // Notify about new frame.
+        if (d->frameReady)
+            d->frameReady();
     }
+
+    // Free the OpenGL resources in this thread.
+    d->context->makeCurrent(d->surface.get());
+    deinitialize(d);
+    d->context->doneCurrent();
 }
 
 } // namespace opengl
@@ -6,9 +6,18 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QThread>
-#include "opengl_widget.h"
+#include "frame_pacer.h"
+#include "resolution_governor.h"
+#include "opengl_shader_compiler.h"
+#include "opengl_swap_chain.h"
+#include "opengl_upload_queue.h"
+
+class QOpenGLContext;
 
 namespace kuu
 {
@@ -16,34 +25,118 @@ namespace opengl
 {
 
 /**
-   @brief   A rendering thread for the OpenGL widget.
+   @brief   A rendering thread for an OpenGL widget.
 
    @details This thread renders a rotating triangle into framebuffer
             by using OpenGL 3.3 pipeline. The framebuffer can then be
             shown to user in UI thread.
 
-            The thread uses double-buffering meaning a framebuffer
-            can be shown to user while the next frame rendering is
-            going on.
+            The thread renders into a swap chain of at least three
+            framebuffers meaning the newest frame can be shown to
+            user while the next frame rendering is going on without
+            the threads waiting for each other.
+
+            The loop is paced with a @ref FramePacer that can be
+            accessed with @ref framePacer function.
+
+            The quads are rotated by a @ref SimulationThread with a
+            fixed timestep. Each frame interpolates the orientations
+            between the two newest simulation steps at the frame
+            start time, so the motion does not depend on the frame
+            rate or on the frame time jitter.
+
+            By default the thread renders frames continuously. In the
+            render-on-demand mode a frame is rendered only when it is
+            requested with @ref requestFrame, when the framebuffer
+            size changes or when the scene reports a change, e.g. a
+            rotating quad. Otherwise the thread sleeps on a wait
+            condition and the UI presents the previous frame again.
+
+            The frames can be rendered with a lower resolution than
+            the framebuffer size. The @ref ResolutionGovernor returned
+            by @ref resolutionGovernor picks the resolution from the
+            frame times. The framebuffers are allocated for the full
+            size and the frame is rendered into their bottom-left
+            corner, so a resolution change never reallocates them.
 
-            The framebuffer can be accessed as a two-dimensional
-            texture by getting the texture ID with @ref
-            framebufferTexture function. Before that the thread must
-            be locked with @ref lock function and after rendering
-            unlocked with @ref unlock call.
+            Only the damaged part of a frame is repainted. The damage
+            is the screen area the quads covered in the previous
+            frame and cover now. As a framebuffer of the swap chain
+            holds an older frame, the damage of the frames published
+            since then is repainted too. The clears and draws are
+            scissored to the repainted rectangles.
+
+            The newest frame can be accessed as a two-dimensional
+            texture with @ref acquireFrame function. After the UI
+            thread has rendered the texture it must call @ref
+            releaseFrame so that the thread knows when it can render
+            into the framebuffer again.
  **/
 class RenderingThread : public QThread
 {
 public:
+    /**
+        @brief   Timing statistics of the rendering.
+        @details The times are in milliseconds and smoothed with an
+                 exponential moving average. The CPU times are
+                 measured with a steady clock and the GPU times with
+                 timer queries that are read a few frames late.
+     **/
+    struct Stats
+    {
+        // Frames published per second.
+        double fps = 0.0;
+
+        // CPU times of the rendering thread frame stages.
+        double cpuFrame   = 0.0;
+        double cpuClear   = 0.0;
+        double cpuUpdate  = 0.0;
+        double cpuRender  = 0.0;
+        double cpuPublish = 0.0;
+
+        // GPU times of the rendering thread frame stages.
+        double gpuClear  = 0.0;
+        double gpuRender = 0.0;
+
+        // CPU and GPU times of the frame present in UI thread.
+        double cpuPresent = 0.0;
+        double gpuPresent = 0.0;
+
+        // Scale of the render resolution.
+        double renderScale = 1.0;
+
+        // Fraction of the frame area that was repainted.
+        double damagedArea = 0.0;
+
+        // Count of job workers and the fraction of the time that the
+        // workers and the waiting thread spent running jobs.
+        int jobWorkers = 0;
+        double jobUtilization = 0.0;
+
+        // Returns the GPU time of the frame.
+        double gpuFrame() const
+        { return gpuClear + gpuRender; }
+
+        // Returns true if the GPU time of the frame is larger than
+        // the CPU time.
+        bool isGpuBound() const
+        { return gpuFrame() > cpuFrame; }
+    };
+
     /**
         @brief Constructs the rendering thread.
 
-        @param widget The OpenGL widget. After a frame is rendered
-                      the thread will call 'update' slot for widget
-                      to paint its surface. The size of the widget is
-                      also used as the size of framebuffers.
+        @param shareContext    The context of the UI thread. The
+                               thread context shares objects with
+                               it and uses the same format.
+        @param framebufferSize The initial size of framebuffers.
+        @param frameReady      Called from the thread after each
+                               frame is rendered, e.g. to request
+                               the widget to paint its surface.
      **/
-    RenderingThread(Widget* widget);
+    RenderingThread(QOpenGLContext* shareContext,
+                    const QSize& framebufferSize,
+                    const std::function<void()>& frameReady);
 
     /**
        @brief   Stop sthe rendering thread.
@@ -53,21 +146,148 @@ public:
     void stop();
 
     /**
-        @brief   Locks the rendering thread mutex.
-        @details The framebuffer texture can then be accessed via
-                 @ref framebufferTexture function.
+       @brief   Sets the render-on-demand mode.
+       @details In the mode the thread renders a frame only when the
+                frame is requested or the scene has changed, and
+                sleeps otherwise. Can be called from any thread.
+     **/
+    void setRenderOnDemand(bool onDemand);
+
+    /**
+       @brief Returns true if the thread is in render-on-demand mode.
+     **/
+    bool isRenderOnDemand() const;
+
+    /**
+       @brief   Requests the thread to render a frame.
+       @details Wakes up the thread in the render-on-demand mode. Can
+                be called from any thread.
+     **/
+    void requestFrame();
+
+    /**
+       @brief   Sets the quads rotating.
+       @details A static scene lets the thread sleep in the
+                render-on-demand mode. The default is true. Can be
+                called from any thread.
+     **/
+    void setAnimated(bool animated);
+
+    /**
+       @brief Returns true if the quads rotate.
+     **/
+    bool isAnimated() const;
+
+    /**
+       @brief   Sets the size of the framebuffers.
+       @details The framebuffers are resized before the next frame is
+                rendered, the thread is not restarted.
+       @param   size The new size.
+     **/
+    void setFramebufferSize(const QSize& size);
+
+    /**
+       @brief   Sets the count of rendered quads.
+       @details With more than one quad the quads are rendered as an
+                instanced @ref QuadBatch. Must be called before the
+                thread is started. The default is 1.
+     **/
+    void setQuadCount(int count);
+
+    /**
+       @brief   Sets the count of job workers.
+       @details The workers update the transforms of a @ref QuadBatch
+                and interpolate the simulation in parallel, only the
+                OpenGL calls are made on the thread. Must be called
+                before the thread is started. The default -1 uses one
+                worker less than the hardware threads.
+     **/
+    void setJobWorkerCount(int count);
+
+    /**
+       @brief   Sets the mesh file rendered with the quads.
+       @details The mesh is uploaded with the @ref uploadQueue and
+                rendered once it is in its mesh arena. Must be called
+                before the thread is started. The default is none.
+       @param   path The path of the mesh file written by the @c
+                     qopenglwidget-meshconv tool.
+     **/
+    void setMeshFile(const QString& path);
+
+    /**
+       @brief   Sets the image file that textures the quads.
+       @details The image is uploaded with the @ref uploadQueue and
+                the quads use their colors until it is uploaded. Must
+                be called before the thread is started. The default
+                is none.
+     **/
+    void setTextureFile(const QString& path);
+
+    /**
+       @brief   Sets the image files that are packed into a texture
+                atlas that textures the quads.
+       @details The images are assigned to the quads in turn, so a
+                batch of quads with different images is still drawn
+                with a single texture binding. The atlas replaces the
+                texture file. Must be called before the thread is
+                started. The default is none.
+     **/
+    void setAtlasFiles(const QStringList& paths);
+
+    /**
+       @brief   Acquires the newest rendered frame.
+       @details Must be called from the UI thread while its OpenGL
+                context is current. The function never blocks.
+       @return  The frame, texture ID is 0 if no frame is rendered.
+     **/
+    SwapChain::Frame acquireFrame();
+
+    /**
+       @brief   Releases the frame acquired with @ref acquireFrame.
+       @details Must be called after the draw calls that sample the
+                frame texture.
+     **/
+    void releaseFrame();
+
+    /**
+       @brief Returns the frame pacer of the rendering loop.
+     **/
+    std::shared_ptr<FramePacer> framePacer() const;
+
+    /**
+       @brief Returns the resolution governor of the rendering loop.
+     **/
+    std::shared_ptr<ResolutionGovernor> resolutionGovernor() const;
+
+    /**
+       @brief   Returns the shader compiler.
+       @details The compiler context shares objects with the thread
+                and UI contexts so the UI can compile its shaders
+                with it as well.
+     **/
+    std::shared_ptr<ShaderCompiler> shaderCompiler() const;
+
+    /**
+       @brief   Returns the upload queue.
+       @details The thread polls the queue before each frame is
+                rendered, so the uploaded meshes and textures can be
+                used by the rendering of the thread.
      **/
-    void lock();
+    std::shared_ptr<UploadQueue> uploadQueue() const;
 
     /**
-       @brief Unlocks the rendering thread mutex.
+       @brief Returns the timing statistics.
      **/
-    void unlock();
+    Stats stats() const;
 
     /**
-       @brief Returns the framebuffer texture ID.
+       @brief   Reports the time the UI thread spent to present a
+                frame.
+       @details The times are included into @ref stats.
+       @param   cpu The CPU time in milliseconds.
+       @param   gpu The GPU time in milliseconds.
      **/
-    GLuint framebufferTexture() const;
+    void reportPresentTime(double cpu, double gpu);
 
 protected:
     void run();
@@ -6,9 +6,20 @@
 
 #include "opengl_shader.h"
 #include "opengl.h"
+#include "opengl_capabilities.h"
+#include "opengl_program_cache.h"
+#include "opengl_state_cache.h"
+#include <algorithm>
+#include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <string>
+#include <vector>
+
+// Both parallel shader compile extensions use the same value.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 namespace kuu
 {
@@ -48,18 +59,61 @@ bool isShaderCompiled(GLuint shaderId)
 }
 
 /* ---------------------------------------------------------------- *
-   Returns uniform location or -1 if the uniform was not found.
+   Returns the uniform type of the OpenGL type. Returns false if the
+   type is not supported.
  * ---------------------------------------------------------------- */
-int uniformLocation(
-    GLuint pgm,
-    const std::string& uniform)
-{
-    int uniformLocation = glGetUniformLocation(pgm, uniform.c_str());
-    if (uniformLocation == -1)
-        std::cerr << "Failed to find "
-                  << uniform << " location."
-                  << std::endl;
-    return uniformLocation;
+bool uniformType(GLenum glType, Shader::UniformType& type)
+{
+    switch (glType)
+    {
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+            type = Shader::UniformType::Int;   return true;
+        case GL_FLOAT:
+            type = Shader::UniformType::Float; return true;
+        case GL_FLOAT_VEC2:
+            type = Shader::UniformType::Vec2;  return true;
+        case GL_FLOAT_VEC3:
+            type = Shader::UniformType::Vec3;  return true;
+        case GL_FLOAT_VEC4:
+            type = Shader::UniformType::Vec4;  return true;
+        case GL_FLOAT_MAT3:
+            type = Shader::UniformType::Mat3;  return true;
+        case GL_FLOAT_MAT4:
+            type = Shader::UniformType::Mat4;  return true;
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   An active uniform of the program.
+ * ---------------------------------------------------------------- */
+struct UniformInfo
+{
+    std::string name;
+    GLint location = -1;
+    Shader::UniformType type = Shader::UniformType::Int;
+    // Count of array elements, 1 if not an array.
+    int size = 1;
+    // Previously written value, empty if not written.
+    std::vector<unsigned char> value;
+};
+
+/* ---------------------------------------------------------------- *
+   Returns true if the driver compiles the shaders in the background
+   and the completion status can be queried without blocking.
+ * ---------------------------------------------------------------- */
+bool isParallelCompileSupported()
+{
+    // The driver is the same for every context of the process.
+    static const bool supported =
+        hasExtension("GL_KHR_parallel_shader_compile") ||
+        hasExtension("GL_ARB_parallel_shader_compile");
+    return supported;
 }
 
 } // anonymous namespace
@@ -77,21 +131,10 @@ struct Shader::Data
     ~Data()
     { destroyData(); }
 
-    // Creates the shader data.
+    // Creates the shader data. The shaders are created only if the
+    // program is compiled from the sources.
     void createData()
     {
-        vsh = glCreateShader(GL_VERTEX_SHADER);
-        if (vsh == 0)
-            std::cerr << "Failed to create vertex shader"
-                      << std::endl;
-
-        fsh = glCreateShader(GL_FRAGMENT_SHADER);
-        if (fsh == 0)
-        {
-            std::cerr << "Failed to create fragment shader"
-                      << std::endl;
-        }
-
         pgm = glCreateProgram();
         if (pgm == 0)
             std::cerr << "Failed to create shader program"
@@ -101,14 +144,158 @@ struct Shader::Data
     // Destroys the shader data. OpenGL resources are freed.
     void destroyData()
     {
-        glDeleteShader(vsh);
-        glDeleteShader(fsh);
-        glDeleteProgram(pgm);
+        deleteShaders();
+        StateCache::current().deleteProgram(pgm);
+    }
+
+    // Compiles the shader source and attaches the shader into the
+    // program. The compile status is not queried so that the driver
+    // can compile the shader in the background. Returns the shader
+    // name.
+    GLuint compileShader(GLenum type,
+                         const std::string& source,
+                         const std::string& typeName)
+    {
+        GLuint shader = glCreateShader(type);
+        if (shader == 0)
+        {
+            std::cerr << "Failed to create " << typeName << " shader"
+                      << std::endl;
+            return 0;
+        }
+
+        const char* sourcePtr = source.c_str();
+        glShaderSource(shader, 1, &sourcePtr, 0);
+        glCompileShader(shader);
+        glAttachShader(pgm, shader);
+        return shader;
     }
 
-    GLuint vsh = 0; // vertex shader name
-    GLuint fsh = 0; // fragment shader name
+    // Starts to compile and link the program from the sources.
+    void compileAndLink()
+    {
+        vsh = compileShader(GL_VERTEX_SHADER,   vshSource, "vertex");
+        fsh = compileShader(GL_FRAGMENT_SHADER, fshSource, "fragment");
+
+        // Allow the binary to be read for the program cache.
+        if (ProgramCache::isSupported())
+            glProgramParameteri(pgm,
+                                GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE);
+        glLinkProgram(pgm);
+    }
+
+    // Prints the compile errors of the shader.
+    void printCompileErrors(GLuint shader, const std::string& typeName)
+    {
+        if (shader == 0 || isShaderCompiled(shader))
+            return;
+        std::cerr << "Failed to compile " << typeName << " shader"
+                  << std::endl;
+        std::cerr << shaderInfoLog(shader) << std::endl;
+    }
+
+    // Detaches and deletes the shaders, they are not needed after
+    // the program is linked.
+    void deleteShaders()
+    {
+        if (vsh)
+        {
+            glDetachShader(pgm, vsh);
+            glDeleteShader(vsh);
+            vsh = 0;
+        }
+        if (fsh)
+        {
+            glDetachShader(pgm, fsh);
+            glDeleteShader(fsh);
+            fsh = 0;
+        }
+    }
+
+    // Enumerates the active uniforms of the linked program.
+    void reflectUniforms()
+    {
+        uniforms.clear();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(pgm, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(pgm, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum glType = 0;
+            glGetActiveUniform(pgm, GLuint(i), GLsizei(name.size()),
+                               &length, &size, &glType, name.data());
+
+            UniformInfo u;
+            if (!uniformType(glType, u.type))
+                continue;
+            u.name.assign(name.data(), length);
+            u.location = glGetUniformLocation(pgm, u.name.c_str());
+            u.size = size;
+
+            // Uniform blocks members do not have a location.
+            if (u.location == -1)
+                continue;
+
+            // Array uniforms are reported with [0] suffix.
+            const std::string suffix = "[0]";
+            if (u.name.size() > suffix.size() &&
+                u.name.compare(u.name.size() - suffix.size(),
+                               suffix.size(), suffix) == 0)
+            {
+                u.name.resize(u.name.size() - suffix.size());
+            }
+
+            uniforms.push_back(u);
+        }
+    }
+
+    // Stores the value of the uniform. Returns false if the uniform
+    // is not valid or if it already has the value.
+    bool changed(int index, const void* data, size_t size)
+    {
+        if (index < 0 || index >= int(uniforms.size()))
+            return false;
+
+        std::vector<unsigned char>& value = uniforms[index].value;
+        if (value.size() == size &&
+            std::memcmp(value.data(), data, size) == 0)
+        {
+            return false;
+        }
+
+        const unsigned char* bytes =
+            static_cast<const unsigned char*>(data);
+        value.assign(bytes, bytes + size);
+        return true;
+    }
+
+    // Returns the location of the uniform.
+    GLint location(int index) const
+    { return uniforms[index].location; }
+
+    GLuint vsh = 0; // vertex shader name while linking
+    GLuint fsh = 0; // fragment shader name while linking
     GLuint pgm = 0; // shader program name
+
+    // Program cache key and true if the program was loaded from the
+    // cache.
+    std::string cacheKey;
+    bool cached = false;
+    // True if the program is linked successfully.
+    bool linked = false;
+
+    std::string vshSource; // vertex shader source
+    std::string fshSource; // fragment shader source
+
+    // Active uniforms of the linked program.
+    std::vector<UniformInfo> uniforms;
 };
 
 /* ---------------------------------------------------------------- */
@@ -121,73 +308,144 @@ Shader::Shader()
 
 void Shader::setVertexShader(const std::string& vertexShader)
 {
-    const char* vshPtr = vertexShader.c_str();
-    glShaderSource(d->vsh, 1, &vshPtr, 0);
-    glCompileShader(d->vsh);
-    if (!isShaderCompiled(d->vsh))
-    {
-        std::cerr << "Failed to compile vertex shader" << std::endl;
-        std::cerr << shaderInfoLog(d->vsh) << std::endl;
-    }
-    glAttachShader(d->pgm, d->vsh);
+    d->vshSource = vertexShader;
 }
 
 /* ---------------------------------------------------------------- */
 
 void Shader::setFragmentShader(const std::string& fragmentShader)
 {
-    const char* fshPtr = fragmentShader.c_str();
-    glShaderSource(d->fsh, 1, &fshPtr, 0);
-    glCompileShader(d->fsh);
-    if (!isShaderCompiled(d->fsh))
+    d->fshSource = fragmentShader;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::link()
+{
+    beginLink();
+    endLink();
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::beginLink()
+{
+    // Load the program from the cache or compile it from sources.
+    d->cacheKey = ProgramCache::key({ d->vshSource, d->fshSource });
+    d->cached = ProgramCache::load(d->pgm, d->cacheKey);
+    if (!d->cached)
+        d->compileAndLink();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Shader::isLinkComplete() const
+{
+    if (d->cached || !isParallelCompileSupported())
+        return true;
+
+    GLint complete = GL_TRUE;
+    glGetProgramiv(d->pgm, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Shader::endLink()
+{
+    if (d->cached)
     {
-        std::cerr << "Failed to compile fragment shader" << std::endl;
-        std::cerr << shaderInfoLog(d->fsh) << std::endl;
+        d->linked = true;
     }
-    glAttachShader(d->pgm, d->fsh);
+    else
+    {
+        int status = 0;
+        glGetProgramiv(d->pgm, GL_LINK_STATUS, &status);
+        d->linked = status == GL_TRUE;
+        if (d->linked)
+        {
+            ProgramCache::store(d->pgm, d->cacheKey);
+        }
+        else
+        {
+            d->printCompileErrors(d->vsh, "vertex");
+            d->printCompileErrors(d->fsh, "fragment");
+            std::cerr << "Failed to link shader program" << std::endl;
+        }
+        d->deleteShaders();
+    }
+
+    d->reflectUniforms();
+    return d->linked;
 }
 
 /* ---------------------------------------------------------------- */
 
-void Shader::link()
+bool Shader::isLinked() const
+{ return d->linked; }
+
+/* ---------------------------------------------------------------- */
+
+int Shader::uniformIndex(const std::string& name,
+                         UniformType type) const
 {
-    glLinkProgram(d->pgm);
+    for (size_t i = 0; i < d->uniforms.size(); ++i)
+    {
+        const UniformInfo& u = d->uniforms[i];
+        if (u.name != name)
+            continue;
 
-    int status = 0;
-    glGetProgramiv(d->pgm, GL_LINK_STATUS, &status);
-    if (status != GL_TRUE)
-        std::cerr << "Failed to link shader program" << std::endl;
+        if (u.type != type)
+        {
+            std::cerr << "Uniform " << name << " type does not "
+                      << "match the handle type." << std::endl;
+            return -1;
+        }
+        return int(i);
+    }
 
-    glDetachShader(d->pgm, d->vsh);
-    glDetachShader(d->pgm, d->fsh);
+    std::cerr << "Failed to find " << name << " uniform."
+              << std::endl;
+    return -1;
 }
 
 /* ---------------------------------------------------------------- */
 
 void Shader::bind()
 {
-    glUseProgram(d->pgm);
+    StateCache::current().useProgram(d->pgm);
 
-    glValidateProgram(d->pgm);
-    GLint status = 0;
-    glGetProgramiv(d->pgm, GL_VALIDATE_STATUS, &status);
-    if (status != GL_TRUE)
-        std::cerr << "Shader program is not valid" << std::endl;
+    // Validation queries the program state synchronously so it is
+    // done only with the debug layer.
+    if (StateCache::isDebugEnabled())
+    {
+        glValidateProgram(d->pgm);
+        GLint status = 0;
+        glGetProgramiv(d->pgm, GL_VALIDATE_STATUS, &status);
+        if (status != GL_TRUE)
+            std::cerr << "Shader program is not valid" << std::endl;
+    }
 }
 
 /* ---------------------------------------------------------------- */
 
 void Shader::release()
 {
-    glUseProgram(0);
+    StateCache::current().useProgram(0);
 }
 
 /* ---------------------------------------------------------------- */
 
 void Shader::setUniform(const std::string& name, int i)
 {
-    int location = uniformLocation(d->pgm, name);
-    glUniform1i(location, i);
+    setUniform(uniform<int>(name), i);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(const std::string& name, const glm::vec2& v)
+{
+    setUniform(uniform<glm::vec2>(name), v);
 }
 
 /* ---------------------------------------------------------------- */
@@ -195,9 +453,81 @@ void Shader::setUniform(const std::string& name, int i)
 void Shader::setUniform(const std::string& name,
                         const glm::mat4& matrix)
 {
-    int location = uniformLocation(d->pgm, name);
-    glUniformMatrix4fv(location, 1, GL_FALSE,
-                       glm::value_ptr(matrix));
+    setUniform(uniform<glm::mat4>(name), matrix);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<int> u, int i)
+{
+    if (d->changed(u.index, &i, sizeof(i)))
+        glUniform1i(d->location(u.index), i);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<float> u, float f)
+{
+    if (d->changed(u.index, &f, sizeof(f)))
+        glUniform1f(d->location(u.index), f);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<glm::vec2> u, const glm::vec2& v)
+{
+    if (d->changed(u.index, glm::value_ptr(v), sizeof(v)))
+        glUniform2fv(d->location(u.index), 1, glm::value_ptr(v));
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<glm::vec3> u, const glm::vec3& v)
+{
+    if (d->changed(u.index, glm::value_ptr(v), sizeof(v)))
+        glUniform3fv(d->location(u.index), 1, glm::value_ptr(v));
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<glm::vec4> u, const glm::vec4& v)
+{
+    if (d->changed(u.index, glm::value_ptr(v), sizeof(v)))
+        glUniform4fv(d->location(u.index), 1, glm::value_ptr(v));
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<glm::mat3> u, const glm::mat3& m)
+{
+    if (d->changed(u.index, glm::value_ptr(m), sizeof(m)))
+        glUniformMatrix3fv(d->location(u.index), 1, GL_FALSE,
+                           glm::value_ptr(m));
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<glm::mat4> u, const glm::mat4& m)
+{
+    if (d->changed(u.index, glm::value_ptr(m), sizeof(m)))
+        glUniformMatrix4fv(d->location(u.index), 1, GL_FALSE,
+                           glm::value_ptr(m));
+}
+
+/* ---------------------------------------------------------------- */
+
+void Shader::setUniform(Uniform<float> u, const float* values,
+                        int count)
+{
+    if (!u.isValid())
+        return;
+
+    count = std::min(count, d->uniforms[u.index].size);
+    if (count <= 0)
+        return;
+
+    if (d->changed(u.index, values, count * sizeof(float)))
+        glUniform1fv(d->location(u.index), count, values);
 }
 
 } // namespace opengl
@@ -6,7 +6,11 @@
 
 #pragma once
 
+#include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <memory>
 #include <string>
 
@@ -53,10 +57,61 @@ namespace opengl
     shader->release();
 
     @endcode
+
+    The active uniforms of the program are enumerated when the shader
+    is linked. A uniform can be set by name or, without a name lookup,
+    with a typed handle:
+
+    @code
+    Shader::Uniform<glm::mat4> cameraMatrix =
+        shader->uniform<glm::mat4>("cameraMatrix");
+    ...
+    shader->bind();
+    shader->setUniform(cameraMatrix, matrix);
+    @endcode
+
+    The shader remembers the uniform values and skips the writes that
+    would not change the value.
  **/
 class Shader
 {
 public:
+    /**
+        Type of a uniform value. Samplers and booleans are integer
+        uniforms.
+     **/
+    enum class UniformType
+    {
+        Int,
+        Float,
+        Vec2,
+        Vec3,
+        Vec4,
+        Mat3,
+        Mat4
+    };
+
+    /**
+        Maps a C++ type to its uniform type.
+     **/
+    template<typename T> struct UniformTraits;
+
+    /**
+        A handle of an active uniform. The handle is valid only for
+        the shader it was returned from.
+     **/
+    template<typename T>
+    struct Uniform
+    {
+        // Index of the uniform in the uniform table, -1 if the
+        // uniform is not active.
+        int index = -1;
+
+        // Returns true if the handle refers to an active uniform.
+        bool isValid() const
+        { return index >= 0; }
+    };
+
     /**
         Constructs the shader.
 
@@ -80,10 +135,60 @@ public:
     /**
         Links the shader.
 
-        This will link the vertex and fragment shader into program.
+        This will compile the vertex and fragment shader and link them
+        into program. If the program binary of the same sources is
+        found from the @ref ProgramCache then the binary is loaded
+        instead and the sources are not compiled.
      **/
     void link();
 
+    /**
+        @brief   Starts to link the shader.
+        @details The sources are compiled and linked without waiting
+                 for the result so that a driver that supports @c
+                 GL_KHR_parallel_shader_compile can compile them in
+                 the background. The link is finished with @ref
+                 endLink.
+     **/
+    void beginLink();
+
+    /**
+        Returns true if the link started with @ref beginLink is
+        complete so that @ref endLink does not block. Always true if
+        the driver does not compile in the background.
+     **/
+    bool isLinkComplete() const;
+
+    /**
+        @brief   Finishes the link started with @ref beginLink.
+        @details The errors are printed, the program binary is stored
+                 into the program cache and the uniforms are
+                 enumerated.
+        @return  True if the program was linked.
+     **/
+    bool endLink();
+
+    /**
+        Returns true if the program has been linked successfully.
+     **/
+    bool isLinked() const;
+
+    /**
+        @brief   Returns the handle of an active uniform.
+        @details An error is printed if the uniform is not active or
+                 if its type does not match the handle type.
+        @param   name The uniform name. The array uniforms are named
+                      without the [0] suffix.
+        @return  The handle, invalid if the uniform was not found.
+     **/
+    template<typename T>
+    Uniform<T> uniform(const std::string& name) const
+    {
+        Uniform<T> u;
+        u.index = uniformIndex(name, UniformTraits<T>::type);
+        return u;
+    }
+
     /**
         Binds the shader into OpenGL context.
      **/
@@ -101,6 +206,13 @@ public:
      **/
     void setUniform(const std::string& name, int i);
 
+    /**
+        Sets a 2D vector uniform.
+        @param name Uniform name.
+        @param v    Vector value.
+     **/
+    void setUniform(const std::string& name, const glm::vec2& v);
+
     /**
         Sets a 4x4 matrix uniform.
         @param name   Uniform name.
@@ -108,10 +220,48 @@ public:
      */
     void setUniform(const std::string& name, const glm::mat4& matrix);
 
+    /**
+        Sets the uniform with the handle. The shader must be bound.
+        Nothing is written if the value has not changed.
+     **/
+    void setUniform(Uniform<int>       u, int i);
+    void setUniform(Uniform<float>     u, float f);
+    void setUniform(Uniform<glm::vec2> u, const glm::vec2& v);
+    void setUniform(Uniform<glm::vec3> u, const glm::vec3& v);
+    void setUniform(Uniform<glm::vec4> u, const glm::vec4& v);
+    void setUniform(Uniform<glm::mat3> u, const glm::mat3& m);
+    void setUniform(Uniform<glm::mat4> u, const glm::mat4& m);
+
+    /**
+        Sets the elements of a float array uniform starting from the
+        first element. The shader must be bound.
+        @param u      The uniform handle.
+        @param values The values.
+        @param count  The count of values.
+     **/
+    void setUniform(Uniform<float> u, const float* values, int count);
+
 private:
+    int uniformIndex(const std::string& name, UniformType type) const;
+
     struct Data;
     std::shared_ptr<Data> d;
 };
 
+template<> struct Shader::UniformTraits<int>
+{ static const UniformType type = UniformType::Int; };
+template<> struct Shader::UniformTraits<float>
+{ static const UniformType type = UniformType::Float; };
+template<> struct Shader::UniformTraits<glm::vec2>
+{ static const UniformType type = UniformType::Vec2; };
+template<> struct Shader::UniformTraits<glm::vec3>
+{ static const UniformType type = UniformType::Vec3; };
+template<> struct Shader::UniformTraits<glm::vec4>
+{ static const UniformType type = UniformType::Vec4; };
+template<> struct Shader::UniformTraits<glm::mat3>
+{ static const UniformType type = UniformType::Mat3; };
+template<> struct Shader::UniformTraits<glm::mat4>
+{ static const UniformType type = UniformType::Mat4; };
+
 } // namespace opengl
 } // namespace kuu
@@ -0,0 +1,543 @@
+/**
+    @file   opengl_shader_compiler.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::ShaderCompiler class.
+ **/
+
+#include "opengl_shader_compiler.h"
+#include "opengl.h"
+#include "opengl_capabilities.h"
+#include "opengl_shader.h"
+#include "opengl_state_cache.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   The shaders and fences of the dropped handles. A handle can be
+   destroyed on a thread that has no context current, so its objects
+   are deleted later by the compiler thread.
+ * ---------------------------------------------------------------- */
+struct Orphans
+{
+    // Deletes the fences and the shaders that are not used elsewhere.
+    // The compiler context must be current.
+    void release()
+    {
+        std::vector<std::shared_ptr<Shader>> s;
+        std::vector<GLsync> f;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s.swap(shaders);
+            f.swap(fences);
+            dropped = false;
+        }
+
+        for (GLsync fence : f)
+            glDeleteSync(fence);
+        s.clear();
+    }
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Shader>> shaders;
+    std::vector<GLsync> fences;
+    // Wakes up the compiler thread, guarded by mutex. Empty after
+    // the compiler has stopped.
+    std::function<void()> wakeUp;
+    // True if objects were added since the previous release.
+    std::atomic<bool> dropped { false };
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the shader handle. The worker publishes the compiled
+   shader with a fence as pending and the consumer takes it into use
+   when the fence is signaled.
+ * ---------------------------------------------------------------- */
+struct ShaderHandle::Data
+{
+    // Hands the shaders and the fence over to the compiler thread,
+    // the last handle can be dropped on any thread.
+    ~Data()
+    {
+        if (!orphans)
+            return;
+        std::lock_guard<std::mutex> lock(orphans->mutex);
+        if (!orphans->wakeUp)
+        {
+            // The compiler has stopped, the objects are deleted on
+            // this thread.
+            if (pendingFence)
+                glDeleteSync(pendingFence);
+            return;
+        }
+
+        if (pendingFence)
+            orphans->fences.push_back(pendingFence);
+        if (pending)
+            orphans->shaders.push_back(pending);
+        if (current)
+            orphans->shaders.push_back(current);
+        orphans->dropped = true;
+        if (orphans->wakeUp)
+            orphans->wakeUp();
+    }
+
+    std::mutex mutex;
+    // Compiled shader and its fence, guarded by mutex.
+    std::shared_ptr<Shader> pending;
+    GLsync pendingFence = 0;
+    // True if the first compile failed, guarded by mutex.
+    bool failed = false;
+    // Shader used by the consumer, guarded by mutex.
+    std::shared_ptr<Shader> current;
+    uint64_t generation = 0;
+
+    // Deletes the objects of the dropped handles.
+    std::shared_ptr<Orphans> orphans;
+};
+
+/* ---------------------------------------------------------------- */
+
+ShaderHandle::ShaderHandle()
+{}
+
+/* ---------------------------------------------------------------- */
+
+bool ShaderHandle::isValid() const
+{ return bool(d); }
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<Shader> ShaderHandle::shader()
+{
+    if (!d)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->pending)
+    {
+        const GLenum result =
+            glClientWaitSync(d->pendingFence, 0, 0);
+        if (result == GL_ALREADY_SIGNALED ||
+            result == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(d->pendingFence);
+            d->pendingFence = 0;
+            d->current = d->pending;
+            d->pending.reset();
+            d->generation++;
+        }
+    }
+    return d->current;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool ShaderHandle::isFailed() const
+{
+    if (!d)
+        return false;
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->failed;
+}
+
+/* ---------------------------------------------------------------- */
+
+uint64_t ShaderHandle::generation() const
+{
+    if (!d)
+        return 0;
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->generation;
+}
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/* ---------------------------------------------------------------- *
+   A compile job of the worker.
+ * ---------------------------------------------------------------- */
+struct Job
+{
+    std::shared_ptr<ShaderHandle::Data> handle;
+    std::string vshSource;
+    std::string fshSource;
+
+    // Source files and their modification times if the job is
+    // compiled from files.
+    QString vshPath;
+    QString fshPath;
+    qint64 vshModified = -1;
+    qint64 fshModified = -1;
+
+    // Shader that is being linked.
+    std::shared_ptr<Shader> shader;
+};
+
+/* ---------------------------------------------------------------- *
+   Returns the modification time of the file.
+ * ---------------------------------------------------------------- */
+qint64 modified(const QString& path)
+{
+    return QFileInfo(path).lastModified().toMSecsSinceEpoch();
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the file into the string.
+ * ---------------------------------------------------------------- */
+bool readFile(const QString& path, std::string& contents)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        std::cerr << "Failed to open shader file "
+                  << path.toStdString() << std::endl;
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    contents.assign(data.constData(), data.size());
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the shader files of the job if they have changed since the
+   previous read. Returns true if the sources were read.
+ * ---------------------------------------------------------------- */
+bool reloadFiles(Job& job)
+{
+    const qint64 vshModified = modified(job.vshPath);
+    const qint64 fshModified = modified(job.fshPath);
+    if (vshModified == job.vshModified &&
+        fshModified == job.fshModified)
+    {
+        return false;
+    }
+
+    job.vshModified = vshModified;
+    job.fshModified = fshModified;
+    return readFile(job.vshPath, job.vshSource) &&
+           readFile(job.fshPath, job.fshSource);
+}
+
+/* ---------------------------------------------------------------- *
+   Lets the driver use as many threads as it wants for the parallel
+   shader compiles.
+ * ---------------------------------------------------------------- */
+void setMaxShaderCompilerThreads()
+{
+    typedef void (APIENTRY *MaxShaderCompilerThreads)(GLuint);
+
+    const char* function = nullptr;
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+        function = "glMaxShaderCompilerThreadsKHR";
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+        function = "glMaxShaderCompilerThreadsARB";
+    if (!function)
+        return;
+
+    MaxShaderCompilerThreads maxShaderCompilerThreads =
+        reinterpret_cast<MaxShaderCompilerThreads>(
+            QOpenGLContext::currentContext()->getProcAddress(function));
+    if (maxShaderCompilerThreads)
+        maxShaderCompilerThreads(0xFFFFFFFF);
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the shader compiler.
+ * ---------------------------------------------------------------- */
+struct ShaderCompiler::Data
+{
+    // Starts to link the shader of the job.
+    void begin(std::shared_ptr<Job> job)
+    {
+        // A reload is started after the current link.
+        if (job->shader)
+            return;
+
+        job->shader = std::make_shared<Shader>();
+        job->shader->setVertexShader(job->vshSource);
+        job->shader->setFragmentShader(job->fshSource);
+        job->shader->beginLink();
+        linking.push_back(job);
+    }
+
+    // Finishes the link and publishes the shader.
+    void finish(Job& job)
+    {
+        KUU_TRACE_SCOPE("ShaderCompiler::finish");
+
+        std::shared_ptr<Shader> shader = job.shader;
+        job.shader.reset();
+        const bool linked = shader->endLink();
+
+        ShaderHandle::Data& handle = *job.handle;
+        if (!linked)
+        {
+            std::lock_guard<std::mutex> lock(handle.mutex);
+            if (!handle.current && !handle.pending)
+                handle.failed = true;
+            return;
+        }
+
+        // The consumer takes the shader into use after the fence is
+        // signaled. The flush makes sure that the fence is signaled
+        // without further commands from this context.
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(handle.mutex);
+        if (handle.pending)
+            glDeleteSync(handle.pendingFence);
+        handle.pending = shader;
+        handle.pendingFence = fence;
+        handle.failed = false;
+    }
+
+    // OpenGL context of the worker.
+    std::shared_ptr<QOpenGLContext> context;
+    // Offscreen surface of the worker.
+    std::shared_ptr<QOffscreenSurface> surface;
+
+    // Guards the exit flag and the queue.
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool exiting = false;
+    std::vector<std::shared_ptr<Job>> queue;
+
+    // Jobs compiled from files and the jobs being linked, accessed
+    // only by the worker.
+    std::vector<std::shared_ptr<Job>> watched;
+    std::vector<std::shared_ptr<Job>> linking;
+
+    // Objects of the dropped handles.
+    std::shared_ptr<Orphans> orphans = std::make_shared<Orphans>();
+};
+
+/* ---------------------------------------------------------------- */
+
+ShaderCompiler::ShaderCompiler(QOpenGLContext* shareContext)
+    : d(std::make_shared<Data>())
+{
+    d->context = std::make_shared<QOpenGLContext>();
+    d->context->setShareContext(shareContext);
+    d->context->setFormat(shareContext->format());
+    d->context->create();
+    d->context->moveToThread(this);
+
+    d->surface = std::make_shared<QOffscreenSurface>();
+    d->surface->setFormat(d->context->format());
+    d->surface->create();
+    d->surface->moveToThread(this);
+
+    // The orphans are locked before the compiler mutex, the compiler
+    // never locks them the other way around.
+    Data* data = d.get();
+    d->orphans->wakeUp = [data]()
+    {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->condition.notify_one();
+    };
+
+    start();
+}
+
+/* ---------------------------------------------------------------- */
+
+ShaderCompiler::~ShaderCompiler()
+{
+    stop();
+    wait();
+
+    // The handles that outlive the compiler delete their objects
+    // themselves.
+    std::lock_guard<std::mutex> lock(d->orphans->mutex);
+    d->orphans->wakeUp = nullptr;
+}
+
+/* ---------------------------------------------------------------- */
+
+ShaderHandle ShaderCompiler::compile(const std::string& vertexShader,
+                                     const std::string& fragmentShader)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->handle    = std::make_shared<ShaderHandle::Data>();
+    job->handle->orphans = d->orphans;
+    job->vshSource = vertexShader;
+    job->fshSource = fragmentShader;
+
+    ShaderHandle handle;
+    handle.d = job->handle;
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->queue.push_back(job);
+    d->condition.notify_one();
+    return handle;
+}
+
+/* ---------------------------------------------------------------- */
+
+ShaderHandle ShaderCompiler::compileFiles(
+        const QString& vertexShaderPath,
+        const QString& fragmentShaderPath)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->handle  = std::make_shared<ShaderHandle::Data>();
+    job->handle->orphans = d->orphans;
+    job->vshPath = vertexShaderPath;
+    job->fshPath = fragmentShaderPath;
+
+    ShaderHandle handle;
+    handle.d = job->handle;
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->queue.push_back(job);
+    d->condition.notify_one();
+    return handle;
+}
+
+/* ---------------------------------------------------------------- */
+
+void ShaderCompiler::stop()
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->exiting = true;
+    d->condition.notify_one();
+}
+
+/* ---------------------------------------------------------------- */
+
+void ShaderCompiler::run()
+{
+    Trace::setThreadName("Shader compiler thread");
+
+    d->context->makeCurrent(d->surface.get());
+
+#ifdef _WIN32
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
+    {
+        std::cerr << "Failed to initialize GLEW." << std::endl;
+        d->context->doneCurrent();
+        return;
+    }
+#endif
+
+    StateCache::current().invalidate();
+    setMaxShaderCompilerThreads();
+
+    // The watched files are checked at this interval.
+    const Clock::duration watchInterval = std::chrono::milliseconds(250);
+    // The background links are polled at this interval.
+    const Clock::duration linkInterval = std::chrono::milliseconds(1);
+
+    Clock::time_point nextWatchTime = Clock::now();
+    for (;;)
+    {
+        // Wait for new jobs. Wake up to poll the links in progress
+        // and the watched files.
+        std::vector<std::shared_ptr<Job>> jobs;
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            auto ready = [this]()
+            {
+                return d->exiting || !d->queue.empty() ||
+                       d->orphans->dropped.load();
+            };
+
+            if (!d->linking.empty())
+                d->condition.wait_for(lock, linkInterval, ready);
+            else if (!d->watched.empty())
+                d->condition.wait_until(lock, nextWatchTime, ready);
+            else
+                d->condition.wait(lock, ready);
+
+            if (d->exiting)
+                break;
+            jobs.swap(d->queue);
+        }
+
+        // Delete the objects of the handles dropped meanwhile.
+        d->orphans->release();
+
+        // Start the new jobs.
+        for (std::shared_ptr<Job> job : jobs)
+        {
+            if (job->vshPath.isEmpty())
+            {
+                d->begin(job);
+                continue;
+            }
+
+            d->watched.push_back(job);
+            if (reloadFiles(*job))
+            {
+                d->begin(job);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(job->handle->mutex);
+                job->handle->failed = true;
+            }
+        }
+
+        // Compile again the shaders whose files have changed.
+        if (Clock::now() >= nextWatchTime)
+        {
+            for (std::shared_ptr<Job> job : d->watched)
+                if (!job->shader && reloadFiles(*job))
+                    d->begin(job);
+            nextWatchTime = Clock::now() + watchInterval;
+        }
+
+        // Finish the links that are complete.
+        for (size_t i = 0; i < d->linking.size();)
+        {
+            if (d->linking[i]->shader->isLinkComplete())
+            {
+                d->finish(*d->linking[i]);
+                d->linking.erase(d->linking.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    // Free the OpenGL resources in this thread.
+    d->linking.clear();
+    d->watched.clear();
+    d->orphans->release();
+    d->context->doneCurrent();
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,150 @@
+/**
+    @file   opengl_shader_compiler.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::ShaderCompiler class.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+class QOpenGLContext;
+
+namespace kuu
+{
+namespace opengl
+{
+
+class Shader;
+
+/**
+    @brief   A handle of a shader compiled by @ref ShaderCompiler.
+
+    @details The handle is like a future: the shader is available
+             from @ref shader once it has been compiled and linked.
+             Until then the caller should render with a fallback. A
+             shader compiled from files is compiled again when the
+             files change and @ref shader starts to return the new
+             shader. The @ref generation tells when the shader has
+             changed, e.g. to look up the uniform handles again.
+
+             The handle must be used from a single thread whose
+             context shares objects with the compiler context. The
+             handle can be destroyed on any thread: the shaders and
+             the fence of the last handle are handed over to the
+             compiler thread, which deletes them. A handle that
+             outlives the compiler must be destroyed with a context
+             current that shares objects with the compiler context.
+ **/
+class ShaderHandle
+{
+public:
+    /**
+        Constructs an empty handle.
+     **/
+    ShaderHandle();
+
+    /**
+        Returns true if the handle refers to a compile job.
+     **/
+    bool isValid() const;
+
+    /**
+        @brief   Returns the newest compiled shader.
+        @details Never blocks. A compiled shader is returned only
+                 after the GPU has finished the compilation commands
+                 of the compiler context. The context of the caller
+                 must be current.
+        @return  The shader or nullptr if the shader is not yet
+                 available.
+     **/
+    std::shared_ptr<Shader> shader();
+
+    /**
+        Returns true if the first compile failed. A failed reload
+        keeps the previous shader.
+     **/
+    bool isFailed() const;
+
+    /**
+        Returns the count of shaders that @ref shader has returned,
+        0 if none.
+     **/
+    uint64_t generation() const;
+
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+/**
+    @brief   Compiles shaders asynchronously on a worker thread.
+
+    @details The worker has its own OpenGL context that shares objects
+             with the given context so the rendering threads never
+             wait for the shader compiler. If the driver supports @c
+             GL_KHR_parallel_shader_compile then the worker starts all
+             the pending compiles and the driver compiles them in
+             parallel in the background.
+
+             The compiled programs are also stored into the @ref
+             ProgramCache.
+
+    @code
+    ShaderHandle handle = compiler->compile(vshSource, fshSource);
+    ...
+    std::shared_ptr<Shader> shader = handle.shader();
+    if (shader)
+    {
+        shader->bind();
+        ...
+    }
+    @endcode
+ **/
+class ShaderCompiler : public QThread
+{
+public:
+    /**
+        @brief Constructs the compiler and starts the worker thread.
+        @param shareContext The context that the compiler context
+                            shares objects with.
+     **/
+    explicit ShaderCompiler(QOpenGLContext* shareContext);
+
+    /**
+        Stops the worker thread.
+     **/
+    ~ShaderCompiler();
+
+    /**
+        Compiles the shader from the sources.
+     **/
+    ShaderHandle compile(const std::string& vertexShader,
+                         const std::string& fragmentShader);
+
+    /**
+        @brief   Compiles the shader from the source files.
+        @details The files are watched and the shader is compiled
+                 again when a file changes.
+     **/
+    ShaderHandle compileFiles(const QString& vertexShaderPath,
+                              const QString& fragmentShaderPath);
+
+    /**
+        Stops the worker thread. The pending compiles are discarded.
+     **/
+    void stop();
+
+protected:
+    void run();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,196 @@
+/**
+    @file   opengl_state_cache.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::StateCache class.
+ **/
+
+#include "opengl_state_cache.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <QtGui/QOpenGLContext>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Debug layer: reports if the cached binding does not match the
+   binding of the context.
+ * ---------------------------------------------------------------- */
+void checkCached(const char* name, GLenum binding, GLint cached)
+{
+    GLint actual = 0;
+    glGetIntegerv(binding, &actual);
+    if (cached != -1 && cached != actual)
+        std::cerr << "Stale " << name << " binding in state cache: "
+                  << "cached " << cached << ", actual " << actual
+                  << std::endl;
+}
+
+/* ---------------------------------------------------------------- *
+   Debug layer: reports the OpenGL errors of the bind call.
+ * ---------------------------------------------------------------- */
+void checkError(const char* function, GLuint name)
+{
+    for (GLenum error = glGetError();
+         error != GL_NO_ERROR;
+         error = glGetError())
+    {
+        std::cerr << function << "(" << name << ") failed with "
+                  << "error 0x" << std::hex << error << std::dec
+                  << std::endl;
+    }
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+StateCache::StateCache()
+    : context_(nullptr)
+{ invalidate(); }
+
+/* ---------------------------------------------------------------- */
+
+StateCache& StateCache::current()
+{
+    static thread_local StateCache cache;
+
+    // The bindings of the previous context do not tell anything
+    // about the bindings of this one.
+    const void* context = QOpenGLContext::currentContext();
+    if (cache.context_ != context)
+    {
+        cache.context_ = context;
+        cache.invalidate();
+    }
+    return cache;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool StateCache::isDebugEnabled()
+{
+#ifdef KUU_GL_DEBUG
+    return true;
+#else
+    static const bool enabled = []()
+    {
+        const char* value = std::getenv("KUU_GL_DEBUG");
+        return value && std::strcmp(value, "1") == 0;
+    }();
+    return enabled;
+#endif
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::invalidate()
+{
+    vertexArray_ = -1;
+    arrayBuffer_ = -1;
+    program_     = -1;
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::bindVertexArray(GLuint vao)
+{
+    const bool debug = isDebugEnabled();
+    if (debug)
+        checkCached("vertex array", GL_VERTEX_ARRAY_BINDING,
+                    vertexArray_);
+
+    if (vertexArray_ == GLint(vao))
+        return;
+
+    glBindVertexArray(vao);
+    vertexArray_ = vao;
+
+    if (debug)
+        checkError("glBindVertexArray", vao);
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    if (target != GL_ARRAY_BUFFER)
+    {
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    const bool debug = isDebugEnabled();
+    if (debug)
+        checkCached("array buffer", GL_ARRAY_BUFFER_BINDING,
+                    arrayBuffer_);
+
+    if (arrayBuffer_ == GLint(buffer))
+        return;
+
+    glBindBuffer(target, buffer);
+    arrayBuffer_ = buffer;
+
+    if (debug)
+        checkError("glBindBuffer", buffer);
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::useProgram(GLuint program)
+{
+    const bool debug = isDebugEnabled();
+    if (debug)
+        checkCached("program", GL_CURRENT_PROGRAM, program_);
+
+    if (program_ == GLint(program))
+        return;
+
+    glUseProgram(program);
+    program_ = program;
+
+    if (debug)
+        checkError("glUseProgram", program);
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::deleteVertexArray(GLuint vao)
+{
+    // Deleting a bound object reverts the binding to zero.
+    glDeleteVertexArrays(1, &vao);
+    if (vertexArray_ == GLint(vao))
+        vertexArray_ = 0;
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::deleteBuffer(GLuint buffer)
+{
+    glDeleteBuffers(1, &buffer);
+    if (arrayBuffer_ == GLint(buffer))
+        arrayBuffer_ = 0;
+}
+
+/* ---------------------------------------------------------------- */
+
+void StateCache::deleteProgram(GLuint program)
+{
+    // A program that is in use is deleted only after it is no longer
+    // used, the name stays in use until then.
+    glDeleteProgram(program);
+    if (program_ == GLint(program))
+    {
+        glUseProgram(0);
+        program_ = 0;
+    }
+}
+
+} // namespace opengl
+} // namespace kuu
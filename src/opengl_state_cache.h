@@ -0,0 +1,119 @@
+/**
+    @file   opengl_state_cache.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::StateCache class.
+ **/
+
+#pragma once
+
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   A cache of the OpenGL object bindings of the current
+             context.
+
+    @details The cache remembers the bound vertex array, array buffer
+             and shader program and skips the bind calls that would
+             not change the binding. There is a cache per thread, not
+             per context: it describes the context that is current on
+             the thread. When @ref current sees that another context
+             has been made current on the thread since the previous
+             call, the cache is invalidated.
+
+             The cache does not see the state changes made outside of
+             it, e.g. by Qt or by QPainter. Call @ref invalidate
+             before rendering in a callback like @c paintGL where Qt
+             might have changed the state, and after making a new
+             context current since a new context can get the address
+             of a destroyed one.
+
+             Objects that might be bound must be deleted through the
+             cache so that a new object with the same name is bound
+             again.
+
+             The debug layer is enabled by defining @c KUU_GL_DEBUG
+             when compiling or by setting the environment variable
+             @c KUU_GL_DEBUG to 1. With the debug layer the cache
+             queries the actual bindings, reports stale cache entries
+             and OpenGL errors and the shader programs are validated
+             when bound. The queries stall the pipeline so the layer
+             is meant only for debugging.
+
+    @code
+    StateCache& cache = StateCache::current();
+    cache.invalidate();
+    cache.bindVertexArray(vao);
+    cache.useProgram(program);
+    @endcode
+ **/
+class StateCache
+{
+public:
+    /**
+        Returns the cache of the calling thread. The cache is
+        invalidated if the current context of the thread has changed.
+     **/
+    static StateCache& current();
+
+    /**
+        Returns true if the debug layer is enabled.
+     **/
+    static bool isDebugEnabled();
+
+    /**
+        Forgets the cached bindings. The next bind calls are passed
+        to OpenGL.
+     **/
+    void invalidate();
+
+    /**
+        Binds the vertex array object.
+     **/
+    void bindVertexArray(GLuint vao);
+
+    /**
+        @brief   Binds the buffer object.
+        @details Only the @c GL_ARRAY_BUFFER binding is cached. The
+                 element array buffer binding is a part of the vertex
+                 array state so it is always passed to OpenGL.
+     **/
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    /**
+        Uses the shader program.
+     **/
+    void useProgram(GLuint program);
+
+    /**
+        Deletes the vertex array object and forgets its binding.
+     **/
+    void deleteVertexArray(GLuint vao);
+
+    /**
+        Deletes the buffer object and forgets its binding.
+     **/
+    void deleteBuffer(GLuint buffer);
+
+    /**
+        Deletes the shader program and forgets its binding.
+     **/
+    void deleteProgram(GLuint program);
+
+private:
+    StateCache();
+
+    // Context that was current when the cache was used last.
+    const void* context_;
+    // Cached object names, -1 if unknown.
+    GLint vertexArray_;
+    GLint arrayBuffer_;
+    GLint program_;
+};
+
+} // namespace opengl
+} // namespace kuu
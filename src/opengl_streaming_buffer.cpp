@@ -0,0 +1,279 @@
+/**
+    @file   opengl_streaming_buffer.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::StreamingBuffer class.
+ **/
+
+#include "opengl_streaming_buffer.h"
+#include "opengl_capabilities.h"
+#include "opengl_state_cache.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+// Count of regions in the ring.
+const int RegionCount = 3;
+// Allocations are aligned to this many bytes.
+const int Alignment = 64;
+// Minimum byte size of a region.
+const int MinRegionSize = 64 * 1024;
+// Timeout of a single fence wait in nanoseconds.
+const GLuint64 WaitTimeout = 1000000000;
+
+/* ---------------------------------------------------------------- *
+   Returns the size rounded up to the alignment.
+ * ---------------------------------------------------------------- */
+int align(int size)
+{
+    return (size + Alignment - 1) / Alignment * Alignment;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the buffer storage can be mapped persistently.
+ * ---------------------------------------------------------------- */
+bool isPersistentMappingSupported()
+{
+#ifdef GL_MAP_PERSISTENT_BIT
+    return hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage");
+#else
+    return false;
+#endif
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the streaming buffer.
+ * ---------------------------------------------------------------- */
+struct StreamingBuffer::Data
+{
+    // Constructs the streaming buffer data.
+    Data(int regionSize)
+        : persistent(isPersistentMappingSupported())
+    {
+        for (GLsync& fence : fences)
+            fence = 0;
+        if (regionSize > 0)
+            allocate(align(regionSize));
+    }
+
+    // Destroys the streaming buffer data. OpenGL resources are freed.
+    ~Data()
+    { destroy(); }
+
+    // Allocates the buffer with the given region size. The previous
+    // buffer is destroyed.
+    void allocate(int size)
+    {
+        destroy();
+        regionSize = size;
+        region     = 0;
+        used       = 0;
+
+        glGenBuffers(1, &buffer);
+        if (buffer == 0)
+            std::cerr << "Failed to generate streaming buffer"
+                      << std::endl;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        const GLsizeiptr bufferSize =
+            GLsizeiptr(regionSize) * RegionCount;
+
+#ifdef GL_MAP_PERSISTENT_BIT
+        if (persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT      |
+                                     GL_MAP_PERSISTENT_BIT |
+                                     GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, bufferSize,
+                            nullptr, flags);
+            mapping = static_cast<char*>(
+                glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+                                 bufferSize, flags));
+            if (mapping)
+                return;
+
+            // The storage is immutable so a mutable buffer is
+            // allocated instead.
+            std::cerr << "Failed to map streaming buffer "
+                      << "persistently" << std::endl;
+            persistent = false;
+            allocate(size);
+            return;
+        }
+#endif
+        glBufferData(GL_COPY_WRITE_BUFFER, bufferSize, nullptr,
+                     GL_STREAM_DRAW);
+    }
+
+    // Destroys the buffer and the fences.
+    void destroy()
+    {
+        deleteFences();
+        if (buffer)
+        {
+            // Deleting the buffer unmaps it.
+            StateCache::current().deleteBuffer(buffer);
+            buffer  = 0;
+            mapping = nullptr;
+        }
+    }
+
+    // Deletes the fences of the regions.
+    void deleteFences()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    // Gives a new storage for the buffer. The commands that read the
+    // previous storage are not affected.
+    void orphan()
+    {
+        deleteFences();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER,
+                     GLsizeiptr(regionSize) * RegionCount,
+                     nullptr, GL_STREAM_DRAW);
+    }
+
+    // Makes sure that the GPU is not reading the current region.
+    void acquireRegion()
+    {
+        GLsync& fence = fences[region];
+        if (!fence)
+            return;
+
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            if (!persistent)
+            {
+                orphan();
+                return;
+            }
+
+            KUU_TRACE_SCOPE("StreamingBuffer::wait");
+            do
+            {
+                result = glClientWaitSync(fence,
+                                          GL_SYNC_FLUSH_COMMANDS_BIT,
+                                          WaitTimeout);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+
+        if (result == GL_WAIT_FAILED)
+            std::cerr << "Failed to wait streaming buffer region"
+                      << std::endl;
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // Copies the data into the buffer.
+    void copy(int offset, const void* data, int byteSize)
+    {
+        if (byteSize <= 0)
+            return;
+
+        if (mapping)
+        {
+            std::memcpy(mapping + offset, data, byteSize);
+            return;
+        }
+
+        // The region is not read by the GPU so the driver does not
+        // need to synchronize nor to preserve the previous contents.
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER,
+                                     offset, byteSize,
+                                     GL_MAP_WRITE_BIT            |
+                                     GL_MAP_UNSYNCHRONIZED_BIT   |
+                                     GL_MAP_INVALIDATE_RANGE_BIT);
+        if (!ptr)
+        {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, byteSize,
+                            data);
+            return;
+        }
+
+        std::memcpy(ptr, data, byteSize);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+
+    bool persistent = false;  // true if mapped persistently
+    GLuint buffer = 0;        // buffer object name
+    char* mapping = nullptr;  // persistent mapping of the buffer
+    int regionSize = 0;       // byte size of a region
+    int region = 0;           // index of the current region
+    int used = 0;             // bytes used from the current region
+    GLsync fences[RegionCount];
+};
+
+/* ---------------------------------------------------------------- */
+
+StreamingBuffer::StreamingBuffer(int regionSize)
+    : d(std::make_shared<Data>(regionSize))
+{}
+
+/* ---------------------------------------------------------------- */
+
+int StreamingBuffer::write(const void* data, int byteSize)
+{
+    const int size = align(byteSize);
+    if (d->buffer == 0 || size > d->regionSize - d->used)
+        d->allocate(std::max(std::max(size, d->regionSize * 2),
+                             MinRegionSize));
+
+    if (d->used == 0)
+        d->acquireRegion();
+
+    const int offset = d->region * d->regionSize + d->used;
+    d->used += size;
+    d->copy(offset, data, byteSize);
+    return offset;
+}
+
+/* ---------------------------------------------------------------- */
+
+void StreamingBuffer::fence()
+{
+    if (d->used == 0)
+        return;
+
+    d->fences[d->region] =
+        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    d->region = (d->region + 1) % RegionCount;
+    d->used   = 0;
+}
+
+/* ---------------------------------------------------------------- */
+
+GLuint StreamingBuffer::buffer() const
+{ return d->buffer; }
+
+/* ---------------------------------------------------------------- */
+
+int StreamingBuffer::regionSize() const
+{ return d->regionSize; }
+
+/* ---------------------------------------------------------------- */
+
+bool StreamingBuffer::isPersistent() const
+{ return d->persistent; }
+
+} // namespace opengl
+} // namespace kuu
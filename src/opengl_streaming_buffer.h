@@ -0,0 +1,105 @@
+/**
+    @file   opengl_streaming_buffer.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::StreamingBuffer class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   A buffer object for data that is written on every frame.
+
+    @details The buffer is split into three regions that are used as a
+             ring. The data of a frame is sub-allocated from the
+             current region and @ref fence ends the frame: a fence is
+             inserted after the commands that read the region and the
+             ring moves to the next region. The region is written
+             again only after its fence is signaled, so the writes
+             never wait for the draws of the previous frames and the
+             draws never see a partially written region.
+
+             If the context supports @c GL_ARB_buffer_storage then the
+             buffer is mapped persistently once and the data is copied
+             straight into the mapping. Otherwise each write maps the
+             range with @c GL_MAP_UNSYNCHRONIZED_BIT and @c
+             GL_MAP_INVALIDATE_RANGE_BIT. Without the persistent
+             mapping a region that is still in use is not waited for,
+             the buffer is orphaned instead and the driver gives it a
+             new storage.
+
+             If the data does not fit into the current region then the
+             buffer is re-allocated with larger regions. The
+             allocations made since the last fence become invalid, so
+             the regions should be large enough for the data of a
+             frame. The buffer object name might change when the
+             buffer is re-allocated.
+
+             The buffer is written through the @c GL_COPY_WRITE_BUFFER
+             target so the other buffer bindings are not changed.
+
+    @code
+    StreamingBuffer buffer;
+    ...
+    const int offset = buffer.write(vertices.data(), byteSize);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.buffer());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
+                          (const GLvoid*) size_t(offset));
+    glDrawArrays(GL_TRIANGLES, 0, count);
+    buffer.fence();
+    @endcode
+ **/
+class StreamingBuffer
+{
+public:
+    /**
+        @brief Constructs the streaming buffer.
+        @note  OpenGL context must be valid.
+        @param regionSize The initial byte size of a region, the
+                          buffer is allocated on the first write if 0.
+     **/
+    explicit StreamingBuffer(int regionSize = 0);
+
+    /**
+        @brief   Writes the data into the current region.
+        @param   data     The data to write.
+        @param   byteSize The size of data in bytes.
+        @return  The byte offset of the data in the buffer.
+     **/
+    int write(const void* data, int byteSize);
+
+    /**
+        Ends the use of the current region. Call after the commands
+        that read the data written since the previous fence.
+     **/
+    void fence();
+
+    /**
+        Returns the buffer object name, 0 before the first write.
+     **/
+    GLuint buffer() const;
+
+    /**
+        Returns the byte size of a region.
+     **/
+    int regionSize() const;
+
+    /**
+        Returns true if the buffer is mapped persistently.
+     **/
+    bool isPersistent() const;
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
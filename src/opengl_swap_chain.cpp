@@ -0,0 +1,357 @@
+/**
+    @file   opengl_swap_chain.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::SwapChain class.
+ **/
+
+#include "opengl_swap_chain.h"
+#include "opengl_framebuffer_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <QtGui/QOpenGLFramebufferObject>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   The state of a swap chain slot. The state is only changed with
+   atomic compare-and-swap so that the producer and the consumer
+   agree who owns the slot.
+ * ---------------------------------------------------------------- */
+enum SlotState
+{
+    SlotFree,       // producer may take the slot
+    SlotRendering,  // producer is rendering into slot
+    SlotReady,      // slot contains the newest frame
+    SlotDisplaying  // consumer is displaying the slot
+};
+
+/* ---------------------------------------------------------------- *
+   Deletes the fence if it exists.
+ * ---------------------------------------------------------------- */
+void deleteFence(GLsync& fence)
+{
+    if (fence)
+        glDeleteSync(fence);
+    fence = 0;
+}
+
+/* ---------------------------------------------------------------- *
+   A slot of the swap chain.
+ * ---------------------------------------------------------------- */
+struct Slot
+{
+    std::atomic<int> state { SlotFree };
+    // Framebuffer, owned by the producer context.
+    std::shared_ptr<QOpenGLFramebufferObject> fbo;
+    // Fence inserted by the producer after rendering.
+    GLsync renderFence = 0;
+    // Fence inserted by the consumer after sampling.
+    GLsync readFence = 0;
+    // Framebuffer texture, frame size and texture size, readable
+    // by the consumer.
+    GLuint texture = 0;
+    QSize size;
+    QSize textureSize;
+    // Running number of the frame in slot.
+    uint64_t number = 0;
+    // Damage of the frame in slot.
+    std::vector<QRect> damage;
+    // Producer: true if the framebuffer holds a frame of the slot
+    // size.
+    bool valid = false;
+};
+
+/* ---------------------------------------------------------------- *
+   The damage of a published frame.
+ * ---------------------------------------------------------------- */
+struct FrameDamage
+{
+    uint64_t number;
+    std::vector<QRect> rects;
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the swap chain.
+ * ---------------------------------------------------------------- */
+struct SwapChain::Data
+{
+    Data(const QSize& size, int slotCount)
+        : size(size)
+        , capacity(size)
+        , slotCount(std::max(slotCount, 3))
+        , chain(new Slot[this->slotCount])
+        , pool(64, this->slotCount + 1)
+    {}
+
+    // Size of the frames.
+    QSize size;
+    // Size that the framebuffers are allocated for.
+    QSize capacity;
+    // Count of slots.
+    int slotCount;
+    // Slots.
+    std::unique_ptr<Slot[]> chain;
+    // Index of the newest published slot or -1.
+    std::atomic<int> latest { -1 };
+    // Producer: pool of framebuffers.
+    FramebufferPool pool;
+
+    // Producer: the slot that is being rendered or -1.
+    int rendering = -1;
+    // Producer: running number of frames.
+    uint64_t frameNumber = 0;
+    // Producer: damage of the newest frames, enough to bring the
+    // oldest slot up to date.
+    std::deque<FrameDamage> history;
+
+    // Consumer: the slot that is being displayed or -1.
+    int displaying = -1;
+};
+
+/* ---------------------------------------------------------------- */
+
+SwapChain::SwapChain(const QSize& size, int slotCount)
+    : d(std::make_shared<Data>(size, slotCount))
+{}
+
+/* ---------------------------------------------------------------- */
+
+int SwapChain::slotCount() const
+{ return d->slotCount; }
+
+/* ---------------------------------------------------------------- */
+
+void SwapChain::setSize(const QSize& size)
+{ setSize(size, size); }
+
+/* ---------------------------------------------------------------- */
+
+void SwapChain::setSize(const QSize& size, const QSize& capacity)
+{
+    d->size = size;
+    d->capacity = QSize(std::max(size.width(),  capacity.width()),
+                        std::max(size.height(), capacity.height()));
+}
+
+/* ---------------------------------------------------------------- */
+
+QSize SwapChain::size() const
+{ return d->size; }
+
+/* ---------------------------------------------------------------- */
+
+QOpenGLFramebufferObject* SwapChain::beginFrame()
+{
+    // Take a free slot. There is always at least one as the consumer
+    // can hold only one slot and only one slot can be ready.
+    d->rendering = -1;
+    for (int i = 0; i < d->slotCount && d->rendering == -1; ++i)
+    {
+        int expected = SlotFree;
+        if (d->chain[i].state.compare_exchange_strong(
+                expected, SlotRendering,
+                std::memory_order_acq_rel))
+        {
+            d->rendering = i;
+        }
+    }
+
+    if (d->rendering == -1)
+    {
+        std::cerr << "Swap chain has no free slots" << std::endl;
+        return nullptr;
+    }
+
+    Slot& slot = d->chain[d->rendering];
+
+    // Wait on GPU until the consumer has sampled the slot.
+    if (slot.readFence)
+    {
+        glWaitSync(slot.readFence, 0, GL_TIMEOUT_IGNORED);
+        deleteFence(slot.readFence);
+    }
+
+    // Replace the framebuffer if the capacity has moved into
+    // another bucket.
+    if (!slot.fbo || slot.fbo->size() != d->pool.bucket(d->capacity))
+    {
+        d->pool.release(slot.fbo);
+        slot.fbo = d->pool.acquire(d->capacity);
+        slot.texture     = slot.fbo->texture();
+        slot.textureSize = slot.fbo->size();
+        slot.valid       = false;
+    }
+    if (slot.size != d->size)
+        slot.valid = false;
+    slot.size = d->size;
+
+    return slot.fbo.get();
+}
+
+/* ---------------------------------------------------------------- */
+
+uint64_t SwapChain::endFrame()
+{
+    if (d->rendering == -1)
+        return 0;
+    const QRect frame(QPoint(0, 0), d->chain[d->rendering].size);
+    return endFrame(std::vector<QRect>(1, frame));
+}
+
+/* ---------------------------------------------------------------- */
+
+uint64_t SwapChain::endFrame(const std::vector<QRect>& damage)
+{
+    if (d->rendering == -1)
+        return 0;
+
+    Slot& slot = d->chain[d->rendering];
+    slot.number = ++d->frameNumber;
+    slot.damage = damage;
+    slot.valid  = true;
+
+    // Keep the damage of as many frames as a slot can be behind.
+    d->history.push_back({ slot.number, damage });
+    while (int(d->history.size()) > d->slotCount)
+        d->history.pop_front();
+
+    // Fence the frame and flush so that the fence is visible to
+    // the consumer context.
+    deleteFence(slot.renderFence);
+    slot.renderFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    // Publish the slot as the newest frame.
+    slot.state.store(SlotReady, std::memory_order_release);
+    const int previous = d->latest.exchange(
+        d->rendering, std::memory_order_acq_rel);
+
+    // Give the previous frame back if the consumer did not take it.
+    if (previous != -1)
+    {
+        int expected = SlotReady;
+        d->chain[previous].state.compare_exchange_strong(
+            expected, SlotFree,
+            std::memory_order_acq_rel);
+    }
+
+    d->rendering = -1;
+    return slot.number;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool SwapChain::accumulatedDamage(std::vector<QRect>& rects) const
+{
+    if (d->rendering == -1)
+        return false;
+
+    const Slot& slot = d->chain[d->rendering];
+    if (!slot.valid || slot.number == 0)
+        return false;
+
+    // The frames after the frame in slot must all be in the history.
+    const uint64_t first = slot.number + 1;
+    if (first > d->frameNumber)
+        return true;
+    if (d->history.empty() || d->history.front().number > first)
+        return false;
+
+    for (const FrameDamage& frame : d->history)
+        if (frame.number >= first)
+            rects.insert(rects.end(), frame.rects.begin(),
+                         frame.rects.end());
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+SwapChain::Frame SwapChain::acquire()
+{
+    for (;;)
+    {
+        const int latest = d->latest.load(std::memory_order_acquire);
+        if (latest == -1 || latest == d->displaying)
+            break;
+
+        // Take the newest slot. This fails if the producer has
+        // already replaced the slot with an even newer one.
+        int expected = SlotReady;
+        if (!d->chain[latest].state.compare_exchange_strong(
+                expected, SlotDisplaying,
+                std::memory_order_acq_rel))
+        {
+            continue;
+        }
+
+        // Give the previously displayed slot back to producer.
+        if (d->displaying != -1)
+            d->chain[d->displaying].state.store(
+                SlotFree, std::memory_order_release);
+        d->displaying = latest;
+
+        // Wait on GPU until the producer has rendered the frame.
+        glWaitSync(d->chain[latest].renderFence, 0,
+                   GL_TIMEOUT_IGNORED);
+        break;
+    }
+
+    Frame frame;
+    if (d->displaying == -1)
+        return frame;
+
+    const Slot& slot = d->chain[d->displaying];
+    frame.texture = slot.texture;
+    frame.size        = slot.size;
+    frame.textureSize = slot.textureSize;
+    frame.number      = slot.number;
+    frame.damage      = slot.damage;
+    return frame;
+}
+
+/* ---------------------------------------------------------------- */
+
+void SwapChain::release()
+{
+    if (d->displaying == -1)
+        return;
+
+    Slot& slot = d->chain[d->displaying];
+    deleteFence(slot.readFence);
+    slot.readFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+/* ---------------------------------------------------------------- */
+
+void SwapChain::destroy()
+{
+    for (int i = 0; i < d->slotCount; ++i)
+    {
+        Slot& slot = d->chain[i];
+        deleteFence(slot.renderFence);
+        deleteFence(slot.readFence);
+        slot.fbo.reset();
+        slot.texture = 0;
+        slot.valid   = false;
+        slot.state.store(SlotFree);
+    }
+    d->pool.clear();
+    d->history.clear();
+    d->latest.store(-1);
+    d->rendering  = -1;
+    d->displaying = -1;
+}
+
+} // namespace opengl
+} // namespace kuu
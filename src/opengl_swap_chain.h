@@ -0,0 +1,226 @@
+/**
+    @file   opengl_swap_chain.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::SwapChain class.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include "opengl.h"
+
+class QOpenGLFramebufferObject;
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+   @brief   A lock-free swap chain of framebuffers.
+
+   @details The swap chain is shared between a producer (rendering
+            thread) and a consumer (UI thread) that both have their
+            own OpenGL context. The contexts must share objects.
+
+            The producer renders into the framebuffer returned by
+            @ref beginFrame and publishes it with @ref endFrame. The
+            consumer takes the newest published frame with @ref
+            acquire and tells that it has issued the draw calls that
+            sample the frame with @ref release. Neither side ever
+            waits for the other one on CPU: the newest frame is
+            exchanged through an atomic slot index.
+
+            Each slot has two fences. The producer fence is inserted
+            after the frame is rendered and the consumer waits for it
+            on GPU before it samples the frame. The consumer fence is
+            inserted after the frame is sampled and the producer waits
+            for it on GPU before it renders into the slot again.
+
+            The framebuffers are created lazily by the producer so the
+            swap chain can be constructed without a current context.
+            The @ref destroy function must be called by the producer
+            while its context is current.
+
+            The producer can change the frame size with @ref setSize
+            without restarting. Each slot gets a framebuffer of the
+            new size from a size-bucketed @ref FramebufferPool the
+            next time the producer renders into it. As the pooled
+            framebuffers can be larger than the frame, the producer
+            renders into the bottom-left corner and the consumer
+            samples only that area.
+
+            The framebuffers can be allocated for a capacity larger
+            than the frame size. A producer that changes the frame
+            size often, e.g. with a dynamic resolution, then renders
+            into a sub-rectangle of the same framebuffers and the
+            framebuffers are never replaced while the frame size
+            stays within the capacity.
+
+            The producer can render only the changed part of a frame.
+            It passes the damage of the frame to @ref endFrame. As
+            the framebuffer of a slot holds the frame that was
+            rendered into it a few frames ago, @ref accumulatedDamage
+            returns the damage of the frames published since then,
+            and the producer repaints the union of the two. The
+            consumer gets the damage of each frame with the frame, so
+            it can present only the changed part when it presented
+            the previous frame.
+
+   @code
+    // Rendering thread
+    QOpenGLFramebufferObject* fbo = swapChain->beginFrame();
+    fbo->bind();
+    ...
+    fbo->release();
+    swapChain->endFrame();
+
+    // UI thread
+    SwapChain::Frame frame = swapChain->acquire();
+    if (frame.texture)
+    {
+        ...
+        swapChain->release();
+    }
+   @endcode
+ **/
+class SwapChain
+{
+public:
+    /**
+       A frame that can be displayed by the consumer.
+     **/
+    struct Frame
+    {
+        // Framebuffer texture ID, 0 if no frame has been published.
+        GLuint texture = 0;
+        // Size of the frame in pixels.
+        QSize size;
+        // Size of the framebuffer texture in pixels. This can be
+        // larger than the frame size.
+        QSize textureSize;
+        // Running number of the frame, starting from 1.
+        uint64_t number = 0;
+        // Damage of the frame relative to the previous frame in
+        // framebuffer pixels with the origin at the bottom-left
+        // corner. Empty if the frame did not change.
+        std::vector<QRect> damage;
+    };
+
+    /**
+        @brief Constructs the swap chain.
+        @param size      The size of the framebuffers.
+        @param slotCount The count of framebuffers, at least 3.
+     **/
+    SwapChain(const QSize& size, int slotCount = 3);
+
+    /**
+        Returns the count of framebuffers in the swap chain.
+     **/
+    int slotCount() const;
+
+    /**
+        @brief   Sets the size of the frames (producer).
+        @details The size is used from the next @ref beginFrame call.
+     **/
+    void setSize(const QSize& size);
+
+    /**
+        @brief   Sets the size of the frames and the size that the
+                 framebuffers are allocated for (producer).
+        @details The size is used from the next @ref beginFrame call.
+                 The framebuffers are not replaced when only the size
+                 changes within the capacity.
+     **/
+    void setSize(const QSize& size, const QSize& capacity);
+
+    /**
+        Returns the size of the frames.
+     **/
+    QSize size() const;
+
+    /**
+        @brief   Begins a new frame (producer).
+        @details Takes a free slot and returns its framebuffer. The
+                 framebuffer is taken from the pool if the slot does
+                 not have one or if its size does not match the
+                 capacity. The producer context must be current.
+     **/
+    QOpenGLFramebufferObject* beginFrame();
+
+    /**
+        @brief   Ends the frame started with @ref beginFrame
+                 (producer).
+        @details Inserts the producer fence, flushes the pipeline
+                 and publishes the frame as the newest one. The whole
+                 frame is damaged.
+        @return  The running number of the frame or 0 if no frame
+                 was started.
+     **/
+    uint64_t endFrame();
+
+    /**
+        @brief   Ends the frame with the damage of the frame
+                 (producer).
+        @details As @ref endFrame, the damage is recorded for @ref
+                 accumulatedDamage and given to the consumer with the
+                 frame.
+        @param   damage The changed rectangles of the frame relative
+                        to the previous frame. Empty if the frame did
+                        not change.
+     **/
+    uint64_t endFrame(const std::vector<QRect>& damage);
+
+    /**
+        @brief   Returns the damage of the frames published after the
+                 frame in the framebuffer of the current slot
+                 (producer).
+        @details Called after @ref beginFrame. The framebuffer holds
+                 an older frame, the region that must be repainted is
+                 the damage of the current frame united with the
+                 returned damage.
+        @param   rects The rectangles are appended into this.
+        @return  False if the framebuffer does not hold a frame of
+                 the current size or the damage is no longer known,
+                 then the whole frame must be repainted.
+     **/
+    bool accumulatedDamage(std::vector<QRect>& rects) const;
+
+    /**
+        @brief   Acquires the newest published frame (consumer).
+        @details If a new frame has been published since the previous
+                 call then the consumer switches to it and the
+                 previously acquired frame is given back to producer.
+                 Otherwise the previous frame is returned again. The
+                 function never blocks. The consumer context must be
+                 current.
+        @return  The frame. The texture is 0 if no frame has been
+                 published yet.
+     **/
+    Frame acquire();
+
+    /**
+        @brief   Releases the acquired frame (consumer).
+        @details Inserts the consumer fence after the draw calls that
+                 sampled the frame. The consumer context must be
+                 current.
+     **/
+    void release();
+
+    /**
+        Destroys the framebuffers and fences. The producer context
+        must be current.
+     **/
+    void destroy();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
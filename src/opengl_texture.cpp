@@ -0,0 +1,200 @@
+/**
+    @file   opengl_texture.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::Texture class.
+ **/
+
+#include "opengl_texture.h"
+#include "opengl_streaming_buffer.h"
+#include <algorithm>
+#include <iostream>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Returns the count of levels in the full mipmap chain of the size.
+ * ---------------------------------------------------------------- */
+int mipmapLevels(const QSize& size)
+{
+    int levels = 1;
+    for (int s = std::max(size.width(), size.height()); s > 1; s /= 2)
+        levels++;
+    return levels;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the texture.
+ * ---------------------------------------------------------------- */
+struct Texture::Data
+{
+    // Creates the texture and allocates its levels. The level 0 is
+    // specified from the pixels if given.
+    Data(const QSize& size, bool mipmaps, const void* pixels)
+        : size(size)
+        , levels(mipmaps ? mipmapLevels(size) : 1)
+    {
+        glGenTextures(1, &texture);
+        if (texture == 0)
+            std::cerr << "Failed to generate texture" << std::endl;
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        QSize levelSize = size;
+        for (int level = 0; level < levels; ++level)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+                         levelSize.width(), levelSize.height(), 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE,
+                         level == 0 ? pixels : nullptr);
+            levelSize = QSize(std::max(levelSize.width()  / 2, 1),
+                              std::max(levelSize.height() / 2, 1));
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                        levels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                        GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                        GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                        GL_CLAMP_TO_EDGE);
+
+        mipmapsDirty = mipmaps && pixels;
+    }
+
+    // Destroys the texture.
+    ~Data()
+    {
+        glDeleteTextures(1, &texture);
+    }
+
+    // Writes the pixels into the rectangle through the unpack buffer.
+    void write(const QRect& rect, const void* pixels)
+    {
+        if (!QRect(QPoint(0, 0), size).contains(rect))
+        {
+            std::cerr << "Texture write outside of the texture"
+                      << std::endl;
+            return;
+        }
+
+        // The unpack buffer is created on the first write.
+        if (!unpackBuffer)
+            unpackBuffer = std::make_shared<StreamingBuffer>();
+
+        const int byteSize = rect.width() * rect.height() * 4;
+        const int offset = unpackBuffer->write(pixels, byteSize);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer->buffer());
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0,
+                        rect.x(), rect.y(),
+                        rect.width(), rect.height(),
+                        GL_RGBA, GL_UNSIGNED_BYTE,
+                        (const GLvoid*) size_t(offset));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        unpackPending = true;
+        mipmapsDirty  = levels > 1;
+    }
+
+    QSize size;
+    int levels = 1;
+    GLuint texture = 0; // texture object name
+
+    // Ring of pixel unpack buffer regions.
+    std::shared_ptr<StreamingBuffer> unpackBuffer;
+    // True if the unpack buffer has writes after the last fence.
+    bool unpackPending = false;
+    // True if the level 0 has been written after the mipmaps were
+    // generated.
+    bool mipmapsDirty = false;
+};
+
+/* ---------------------------------------------------------------- */
+
+Texture::Texture(const QSize& size, bool mipmaps)
+    : d(std::make_shared<Data>(size, mipmaps, nullptr))
+{}
+
+/* ---------------------------------------------------------------- */
+
+Texture::Texture(const QImage& image, bool mipmaps)
+    : d(std::make_shared<Data>(
+          image.size(), mipmaps,
+          image.convertToFormat(QImage::Format_RGBA8888).constBits()))
+{}
+
+/* ---------------------------------------------------------------- */
+
+QSize Texture::size() const
+{ return d->size; }
+
+/* ---------------------------------------------------------------- */
+
+bool Texture::hasMipmaps() const
+{ return d->levels > 1; }
+
+/* ---------------------------------------------------------------- */
+
+GLuint Texture::id() const
+{ return d->texture; }
+
+/* ---------------------------------------------------------------- */
+
+void Texture::write(const QImage& image, const QPoint& position)
+{
+    // The rows of a 32-bit image are tightly packed.
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    d->write(QRect(position, rgba.size()), rgba.constBits());
+}
+
+/* ---------------------------------------------------------------- */
+
+void Texture::write(const QRect& rect, const void* pixels)
+{
+    d->write(rect, pixels);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Texture::generateMipmaps()
+{
+    // The texture sub-image commands have read the unpack buffer
+    // region when the commands issued so far are complete.
+    if (d->unpackPending)
+    {
+        d->unpackBuffer->fence();
+        d->unpackPending = false;
+    }
+
+    if (!d->mipmapsDirty)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, d->texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    d->mipmapsDirty = false;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Texture::bind(int unit)
+{
+    generateMipmaps();
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, d->texture);
+}
+
+} // namespace opengl
+} // namespace kuu
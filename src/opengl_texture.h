@@ -0,0 +1,119 @@
+/**
+    @file   opengl_texture.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::Texture class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QPoint>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtGui/QImage>
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+
+/**
+    @brief   A two-dimensional RGBA texture.
+
+    @details The texture has 8-bit RGBA texels and optionally a full
+             mipmap chain. The first row of a written image is at the
+             texture coordinate t = 0, so the texture coordinates of
+             an image region are its pixel rectangle divided by the
+             texture size.
+
+             The writes go through a @ref StreamingBuffer that is
+             bound as the pixel unpack buffer: the pixels are copied
+             into a region of the buffer and @c glTexSubImage2D reads
+             them from there. The copy never waits for the draws that
+             sample the texture and the call returns without waiting
+             for the transfer. The regions are fenced when the texture
+             is bound, so the writes of a frame should fit into a
+             region.
+
+             The mipmaps are generated on demand when the texture is
+             bound after a write, so many writes between the draws
+             generate the mipmaps only once.
+
+             The constructor that takes an image specifies the texture
+             straight from the image. Use @ref UploadQueue to create
+             large textures without blocking the rendering thread.
+
+    @code
+    Texture texture(QSize(256, 256));
+    texture.write(image, QPoint(0, 0));
+    ...
+    texture.bind(0);
+    shader->setUniform(sampler, 0);
+    @endcode
+ **/
+class Texture
+{
+public:
+    /**
+        @brief Constructs the texture with undefined contents.
+        @note  OpenGL context must be valid.
+        @param size    The size of the texture.
+        @param mipmaps True if the texture has mipmaps.
+     **/
+    explicit Texture(const QSize& size, bool mipmaps = true);
+
+    /**
+        @brief Constructs the texture from the image.
+        @note  OpenGL context must be valid.
+        @param image   The image.
+        @param mipmaps True if the texture has mipmaps.
+     **/
+    explicit Texture(const QImage& image, bool mipmaps = true);
+
+    /**
+        Returns the size of the texture.
+     **/
+    QSize size() const;
+
+    /**
+        Returns true if the texture has mipmaps.
+     **/
+    bool hasMipmaps() const;
+
+    /**
+        Returns the texture object name.
+     **/
+    GLuint id() const;
+
+    /**
+        Writes the image into the texture at the position. The image
+        must fit into the texture.
+     **/
+    void write(const QImage& image, const QPoint& position = QPoint());
+
+    /**
+        Writes the pixels into the rectangle of the texture. The
+        pixels are tightly packed 8-bit RGBA.
+     **/
+    void write(const QRect& rect, const void* pixels);
+
+    /**
+        Generates the mipmaps if the texture has been written since
+        the mipmaps were generated. Called by @ref bind.
+     **/
+    void generateMipmaps();
+
+    /**
+        Binds the texture into the texture unit. The mipmaps are
+        generated if needed.
+     **/
+    void bind(int unit = 0);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,230 @@
+/**
+    @file   opengl_texture_atlas.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::TextureAtlas class.
+ **/
+
+#include "opengl_texture_atlas.h"
+#include "opengl_texture.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   A horizontal segment of the skyline.
+ * ---------------------------------------------------------------- */
+struct Segment
+{
+    int x;
+    int y;
+    int width;
+};
+
+/* ---------------------------------------------------------------- *
+   Returns the padded copy of the image. The padding repeats the
+   edge pixels of the image.
+ * ---------------------------------------------------------------- */
+QImage padded(const QImage& source, int padding)
+{
+    const QImage image = source.convertToFormat(QImage::Format_RGBA8888);
+    if (padding == 0)
+        return image;
+
+    const int w = image.width();
+    const int h = image.height();
+    QImage out(w + padding * 2, h + padding * 2,
+               QImage::Format_RGBA8888);
+    for (int y = 0; y < out.height(); ++y)
+    {
+        const int sy = std::min(std::max(y - padding, 0), h - 1);
+        const uint32_t* src =
+            reinterpret_cast<const uint32_t*>(image.constScanLine(sy));
+        uint32_t* dst = reinterpret_cast<uint32_t*>(out.scanLine(y));
+        for (int x = 0; x < out.width(); ++x)
+            dst[x] = src[std::min(std::max(x - padding, 0), w - 1)];
+    }
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns a transparent image. The atlas texture is specified from
+   it so that the unused areas are transparent.
+ * ---------------------------------------------------------------- */
+QImage transparent(const QSize& size)
+{
+    QImage image(size, QImage::Format_RGBA8888);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the texture atlas.
+ * ---------------------------------------------------------------- */
+struct TextureAtlas::Data
+{
+    Data(const QSize& size, int padding)
+        : size(size)
+        , padding(std::max(padding, 0))
+        , texture(std::make_shared<Texture>(transparent(size)))
+    {
+        clear();
+    }
+
+    // Resets the skyline to the bottom edge of the atlas.
+    void clear()
+    {
+        skyline.clear();
+        skyline.push_back({ 0, 0, size.width() });
+    }
+
+    // Returns the lowest y where a rectangle of the width fits
+    // starting at the segment or INT_MAX if it does not fit.
+    int fit(size_t index, int width) const
+    {
+        const int x = skyline[index].x;
+        if (x + width > size.width())
+            return INT_MAX;
+
+        int y = 0;
+        for (size_t i = index; i < skyline.size(); ++i)
+        {
+            if (skyline[i].x >= x + width)
+                break;
+            y = std::max(y, skyline[i].y);
+        }
+        return y;
+    }
+
+    // Places the rectangle at the start of the segment and updates
+    // the skyline.
+    void place(size_t index, const QRect& rect)
+    {
+        const Segment top = { rect.x(), rect.bottom() + 1, rect.width() };
+        skyline.insert(skyline.begin() + index, top);
+
+        // Shrink or remove the segments under the new segment.
+        const int right = top.x + top.width;
+        for (size_t i = index + 1; i < skyline.size();)
+        {
+            Segment& s = skyline[i];
+            if (s.x >= right)
+                break;
+            const int shrink = right - s.x;
+            if (shrink >= s.width)
+            {
+                skyline.erase(skyline.begin() + i);
+                continue;
+            }
+            s.x     += shrink;
+            s.width -= shrink;
+            break;
+        }
+
+        // Merge the neighbouring segments of the same height.
+        for (size_t i = 0; i + 1 < skyline.size();)
+        {
+            if (skyline[i].y == skyline[i + 1].y)
+            {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    QSize size;
+    int padding;
+    std::shared_ptr<Texture> texture;
+    // Top edge of the packed area from left to right.
+    std::vector<Segment> skyline;
+};
+
+/* ---------------------------------------------------------------- */
+
+TextureAtlas::TextureAtlas(const QSize& size, int padding)
+    : d(std::make_shared<Data>(size, padding))
+{}
+
+/* ---------------------------------------------------------------- */
+
+QRect TextureAtlas::add(const QImage& image)
+{
+    if (image.isNull())
+        return QRect();
+
+    const int w = image.width()  + d->padding * 2;
+    const int h = image.height() + d->padding * 2;
+
+    // Find the position where the top edge of the image is lowest,
+    // on ties prefer the position on the narrowest segment.
+    size_t best = d->skyline.size();
+    int bestTop = INT_MAX;
+    int bestWidth = INT_MAX;
+    int bestY = 0;
+    for (size_t i = 0; i < d->skyline.size(); ++i)
+    {
+        const int y = d->fit(i, w);
+        if (y == INT_MAX || y + h > d->size.height())
+            continue;
+
+        const int width = d->skyline[i].width;
+        if (y + h < bestTop || (y + h == bestTop && width < bestWidth))
+        {
+            best      = i;
+            bestTop   = y + h;
+            bestWidth = width;
+            bestY     = y;
+        }
+    }
+
+    if (best == d->skyline.size())
+        return QRect();
+
+    const QRect rect(d->skyline[best].x, bestY, w, h);
+    d->place(best, rect);
+    d->texture->write(padded(image, d->padding), rect.topLeft());
+
+    return rect.adjusted(d->padding,  d->padding,
+                        -d->padding, -d->padding);
+}
+
+/* ---------------------------------------------------------------- */
+
+glm::vec4 TextureAtlas::uvRect(const QRect& rect) const
+{
+    const float w = float(d->size.width());
+    const float h = float(d->size.height());
+    return glm::vec4(float(rect.left())                / w,
+                     float(rect.top())                 / h,
+                     float(rect.left() + rect.width()) / w,
+                     float(rect.top() + rect.height()) / h);
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<Texture> TextureAtlas::texture() const
+{
+    return d->texture;
+}
+
+/* ---------------------------------------------------------------- */
+
+void TextureAtlas::clear()
+{
+    d->clear();
+}
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,83 @@
+/**
+    @file   opengl_texture_atlas.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::TextureAtlas class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtGui/QImage>
+#include <glm/vec4.hpp>
+
+namespace kuu
+{
+namespace opengl
+{
+
+class Texture;
+
+/**
+    @brief   Packs images into a single texture.
+
+    @details Objects that sample images of the same atlas can be drawn
+             with a single texture binding and so in a single batch.
+             The images are packed with a skyline bottom-left packer:
+             the atlas keeps the top edge of the packed area as a list
+             of horizontal segments and places an image at the
+             position where its top edge stays the lowest.
+
+             The images are padded with their edge pixels so that the
+             bilinear filtering and the smaller mipmaps do not bleed
+             the neighbouring images in. Images are written through
+             the pixel unpack buffer of the texture, see @ref Texture.
+
+    @code
+    TextureAtlas atlas(QSize(1024, 1024));
+    const QRect rect = atlas.add(image);
+    if (!rect.isNull())
+        quad->setTexture(atlas.texture(), atlas.uvRect(rect));
+    @endcode
+ **/
+class TextureAtlas
+{
+public:
+    /**
+        @brief Constructs the atlas.
+        @note  OpenGL context must be valid.
+        @param size    The size of the atlas texture.
+        @param padding The count of padding pixels around an image.
+     **/
+    explicit TextureAtlas(const QSize& size, int padding = 1);
+
+    /**
+        Adds the image into the atlas. Returns the pixel rectangle of
+        the image or a null rectangle if the image does not fit.
+     **/
+    QRect add(const QImage& image);
+
+    /**
+        Returns the texture coordinates (u0, v0, u1, v1) of the pixel
+        rectangle.
+     **/
+    glm::vec4 uvRect(const QRect& rect) const;
+
+    /**
+        Returns the atlas texture.
+     **/
+    std::shared_ptr<Texture> texture() const;
+
+    /**
+        Removes all the images. The texture contents are left as is.
+     **/
+    void clear();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -0,0 +1,721 @@
+/**
+    @file   opengl_upload_queue.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::opengl::UploadQueue class.
+ **/
+
+#include "opengl_upload_queue.h"
+#include "opengl_mesh_file.h"
+#include "opengl_state_cache.h"
+#include "opengl_texture.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include <QtCore/QThread>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <glm/common.hpp>
+
+namespace kuu
+{
+namespace opengl
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   The objects of the uploads that were dropped before they were
+   polled. A handle can be destroyed on a thread that has no context
+   current, so its objects are deleted later by the polling thread
+   or a worker.
+ * ---------------------------------------------------------------- */
+struct Orphans
+{
+    // Deletes the objects. A context that shares the objects must be
+    // current.
+    void release()
+    {
+        std::vector<GLuint> b;
+        std::vector<std::shared_ptr<Texture>> t;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            b.swap(buffers);
+            t.swap(textures);
+        }
+
+        StateCache& cache = StateCache::current();
+        for (GLuint buffer : b)
+            cache.deleteBuffer(buffer);
+        t.clear();
+    }
+
+    std::mutex mutex;
+    std::vector<GLuint> buffers;
+    std::vector<std::shared_ptr<Texture>> textures;
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the upload handle. The worker writes the objects
+   before the upload is pushed into the completed list, after that
+   the data is accessed only by the polling thread.
+ * ---------------------------------------------------------------- */
+struct UploadHandle::Data
+{
+    enum State
+    {
+        Pending,
+        Complete,
+        Failed
+    };
+
+    // Hands the objects of an upload that was not polled over to the
+    // queue, they are deleted when a context is current.
+    ~Data()
+    {
+        if (!orphans)
+            return;
+        std::lock_guard<std::mutex> lock(orphans->mutex);
+        if (vertexBuffer)
+            orphans->buffers.push_back(vertexBuffer);
+        if (indexBuffer)
+            orphans->buffers.push_back(indexBuffer);
+        if (texture && state.load() != Complete)
+            orphans->textures.push_back(texture);
+    }
+
+    std::atomic<int> state { Pending };
+
+    // Buffers, vertex attributes and parts of a mesh upload.
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer  = 0;
+    int vertexCount     = 0;
+    int indexCount      = 0;
+    GLenum indexType    = GL_UNSIGNED_INT;
+    int vertexStride    = 0;
+    std::vector<MeshFile::Attribute> attributes;
+    std::vector<MeshFile::Part> fileParts;
+    // Bounding box of the positions.
+    bool hasBounds = false;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // The mesh copied into an arena by the polling thread.
+    std::shared_ptr<MeshArena> arena;
+    MeshHandle mesh;
+    std::vector<MeshHandle> parts;
+
+    // Texture of a texture upload.
+    std::shared_ptr<Texture> texture;
+
+    // Deletes the objects of the dropped uploads.
+    std::shared_ptr<Orphans> orphans;
+};
+
+/* ---------------------------------------------------------------- */
+
+UploadHandle::UploadHandle()
+{}
+
+/* ---------------------------------------------------------------- */
+
+bool UploadHandle::isValid() const
+{ return bool(d); }
+
+/* ---------------------------------------------------------------- */
+
+bool UploadHandle::isComplete() const
+{
+    return d && d->state.load(std::memory_order_acquire) ==
+                Data::Complete;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool UploadHandle::isFailed() const
+{
+    return d && d->state.load(std::memory_order_acquire) ==
+                Data::Failed;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<MeshArena> UploadHandle::arena() const
+{ return isComplete() ? d->arena : nullptr; }
+
+/* ---------------------------------------------------------------- */
+
+MeshHandle UploadHandle::mesh() const
+{ return isComplete() ? d->mesh : MeshHandle(); }
+
+/* ---------------------------------------------------------------- */
+
+std::vector<MeshHandle> UploadHandle::parts() const
+{ return isComplete() ? d->parts : std::vector<MeshHandle>(); }
+
+/* ---------------------------------------------------------------- */
+
+bool UploadHandle::bounds(glm::vec3& min, glm::vec3& max) const
+{
+    if (!isComplete() || !d->hasBounds)
+        return false;
+    min = d->boundsMin;
+    max = d->boundsMax;
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<Texture> UploadHandle::texture() const
+{ return isComplete() ? d->texture : nullptr; }
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   An upload job of the workers.
+ * ---------------------------------------------------------------- */
+struct Job
+{
+    enum Type
+    {
+        MeshFileJob,
+        ImageFileJob,
+        ImageJob
+    };
+
+    Type type;
+    QString path;
+    QImage image;
+    std::shared_ptr<UploadHandle::Data> handle;
+};
+
+/* ---------------------------------------------------------------- *
+   A written upload in the completed list. The list is a lock-free
+   stack: the workers push the uploads with compare-and-swap and the
+   polling thread takes the whole list with an exchange.
+ * ---------------------------------------------------------------- */
+struct Completed
+{
+    std::shared_ptr<UploadHandle::Data> handle;
+    GLsync fence = 0;
+    Completed* next = nullptr;
+};
+
+/* ---------------------------------------------------------------- *
+   A worker thread that runs the given function.
+ * ---------------------------------------------------------------- */
+class Worker : public QThread
+{
+public:
+    explicit Worker(const std::function<void()>& body)
+        : body_(body)
+    {}
+
+protected:
+    void run()
+    { body_(); }
+
+private:
+    std::function<void()> body_;
+};
+
+/* ---------------------------------------------------------------- *
+   Writes the mesh file into buffer objects. The buffers are written
+   through the copy target so that no vertex array is needed.
+ * ---------------------------------------------------------------- */
+bool uploadMeshFile(const QString& path, UploadHandle::Data& handle)
+{
+    MeshFile file;
+    if (!file.open(path))
+        return false;
+
+    const MeshFile::Content& c = file.content();
+    const int indexSize = c.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+
+    glGenBuffers(1, &handle.vertexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle.vertexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER,
+                 GLsizeiptr(c.vertexCount) * c.vertexStride,
+                 c.vertexData, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &handle.indexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, handle.indexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER,
+                 GLsizeiptr(c.indexCount) * indexSize,
+                 c.indexData, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    handle.vertexCount  = c.vertexCount;
+    handle.indexCount   = c.indexCount;
+    handle.indexType    = c.indexType;
+    handle.vertexStride = c.vertexStride;
+    handle.attributes   = c.attributes;
+    handle.fileParts    = c.parts;
+
+    // Find the bounds of the positions while the pages are mapped.
+    for (const MeshFile::Attribute& a : c.attributes)
+    {
+        if (a.location != 0 || a.type != GL_FLOAT || a.tupleSize != 3)
+            continue;
+
+        const float inf = std::numeric_limits<float>::max();
+        handle.boundsMin = glm::vec3( inf);
+        handle.boundsMax = glm::vec3(-inf);
+        const uint8_t* v =
+            static_cast<const uint8_t*>(c.vertexData) + a.offset;
+        for (int i = 0; i < c.vertexCount; ++i, v += c.vertexStride)
+        {
+            glm::vec3 p;
+            std::memcpy(&p, v, sizeof(p));
+            handle.boundsMin = glm::min(handle.boundsMin, p);
+            handle.boundsMax = glm::max(handle.boundsMax, p);
+        }
+        handle.hasBounds = c.vertexCount > 0;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the image into a texture and generates its mipmaps.
+ * ---------------------------------------------------------------- */
+bool uploadImage(const QImage& image, UploadHandle::Data& handle)
+{
+    if (image.isNull())
+        return false;
+
+    handle.texture = std::make_shared<Texture>(image);
+    handle.texture->generateMipmaps();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   A mesh arena of a vertex format and index type.
+ * ---------------------------------------------------------------- */
+struct FormatArena
+{
+    int vertexStride;
+    GLenum indexType;
+    std::vector<MeshFile::Attribute> attributes;
+    std::shared_ptr<MeshArena> arena;
+
+    // Returns true if the mesh upload has the format of the arena.
+    bool matches(const UploadHandle::Data& handle) const
+    {
+        if (handle.vertexStride != vertexStride ||
+            handle.indexType    != indexType    ||
+            handle.attributes.size() != attributes.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < attributes.size(); ++i)
+        {
+            const MeshFile::Attribute& a = attributes[i];
+            const MeshFile::Attribute& b = handle.attributes[i];
+            if (a.location   != b.location  ||
+                a.tupleSize  != b.tupleSize ||
+                a.type       != b.type      ||
+                a.normalized != b.normalized ||
+                a.offset     != b.offset)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the upload queue.
+ * ---------------------------------------------------------------- */
+struct UploadQueue::Data
+{
+    // Frees the uploads that were never polled. Without a current
+    // context their objects are left to the orphans and leaked, call
+    // UploadQueue::clear before.
+    ~Data()
+    { clear(false); }
+
+    // Removes the uploads that were not polled. The fences and the
+    // objects are deleted if the polling context is current.
+    void clear(bool current)
+    {
+        Completed* c = completed.exchange(nullptr,
+                                          std::memory_order_acquire);
+        for (; c; c = c->next)
+            waiting.push_back(c);
+
+        for (Completed* w : waiting)
+        {
+            if (current)
+                glDeleteSync(w->fence);
+            delete w;
+        }
+        pending -= int(waiting.size());
+        waiting.clear();
+
+        if (current)
+        {
+            orphans->release();
+            arenas.clear();
+        }
+    }
+
+    // Copies the uploaded buffers of the mesh into the arena of its
+    // format and deletes the buffers. Returns false if the mesh has
+    // no vertices or indices.
+    bool allocateMesh(UploadHandle::Data& handle)
+    {
+        std::vector<FormatArena>::iterator it =
+            std::find_if(arenas.begin(), arenas.end(),
+                         [&handle](const FormatArena& a)
+                         { return a.matches(handle); });
+        if (it == arenas.end())
+        {
+            FormatArena a;
+            a.vertexStride = handle.vertexStride;
+            a.indexType    = handle.indexType;
+            a.attributes   = handle.attributes;
+            a.arena = std::make_shared<MeshArena>(handle.vertexStride,
+                                                  handle.indexType);
+            for (const MeshFile::Attribute& attr : handle.attributes)
+                a.arena->setAttributeDefinition(
+                    attr.location, attr.tupleSize, attr.offset,
+                    attr.type, attr.normalized);
+            it = arenas.insert(arenas.end(), a);
+        }
+
+        handle.arena = it->arena;
+        handle.mesh  = handle.arena->allocateFromBuffers(
+            handle.vertexBuffer, handle.vertexCount,
+            handle.indexBuffer,  handle.indexCount);
+
+        StateCache& cache = StateCache::current();
+        cache.deleteBuffer(handle.vertexBuffer);
+        cache.deleteBuffer(handle.indexBuffer);
+        handle.vertexBuffer = 0;
+        handle.indexBuffer  = 0;
+
+        // The indices of the parts are relative to the first vertex
+        // of the file.
+        for (const MeshFile::Part& p : handle.fileParts)
+        {
+            MeshHandle part;
+            part.baseVertex  = handle.mesh.baseVertex;
+            part.vertexCount = p.vertexCount;
+            part.firstIndex  = handle.mesh.firstIndex + p.firstIndex;
+            part.indexCount  = p.indexCount;
+            handle.parts.push_back(part);
+        }
+        return handle.mesh.isValid();
+    }
+
+    // Adds the job into the queue.
+    UploadHandle push(Job job)
+    {
+        job.handle = std::make_shared<UploadHandle::Data>();
+        job.handle->orphans = orphans;
+        UploadHandle handle;
+        handle.d = job.handle;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job);
+        pending++;
+        condition.notify_one();
+        return handle;
+    }
+
+    // Runs the jobs in the worker thread.
+    void work(QOpenGLContext* context, QOffscreenSurface* surface)
+    {
+        Trace::setThreadName("Upload thread");
+
+        // Without a context the worker fails the jobs it takes so
+        // that their handles do not stay pending.
+        const bool current = context->makeCurrent(surface);
+        bool ready = current;
+        if (!current)
+            std::cerr << "Failed to make the upload context current."
+                      << std::endl;
+
+#ifdef _WIN32
+        if (ready)
+        {
+            glewExperimental = GL_TRUE;
+            if (glewInit() != GLEW_OK)
+            {
+                std::cerr << "Failed to initialize GLEW." << std::endl;
+                ready = false;
+            }
+        }
+#endif
+
+        if (ready)
+            StateCache::current().invalidate();
+
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]()
+                { return exiting || !queue.empty(); });
+                if (exiting)
+                    break;
+                job = queue.front();
+                queue.pop_front();
+            }
+
+            KUU_TRACE_SCOPE("UploadQueue::upload");
+
+            bool ok = false;
+            if (ready)
+            {
+                switch (job.type)
+                {
+                    case Job::MeshFileJob:
+                        ok = uploadMeshFile(job.path, *job.handle);
+                        break;
+                    case Job::ImageFileJob:
+                        ok = uploadImage(QImage(job.path), *job.handle);
+                        if (!ok)
+                            std::cerr << "Failed to read image "
+                                      << job.path.toStdString()
+                                      << std::endl;
+                        break;
+                    case Job::ImageJob:
+                        ok = uploadImage(job.image, *job.handle);
+                        break;
+                }
+            }
+
+            if (!ok)
+            {
+                job.handle->state.store(UploadHandle::Data::Failed,
+                                        std::memory_order_release);
+                pending--;
+                continue;
+            }
+
+            // Delete the objects of the uploads dropped meanwhile.
+            orphans->release();
+
+            // The polling thread uses the objects after the fence is
+            // signaled. The flush makes sure that the fence is
+            // signaled without further commands from this context.
+            Completed* c = new Completed();
+            c->handle = job.handle;
+            c->fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+
+            c->next = completed.load(std::memory_order_relaxed);
+            while (!completed.compare_exchange_weak(
+                       c->next, c,
+                       std::memory_order_release,
+                       std::memory_order_relaxed))
+            {}
+        }
+
+        if (ready)
+            orphans->release();
+        if (current)
+            context->doneCurrent();
+    }
+
+    // OpenGL contexts, surfaces and threads of the workers.
+    std::vector<std::shared_ptr<QOpenGLContext>> contexts;
+    std::vector<std::shared_ptr<QOffscreenSurface>> surfaces;
+    std::vector<std::shared_ptr<Worker>> workers;
+
+    // Guards the exit flag and the queue.
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool exiting = false;
+    std::deque<Job> queue;
+
+    // Count of uploads that are not yet polled or failed.
+    std::atomic<int> pending { 0 };
+
+    // Uploads written by the workers, newest first.
+    std::atomic<Completed*> completed { nullptr };
+    // Uploads whose fences were not yet signaled, accessed only by
+    // the polling thread.
+    std::vector<Completed*> waiting;
+
+    // Objects of the uploads dropped before they were polled.
+    std::shared_ptr<Orphans> orphans = std::make_shared<Orphans>();
+
+    // Arenas of the uploaded meshes, accessed only by the polling
+    // thread.
+    std::vector<FormatArena> arenas;
+};
+
+/* ---------------------------------------------------------------- */
+
+UploadQueue::UploadQueue(QOpenGLContext* shareContext,
+                         int workerCount)
+    : d(std::make_shared<Data>())
+{
+    for (int i = 0; i < std::max(workerCount, 1); ++i)
+    {
+        Data* data = d.get();
+        std::shared_ptr<Worker> worker;
+
+        std::shared_ptr<QOpenGLContext> context =
+            std::make_shared<QOpenGLContext>();
+        context->setShareContext(shareContext);
+        context->setFormat(shareContext->format());
+        context->create();
+
+        std::shared_ptr<QOffscreenSurface> surface =
+            std::make_shared<QOffscreenSurface>();
+        surface->setFormat(context->format());
+        surface->create();
+
+        QOpenGLContext* c = context.get();
+        QOffscreenSurface* s = surface.get();
+        worker = std::make_shared<Worker>([data, c, s]()
+        { data->work(c, s); });
+        context->moveToThread(worker.get());
+        surface->moveToThread(worker.get());
+
+        d->contexts.push_back(context);
+        d->surfaces.push_back(surface);
+        d->workers.push_back(worker);
+    }
+
+    // The uploads should not take time from the rendering and UI
+    // threads.
+    for (std::shared_ptr<Worker> worker : d->workers)
+        worker->start(QThread::LowPriority);
+}
+
+/* ---------------------------------------------------------------- */
+
+UploadQueue::~UploadQueue()
+{
+    stop();
+}
+
+/* ---------------------------------------------------------------- */
+
+UploadHandle UploadQueue::uploadMesh(const QString& path)
+{
+    Job job;
+    job.type = Job::MeshFileJob;
+    job.path = path;
+    return d->push(job);
+}
+
+/* ---------------------------------------------------------------- */
+
+UploadHandle UploadQueue::uploadTexture(const QString& path)
+{
+    Job job;
+    job.type = Job::ImageFileJob;
+    job.path = path;
+    return d->push(job);
+}
+
+/* ---------------------------------------------------------------- */
+
+UploadHandle UploadQueue::uploadTexture(const QImage& image)
+{
+    Job job;
+    job.type  = Job::ImageJob;
+    job.image = image;
+    return d->push(job);
+}
+
+/* ---------------------------------------------------------------- */
+
+int UploadQueue::poll()
+{
+    KUU_TRACE_SCOPE("UploadQueue::poll");
+
+    d->orphans->release();
+
+    // Take the uploads written since the previous poll, the oldest
+    // upload is the last one in the list.
+    Completed* c = d->completed.exchange(nullptr,
+                                         std::memory_order_acquire);
+    const size_t first = d->waiting.size();
+    for (; c; c = c->next)
+        d->waiting.push_back(c);
+    std::reverse(d->waiting.begin() + first, d->waiting.end());
+
+    int count = 0;
+    for (size_t i = 0; i < d->waiting.size();)
+    {
+        Completed* w = d->waiting[i];
+        const GLenum result = glClientWaitSync(w->fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED &&
+            result != GL_CONDITION_SATISFIED)
+        {
+            ++i;
+            continue;
+        }
+
+        glDeleteSync(w->fence);
+        UploadHandle::Data& handle = *w->handle;
+        bool ok = true;
+        if (handle.vertexBuffer)
+            ok = d->allocateMesh(handle);
+        handle.state.store(ok ? UploadHandle::Data::Complete
+                              : UploadHandle::Data::Failed,
+                           std::memory_order_release);
+
+        d->waiting.erase(d->waiting.begin() + i);
+        delete w;
+        count++;
+    }
+    d->pending -= count;
+    return count;
+}
+
+/* ---------------------------------------------------------------- */
+
+int UploadQueue::pendingCount() const
+{
+    return d->pending.load();
+}
+
+/* ---------------------------------------------------------------- */
+
+void UploadQueue::clear()
+{
+    d->clear(true);
+}
+
+/* ---------------------------------------------------------------- */
+
+void UploadQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->exiting = true;
+        d->pending -= int(d->queue.size());
+        d->queue.clear();
+        d->condition.notify_all();
+    }
+
+    for (std::shared_ptr<Worker> worker : d->workers)
+        worker->wait();
+}
+
+} // namespace opengl
+} // namespace kuu
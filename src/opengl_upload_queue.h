@@ -0,0 +1,214 @@
+/**
+    @file   opengl_upload_queue.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::UploadQueue class.
+ **/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QString>
+#include <QtGui/QImage>
+#include <glm/vec3.hpp>
+#include "opengl.h"
+#include "opengl_mesh_arena.h"
+
+class QOpenGLContext;
+
+namespace kuu
+{
+namespace opengl
+{
+
+class Texture;
+
+/**
+    @brief   A handle of an upload of @ref UploadQueue.
+
+    @details The handle is like a future: the uploaded mesh or
+             texture is available once the queue has taken the upload
+             into use with @ref UploadQueue::poll. Until then the
+             caller should render without it.
+
+             The handle must be used from the thread that polls the
+             queue. The mesh or texture of a complete upload belongs
+             to the caller, a mesh is freed from its arena with @ref
+             MeshArena::free. The objects of an upload whose handle
+             is destroyed before it is polled are deleted by the
+             queue on the next poll, so the handle can be destroyed
+             on any thread.
+ **/
+class UploadHandle
+{
+public:
+    /**
+        Constructs an empty handle.
+     **/
+    UploadHandle();
+
+    /**
+        Returns true if the handle refers to an upload.
+     **/
+    bool isValid() const;
+
+    /**
+        Returns true if the upload is complete and its object can be
+        used.
+     **/
+    bool isComplete() const;
+
+    /**
+        Returns true if the upload failed, e.g. the file could not be
+        read.
+     **/
+    bool isFailed() const;
+
+    /**
+        Returns the arena of the uploaded mesh, nullptr if the upload
+        is not a complete mesh upload. The meshes of the same vertex
+        format and index type share an arena.
+     **/
+    std::shared_ptr<MeshArena> arena() const;
+
+    /**
+        Returns the uploaded mesh in the arena, invalid if the upload
+        is not a complete mesh upload.
+     **/
+    MeshHandle mesh() const;
+
+    /**
+        Returns the parts of the uploaded mesh in the arena, e.g. the
+        objects of the source file. The indices of the parts are
+        relative to the first vertex of the mesh so the parts share
+        its base vertex. The parts are for rendering only, the mesh
+        is freed with the handle of @ref mesh.
+     **/
+    std::vector<MeshHandle> parts() const;
+
+    /**
+        Gets the bounding box of the positions of the uploaded mesh,
+        i.e. of the three float attribute at location 0. Returns
+        false if the upload is not a complete mesh upload or the
+        mesh has no such positions.
+     **/
+    bool bounds(glm::vec3& min, glm::vec3& max) const;
+
+    /**
+        Returns the uploaded texture, nullptr if the upload is not a
+        complete texture upload. The texture has mipmaps.
+     **/
+    std::shared_ptr<Texture> texture() const;
+
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+/**
+    @brief   Uploads meshes and textures on background threads.
+
+    @details The queue has worker threads that each have an OpenGL
+             context sharing objects with the given context. A worker
+             reads the file, decodes the image and writes the data
+             into the buffer and texture objects in its own context,
+             so the rendering thread does not wait for the file
+             system or for the transfers.
+
+             When an upload is written the worker inserts a fence and
+             pushes the upload into a lock-free list of completed
+             uploads. The rendering thread calls @ref poll once per
+             frame, takes the whole list with a single atomic
+             exchange and completes the uploads whose fences are
+             signaled. The buffers of a mesh are copied on the GPU
+             into a @ref MeshArena of its vertex format in the polling
+             context, since vertex arrays are not shared between
+             contexts, so the uploaded meshes are rendered without
+             switching vertex arrays. An upload is seen by the
+             rendering thread either completely or not at all.
+
+             The workers run with a low priority so that they do not
+             take CPU time from the rendering and UI threads.
+
+    @code
+    UploadHandle handle = uploadQueue->uploadMesh("model.kmesh");
+    ...
+    // On each frame
+    uploadQueue->poll();
+    if (handle.isComplete())
+    {
+        handle.arena()->bind();
+        handle.arena()->render(handle.parts());
+    }
+    @endcode
+ **/
+class UploadQueue
+{
+public:
+    /**
+        @brief Constructs the queue and starts the worker threads.
+        @param shareContext The context that the worker contexts
+                            share objects with.
+        @param workerCount  The count of worker threads.
+     **/
+    explicit UploadQueue(QOpenGLContext* shareContext,
+                         int workerCount = 1);
+
+    /**
+        Stops the worker threads. Call @ref clear before with the
+        polling context current to delete the uploads that were not
+        polled and to release the mesh arenas, otherwise their
+        objects are leaked.
+     **/
+    ~UploadQueue();
+
+    /**
+        Uploads the mesh of a mesh file written by the @c
+        qopenglwidget-meshconv tool.
+     **/
+    UploadHandle uploadMesh(const QString& path);
+
+    /**
+        Uploads the image file as a texture.
+     **/
+    UploadHandle uploadTexture(const QString& path);
+
+    /**
+        Uploads the image as a texture.
+     **/
+    UploadHandle uploadTexture(const QImage& image);
+
+    /**
+        @brief Completes the uploads that the GPU has finished.
+        @note  Must be called from the thread that uses the uploads,
+               the context of the thread must be current.
+        @return The count of uploads completed by this call.
+     **/
+    int poll();
+
+    /**
+        Returns the count of uploads that are queued, being written
+        or waiting to be polled.
+     **/
+    int pendingCount() const;
+
+    /**
+        @brief Deletes the uploads that are written but not polled
+               and releases the mesh arenas of the queue. An arena
+               is deleted with the last handle of its meshes.
+        @note  The context of the polling thread must be current.
+     **/
+    void clear();
+
+    /**
+        Stops the worker threads. The uploads that are not started
+        are discarded and their handles stay pending.
+     **/
+    void stop();
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace opengl
+} // namespace kuu
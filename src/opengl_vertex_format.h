@@ -0,0 +1,337 @@
+/**
+    @file   opengl_vertex_format.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::opengl::VertexFormat class template.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include "opengl.h"
+
+namespace kuu
+{
+namespace opengl
+{
+namespace vertex
+{
+
+/* ---------------------------------------------------------------- *
+   Returns true if the type packs all the components into an int.
+ * ---------------------------------------------------------------- */
+constexpr bool isPacked(GLenum type)
+{
+    return type == GL_INT_2_10_10_10_REV ||
+           type == GL_UNSIGNED_INT_2_10_10_10_REV;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the byte size of a component of the type.
+ * ---------------------------------------------------------------- */
+constexpr int componentSize(GLenum type)
+{
+    return type == GL_FLOAT          ? 4 :
+           type == GL_HALF_FLOAT     ? 2 :
+           type == GL_UNSIGNED_BYTE  ? 1 :
+           type == GL_BYTE           ? 1 :
+           type == GL_UNSIGNED_SHORT ? 2 :
+           type == GL_SHORT          ? 2 : 0;
+}
+
+/**
+    @brief   Describes a vertex attribute.
+
+    @details The attribute is stored as @c T in the vertex and read
+             by OpenGL as @c TupleSize components of @c Type. The
+             description is checked at compile time. OpenGL reads the
+             attributes fastest when they are aligned to four bytes so
+             the size of every attribute must be a multiple of four.
+ **/
+template<typename T, int TupleSize, GLenum Type, bool Normalized = false>
+struct Attribute
+{
+    typedef T StorageType;
+    static const int    tupleSize  = TupleSize;
+    static const GLenum type       = Type;
+    static const bool   normalized = Normalized;
+    static const int    size       = sizeof(T);
+
+    static_assert(TupleSize >= 1 && TupleSize <= 4,
+                  "Attribute must have from one to four components");
+    static_assert(sizeof(T) % 4 == 0,
+                  "Attribute size must be a multiple of four bytes");
+    static_assert(isPacked(Type)
+                      ? TupleSize == 4 && sizeof(T) == 4
+                      : sizeof(T) == TupleSize * componentSize(Type),
+                  "Attribute storage does not match the OpenGL type");
+};
+
+// 32-bit floats.
+typedef Attribute<float,     1, GL_FLOAT> Float1;
+typedef Attribute<glm::vec2, 2, GL_FLOAT> Float2;
+typedef Attribute<glm::vec3, 3, GL_FLOAT> Float3;
+typedef Attribute<glm::vec4, 4, GL_FLOAT> Float4;
+// 16-bit floats, see packHalf2 and packHalf4.
+typedef Attribute<glm::u16vec2, 2, GL_HALF_FLOAT> Half2;
+typedef Attribute<glm::u16vec4, 4, GL_HALF_FLOAT> Half4;
+// Unsigned bytes normalized to [0, 1], e.g. a color.
+typedef Attribute<glm::u8vec4, 4, GL_UNSIGNED_BYTE, true> UNorm8x4;
+// Signed 10-bit components normalized to [-1, 1], e.g. a normal.
+// The shader reads the unused 2-bit fourth component as w.
+typedef Attribute<uint32_t, 4, GL_INT_2_10_10_10_REV, true> SNorm10x3;
+// Unsigned 10-bit components normalized to [0, 1].
+typedef Attribute<uint32_t, 4, GL_UNSIGNED_INT_2_10_10_10_REV, true>
+    UNorm10x3;
+
+/* ---------------------------------------------------------------- *
+   Packs the vector into half floats.
+ * ---------------------------------------------------------------- */
+inline glm::u16vec2 packHalf2(const glm::vec2& v)
+{
+    return glm::u16vec2(glm::packHalf1x16(v.x),
+                        glm::packHalf1x16(v.y));
+}
+
+inline glm::u16vec4 packHalf4(const glm::vec4& v)
+{
+    return glm::u16vec4(glm::packHalf1x16(v.x),
+                        glm::packHalf1x16(v.y),
+                        glm::packHalf1x16(v.z),
+                        glm::packHalf1x16(v.w));
+}
+
+/* ---------------------------------------------------------------- *
+   Packs the vector in range [0, 1] into normalized bytes.
+ * ---------------------------------------------------------------- */
+inline glm::u8vec4 packUnorm8x4(const glm::vec4& v)
+{
+    return glm::u8vec4(glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f));
+}
+
+/* ---------------------------------------------------------------- *
+   Packs the vector in range [-1, 1] into 10-bit components.
+ * ---------------------------------------------------------------- */
+inline uint32_t packSnorm10x3(const glm::vec3& v)
+{
+    return glm::packSnorm3x10_1x2(glm::vec4(v, 0.0f));
+}
+
+namespace detail
+{
+
+// Sum of the sizes of the attributes.
+template<typename... A>
+struct SizeSum;
+
+template<>
+struct SizeSum<>
+{ static const int value = 0; };
+
+template<typename A, typename... R>
+struct SizeSum<A, R...>
+{ static const int value = A::size + SizeSum<R...>::value; };
+
+// Offset of the Ith attribute.
+template<int I, typename... A>
+struct Offset;
+
+template<typename A, typename... R>
+struct Offset<0, A, R...>
+{ static const int value = 0; };
+
+template<int I, typename A, typename... R>
+struct Offset<I, A, R...>
+{ static const int value = A::size + Offset<I - 1, R...>::value; };
+
+// Ith attribute.
+template<int I, typename... A>
+struct At;
+
+template<typename A, typename... R>
+struct At<0, A, R...>
+{ typedef A Type; };
+
+template<int I, typename A, typename... R>
+struct At<I, A, R...>
+{ typedef typename At<I - 1, R...>::Type Type; };
+
+// Storage of the attribute values of a vertex.
+template<typename... A>
+struct Storage;
+
+template<typename A>
+struct Storage<A>
+{
+    Storage() {}
+    Storage(const typename A::StorageType& value)
+        : value(value)
+    {}
+
+    typename A::StorageType value;
+};
+
+template<typename A, typename... R>
+struct Storage<A, R...>
+{
+    Storage() {}
+    Storage(const typename A::StorageType& value,
+            const typename R::StorageType&... rest)
+        : value(value)
+        , rest(rest...)
+    {}
+
+    typename A::StorageType value;
+    Storage<R...> rest;
+};
+
+// Access to the value of the Ith attribute.
+template<int I, typename... A>
+struct Get;
+
+template<typename A, typename... R>
+struct Get<0, A, R...>
+{
+    typedef typename A::StorageType Type;
+    static Type& get(Storage<A, R...>& s)
+    { return s.value; }
+};
+
+template<int I, typename A, typename... R>
+struct Get<I, A, R...>
+{
+    typedef typename Get<I - 1, R...>::Type Type;
+    static Type& get(Storage<A, R...>& s)
+    { return Get<I - 1, R...>::get(s.rest); }
+};
+
+// Calls the function for each attribute.
+template<int I, int Offset, typename... A>
+struct ForEach;
+
+template<int I, int Offset>
+struct ForEach<I, Offset>
+{
+    template<typename F>
+    static void apply(F&) {}
+};
+
+template<int I, int Offset, typename A, typename... R>
+struct ForEach<I, Offset, A, R...>
+{
+    template<typename F>
+    static void apply(F& f)
+    {
+        f(I, A::tupleSize, A::type, A::normalized, Offset);
+        ForEach<I + 1, Offset + A::size, R...>::apply(f);
+    }
+};
+
+} // namespace detail
+} // namespace vertex
+
+/**
+    @brief   A vertex layout described at compile time.
+
+    @details The attributes are given in the order of their shader
+             locations, the first attribute is at location 0. The
+             stride, the attribute offsets, the OpenGL types and the
+             normalization are derived from the attribute descriptions
+             and the vertex type of the format has exactly that
+             layout.
+
+             Packed attributes like half floats, normalized bytes and
+             10-bit components take 2-4 times less memory and
+             bandwidth than the same attributes as floats.
+
+    @code
+    typedef VertexFormat<vertex::Float3,   // position
+                         vertex::UNorm8x4, // color
+                         vertex::Half2>    // texture coordinate
+        Format;
+    static_assert(Format::stride == 20, "");
+
+    std::vector<Format::Vertex> vertices =
+    {
+        Format::Vertex(glm::vec3(-1.0f, -1.0f, 0.0f),
+                       glm::u8vec4(255, 0, 0, 255),
+                       vertex::packHalf2(glm::vec2(0.0f, 0.0f))),
+        ...
+    };
+
+    mesh->writeVertices(vertices);
+    mesh->setVertexFormat<Format>();
+    @endcode
+ **/
+template<typename... Attributes>
+class VertexFormat
+{
+public:
+    static_assert(sizeof...(Attributes) > 0,
+                  "Vertex format must have attributes");
+
+    /**
+        The count of attributes.
+     **/
+    static const int attributeCount = sizeof...(Attributes);
+
+    /**
+        The byte size of a vertex.
+     **/
+    static const int stride =
+        vertex::detail::SizeSum<Attributes...>::value;
+
+    /**
+        Returns the byte offset of the Ith attribute.
+     **/
+    template<int I>
+    static constexpr int offset()
+    { return vertex::detail::Offset<I, Attributes...>::value; }
+
+    /**
+        The description of the Ith attribute.
+     **/
+    template<int I>
+    using Attribute =
+        typename vertex::detail::At<I, Attributes...>::Type;
+
+    /**
+        Calls the function for each attribute with the location,
+        tuple size, OpenGL type, normalization and offset of the
+        attribute.
+     **/
+    template<typename F>
+    static void forEachAttribute(F f)
+    { vertex::detail::ForEach<0, 0, Attributes...>::apply(f); }
+
+    /**
+        A vertex of the format.
+     **/
+    struct Vertex : vertex::detail::Storage<Attributes...>
+    {
+        typedef VertexFormat Format;
+
+        Vertex() {}
+        Vertex(const typename Attributes::StorageType&... values)
+            : vertex::detail::Storage<Attributes...>(values...)
+        {}
+
+        /**
+            Returns the value of the Ith attribute.
+         **/
+        template<int I>
+        typename vertex::detail::Get<I, Attributes...>::Type& get()
+        { return vertex::detail::Get<I, Attributes...>::get(*this); }
+    };
+
+    static_assert(sizeof(Vertex) == stride,
+                  "Vertex has padding between the attributes");
+};
+
+} // namespace opengl
+} // namespace kuu
@@ -5,32 +5,56 @@
  **/
 
 #include "opengl_viewport_target.h"
+#include <algorithm>
 #include <iostream>
 #include "opengl_mesh.h"
 #include "opengl_shader.h"
+#include "opengl_shader_compiler.h"
+#include "opengl_vertex_format.h"
 
 namespace kuu
 {
 namespace opengl
 {
 
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   The vertex format of the target quad: position, color and texture
+   coordinate.
+ * ---------------------------------------------------------------- */
+typedef VertexFormat<vertex::Float3,
+                     vertex::UNorm8x4,
+                     vertex::Half2> TargetFormat;
+
+// Strength of the sharpen filter.
+const float Sharpness = 0.2f;
+
+} // anonymous namespace
+
 /* ---------------------------------------------------------------- *
    The data of the viewport target.
  * ---------------------------------------------------------------- */
 struct ViewportTarget::Data
 {
-    Data()
+    Data(std::shared_ptr<ShaderCompiler> compiler)
     {
         // Create vertex data.
+        typedef TargetFormat::Vertex Vertex;
+        typedef glm::u8vec4 Color;
         const float w = 1.0f;
         const float h = 1.0f;
-        const std::vector<float> vertexData =
+        const std::vector<Vertex> vertexData =
         {
-          // x   y   z     r     g     b,    u,    v
-            -w, -h, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
-             w, -h, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-             w,  h, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
-            -w,  h, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f
+            Vertex(glm::vec3(-w, -h, 0.0f), Color(255,   0,   0, 255),
+                   vertex::packHalf2(glm::vec2(0.0f, 0.0f))),
+            Vertex(glm::vec3( w, -h, 0.0f), Color(  0, 255,   0, 255),
+                   vertex::packHalf2(glm::vec2(1.0f, 0.0f))),
+            Vertex(glm::vec3( w,  h, 0.0f), Color(  0,   0, 255, 255),
+                   vertex::packHalf2(glm::vec2(1.0f, 1.0f))),
+            Vertex(glm::vec3(-w,  h, 0.0f), Color(255, 255,   0, 255),
+                   vertex::packHalf2(glm::vec2(0.0f, 1.0f)))
         };
 
         // Create triangle indices (two triangles)
@@ -41,71 +65,264 @@ struct ViewportTarget::Data
         };
 
         mesh = std::make_shared<Mesh>();
-        mesh->writeVertexData(vertexData);
+        mesh->writeVertices(vertexData);
         mesh->writeIndexData(indexData);
-        mesh->setAttributeDefinition(0, 3, 8 * sizeof(float), 0);
-        mesh->setAttributeDefinition(1, 3, 8 * sizeof(float),
-                                     3 * sizeof(float));
-        mesh->setAttributeDefinition(2, 3, 8 * sizeof(float),
-                                     6 * sizeof(float));
+        mesh->setVertexFormat<TargetFormat>();
+        // Leave no vertex array bound for Qt.
+        mesh->release();
 
         const std::string vshSource =
             "#version 330 core\r\n" // note linebreak
             "layout (location = 0) in vec3 position;"
             "layout (location = 1) in vec3 color;"
             "layout (location = 2) in vec2 texCoord;"
+            "uniform vec2 texScale;"
             "out vec4 colorIn;"
             "out vec2 texCoordIn;"
             "void main(void)"
             "{"
                " gl_Position = vec4(position, 1.0);"
                 "colorIn = vec4(color, 1.0);"
-                "texCoordIn = texCoord;"
+                "texCoordIn = texCoord * texScale;"
             "}";
 
+        // The samples are clamped between the centers of the first
+        // and the last texel of the frame. With sharpening the four
+        // neighbouring texels are subtracted from the center.
         const std::string fshSource =
             "#version 330 core\r\n" // note linebreak
             "uniform sampler2D tex;"
+            "uniform vec2 texelSize;"
+            "uniform vec2 texMax;"
+            "uniform float sharpness;"
             "in vec4 colorIn;"
             "in vec2 texCoordIn;"
             "out vec4 colorOut;"
+            "vec4 frameSample(vec2 offset)"
+            "{"
+                "vec2 uv = texCoordIn + offset * texelSize;"
+                "return texture(tex, clamp(uv, texelSize * 0.5, texMax));"
+            "}"
             "void main(void)"
             "{"
-                "colorOut = texture(tex, texCoordIn);"
+                "vec4 c = frameSample(vec2(0.0));"
+                "if (sharpness > 0.0)"
+                "{"
+                    "vec4 n = frameSample(vec2( 0.0,  1.0)) +"
+                    "         frameSample(vec2( 0.0, -1.0)) +"
+                    "         frameSample(vec2( 1.0,  0.0)) +"
+                    "         frameSample(vec2(-1.0,  0.0));"
+                    "c = clamp(c + sharpness * (4.0 * c - n), 0.0, 1.0);"
+                "}"
+                "colorOut = c;"
             "}";
 
+        if (compiler)
+        {
+            shaderHandle = compiler->compile(vshSource, fshSource);
+            return;
+        }
+
         shader = std::make_shared<Shader>();
         shader->setVertexShader(vshSource);
         shader->setFragmentShader(fshSource);
         shader->link();
+        findUniforms();
+    }
+
+    // Destroys the viewport target data.
+    ~Data()
+    {
+        if (readFbo)
+            glDeleteFramebuffers(1, &readFbo);
+        if (samplers[0])
+            glDeleteSamplers(2, samplers);
+    }
+
+    // Looks up the uniforms of the shader.
+    void findUniforms()
+    {
+        tex       = shader->uniform<int>("tex");
+        texScale  = shader->uniform<glm::vec2>("texScale");
+        texelSize = shader->uniform<glm::vec2>("texelSize");
+        texMax    = shader->uniform<glm::vec2>("texMax");
+        sharpness = shader->uniform<float>("sharpness");
+    }
+
+    // Returns the sampler of the frame. The framebuffer texture is
+    // sampled with the nearest filter when its texels map one-to-one
+    // to the target and with the linear filter when it is scaled.
+    // The sampler objects override the texture parameters without
+    // changing the texture of the rendering thread.
+    GLuint sampler(bool scaled)
+    {
+        if (!samplers[0])
+        {
+            glGenSamplers(2, samplers);
+            for (int i = 0; i < 2; ++i)
+            {
+                const GLint filter = i == 0 ? GL_NEAREST : GL_LINEAR;
+                glSamplerParameteri(samplers[i],
+                                    GL_TEXTURE_MIN_FILTER, filter);
+                glSamplerParameteri(samplers[i],
+                                    GL_TEXTURE_MAG_FILTER, filter);
+                glSamplerParameteri(samplers[i], GL_TEXTURE_WRAP_S,
+                                    GL_CLAMP_TO_EDGE);
+                glSamplerParameteri(samplers[i], GL_TEXTURE_WRAP_T,
+                                    GL_CLAMP_TO_EDGE);
+            }
+        }
+        return samplers[scaled ? 1 : 0];
+    }
+
+    // Takes the asynchronously compiled shader into use when it is
+    // available. Returns false if there is no shader yet.
+    bool hasShader()
+    {
+        if (shader)
+            return true;
+
+        shader = shaderHandle.shader();
+        if (!shader)
+            return false;
+
+        findUniforms();
+        return true;
+    }
+
+    // Draws the frame area of the texture with the textured quad.
+    void draw(GLuint textureId,
+              const glm::ivec2& size,
+              const glm::ivec2& textureSize,
+              const glm::ivec2& targetSize)
+    {
+        const bool scaled = size != targetSize;
+        const glm::vec2 texel = 1.0f / glm::vec2(textureSize);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glBindSampler(0, sampler(scaled));
+
+        mesh->bind();
+        shader->bind();
+        shader->setUniform(tex, 0);
+        shader->setUniform(texScale, glm::vec2(size) * texel);
+        shader->setUniform(texelSize, texel);
+        shader->setUniform(texMax, (glm::vec2(size) - 0.5f) * texel);
+        shader->setUniform(sharpness,
+            scaled && upscaleFilter == UpscaleFilter::Sharpen
+                ? Sharpness : 0.0f);
+        mesh->render(GL_TRIANGLES);
+        shader->release();
+        mesh->release();
+
+        glBindSampler(0, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Copies the texture into framebuffer with a blit.
+    void blit(GLuint textureId,
+              const glm::ivec2& size,
+              GLuint framebuffer,
+              const glm::ivec2& targetSize)
+    {
+        // The framebuffer of the rendering thread can not be used as
+        // framebuffers are not shared between contexts. The texture
+        // is attached into a read framebuffer of this context.
+        if (!readFbo)
+            glGenFramebuffers(1, &readFbo);
+
+        // The texture is attached on every blit as the rendering
+        // thread may have recreated a texture with the same name.
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER,
+                               GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, textureId, 0);
+
+        const GLenum filter = size == targetSize ? GL_NEAREST
+                                                 : GL_LINEAR;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(0, 0, size.x, size.y,
+                          0, 0, targetSize.x, targetSize.y,
+                          GL_COLOR_BUFFER_BIT, filter);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     }
 
     std::shared_ptr<Mesh> mesh;
     std::shared_ptr<Shader> shader;
+    Shader::Uniform<int> tex;
+    Shader::Uniform<glm::vec2> texScale;
+    Shader::Uniform<glm::vec2> texelSize;
+    Shader::Uniform<glm::vec2> texMax;
+    Shader::Uniform<float> sharpness;
+    // Handle of the asynchronously compiled shader.
+    ShaderHandle shaderHandle;
+
+    PresentMode presentMode = PresentMode::Draw;
+    UpscaleFilter upscaleFilter = UpscaleFilter::Bilinear;
+    GLuint readFbo = 0; // read framebuffer for blitting
+    GLuint samplers[2] = { 0, 0 }; // nearest and linear samplers
 };
 
 /* ---------------------------------------------------------------- */
 
-ViewportTarget::ViewportTarget()
-    : d(std::make_shared<Data>())
+ViewportTarget::ViewportTarget(
+        std::shared_ptr<ShaderCompiler> compiler)
+    : d(std::make_shared<Data>(compiler))
 {}
 
 /* ---------------------------------------------------------------- */
 
-void ViewportTarget::render(GLuint textureId)
+void ViewportTarget::setPresentMode(PresentMode mode)
+{ d->presentMode = mode; }
+
+/* ---------------------------------------------------------------- */
+
+ViewportTarget::PresentMode ViewportTarget::presentMode() const
+{ return d->presentMode; }
+
+/* ---------------------------------------------------------------- */
+
+void ViewportTarget::setUpscaleFilter(UpscaleFilter filter)
+{ d->upscaleFilter = filter; }
+
+/* ---------------------------------------------------------------- */
+
+ViewportTarget::UpscaleFilter ViewportTarget::upscaleFilter() const
+{ return d->upscaleFilter; }
+
+/* ---------------------------------------------------------------- */
+
+void ViewportTarget::render(GLuint textureId,
+                            const glm::ivec2& size,
+                            const glm::ivec2& textureSize,
+                            GLuint framebuffer,
+                            const glm::ivec2& targetSize,
+                            const std::vector<glm::ivec4>& rects)
 {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-
-    d->mesh->bind();
-    d->shader->bind();
-    d->shader->setUniform("tex", 0);
-    d->mesh->render(GL_TRIANGLES);
-    d->shader->release();
-    d->mesh->release();
-
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Blit until the shader is compiled.
+    const bool draw = d->presentMode == PresentMode::Draw &&
+                      d->hasShader();
+
+    // Both the draw and the blit are limited by the scissor test.
+    if (!rects.empty())
+        glEnable(GL_SCISSOR_TEST);
+
+    const size_t count = std::max(rects.size(), size_t(1));
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!rects.empty())
+            glScissor(rects[i].x, rects[i].y, rects[i].z, rects[i].w);
+
+        if (draw)
+            d->draw(textureId, size, textureSize, targetSize);
+        else
+            d->blit(textureId, size, framebuffer, targetSize);
+    }
+
+    if (!rects.empty())
+        glDisable(GL_SCISSOR_TEST);
 }
 
 } // namespace opengl
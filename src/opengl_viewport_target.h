@@ -9,31 +9,119 @@
 
 #include "opengl.h"
 #include <memory>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
 
 namespace kuu
 {
 namespace opengl
 {
 
+class ShaderCompiler;
+
 /**
     A viewport target.
 
-    This renders framebuffer texture into viewport.
+    This renders framebuffer texture into viewport. The texture can be
+    presented in two ways:
+
+    - Draw: the texture is drawn with a textured quad. This needs a
+      vertex array, a shader program and its uniforms.
+    - Blit: the texture is attached into a read framebuffer and copied
+      into the target framebuffer with @c glBlitFramebuffer. A scaled
+      blit with linear filtering is done if the sizes differ.
+
+    A frame rendered with a lower resolution is upscaled with the
+    upscale filter in the draw mode. The bilinear filter samples the
+    frame with a linear sampler object, the sharpen filter sharpens
+    the bilinear result with the neighbouring texels to restore some
+    of the contrast lost in upscaling. The samples are clamped to the
+    frame area so that the texels outside of it do not bleed in.
+
+    The texture can be presented partially. Both modes are then
+    scissored to the given rectangles of the target and the rest of
+    the target keeps its previous content.
  **/
 class ViewportTarget
 {
 public:
+    /**
+        Presentation mode.
+     **/
+    enum class PresentMode
+    {
+        Draw,
+        Blit
+    };
+
+    /**
+        Upscale filter of the draw mode.
+     **/
+    enum class UpscaleFilter
+    {
+        Bilinear,
+        Sharpen
+    };
+
     /**
         Constructs the viewport target.
-        @note OpenGL context must be valid.
+
+        If a shader compiler is given then the shader of the draw
+        mode is compiled asynchronously and the texture is presented
+        with a blit until the shader is available.
+
+        @note  OpenGL context must be valid.
+        @param compiler The shader compiler, nullptr to compile the
+                        shader synchronously.
+     **/
+    explicit ViewportTarget(
+        std::shared_ptr<ShaderCompiler> compiler = nullptr);
+
+    /**
+        Sets the presentation mode. Default is @c PresentMode::Draw.
      **/
-    ViewportTarget();
+    void setPresentMode(PresentMode mode);
+
+    /**
+        Returns the presentation mode.
+     **/
+    PresentMode presentMode() const;
+
+    /**
+        Sets the upscale filter. Default is @c UpscaleFilter::Bilinear.
+     **/
+    void setUpscaleFilter(UpscaleFilter filter);
+
+    /**
+        Returns the upscale filter.
+     **/
+    UpscaleFilter upscaleFilter() const;
 
     /**
         Renders the framebuffer texture into viewport.
-        @param textureId The framebuffer texture.
+
+        The target framebuffer must be bound and the viewport must
+        cover the target size. Both are still bound after the call.
+
+        @param textureId   The framebuffer texture.
+        @param size        The size of the area to render, starting
+                           from the bottom-left corner of the texture.
+        @param textureSize The size of the texture.
+        @param framebuffer The target framebuffer.
+        @param targetSize  The size of the target framebuffer.
+        @param rects       The rectangles (x, y, width, height) of the
+                           target to render in pixels with the origin
+                           at the bottom-left corner. If empty then
+                           the whole target is rendered.
      **/
-    void render(GLuint textureId);
+    void render(GLuint textureId,
+                const glm::ivec2& size,
+                const glm::ivec2& textureSize,
+                GLuint framebuffer,
+                const glm::ivec2& targetSize,
+                const std::vector<glm::ivec4>& rects =
+                    std::vector<glm::ivec4>());
 
 private:
     struct Data;
@@ -6,13 +6,123 @@
 
 #include "opengl_widget.h"
 #include "opengl_rendering_thread.h"
+#include "opengl_gpu_timer.h"
+#include "opengl_state_cache.h"
 #include "opengl_viewport_target.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <QtCore/QtGlobal>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QKeyEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
 
 namespace kuu
 {
 namespace opengl
 {
 
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Returns the statistics value as text.
+ * ---------------------------------------------------------------- */
+QString number(double value)
+{
+    return QString::number(value, 'f', 2);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the damage rectangle of the frame in target pixels. The
+   rectangle is grown by the texels that the upscale filters sample
+   around a pixel.
+ * ---------------------------------------------------------------- */
+glm::ivec4 targetRect(const QRect& rect,
+                      const QSize& frameSize,
+                      const QSize& targetSize)
+{
+    const int grow = 2;
+    const double sx = double(targetSize.width())  / frameSize.width();
+    const double sy = double(targetSize.height()) / frameSize.height();
+    const double left   = rect.left() - grow;
+    const double bottom = rect.top()  - grow;
+    const double right  = rect.left() + rect.width()  + grow;
+    const double top    = rect.top()  + rect.height() + grow;
+    const int x0 = std::max(int(std::floor(left   * sx)), 0);
+    const int y0 = std::max(int(std::floor(bottom * sy)), 0);
+    const int x1 = std::min(int(std::ceil(right * sx)),
+                            targetSize.width());
+    const int y1 = std::min(int(std::ceil(top   * sy)),
+                            targetSize.height());
+    return glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+}
+
+/* ---------------------------------------------------------------- *
+   Draws the statistics overlay with the painter. Returns the
+   rectangle of the overlay.
+ * ---------------------------------------------------------------- */
+QRect drawHud(QPainter& painter, const RenderingThread::Stats& stats)
+{
+    const QString lines[] =
+    {
+        QString("FPS     %1").arg(number(stats.fps)),
+        QString("CPU     %1 ms (clear %2, update %3, render %4, "
+                "publish %5)")
+            .arg(number(stats.cpuFrame))
+            .arg(number(stats.cpuClear))
+            .arg(number(stats.cpuUpdate))
+            .arg(number(stats.cpuRender))
+            .arg(number(stats.cpuPublish)),
+        QString("GPU     %1 ms (clear %2, render %3)")
+            .arg(number(stats.gpuFrame()))
+            .arg(number(stats.gpuClear))
+            .arg(number(stats.gpuRender)),
+        QString("Present %1 ms CPU, %2 ms GPU")
+            .arg(number(stats.cpuPresent))
+            .arg(number(stats.gpuPresent)),
+        QString("Bound   %1").arg(stats.isGpuBound() ? "GPU" : "CPU"),
+        QString("Scale   %1").arg(number(stats.renderScale)),
+        QString("Damage  %1 %").arg(number(stats.damagedArea * 100.0)),
+        QString("Jobs    %1 workers, %2 % busy")
+            .arg(stats.jobWorkers)
+            .arg(number(stats.jobUtilization * 100.0))
+    };
+    const int lineCount = int(sizeof(lines) / sizeof(lines[0]));
+
+    QFont font("Monospace");
+    font.setStyleHint(QFont::TypeWriter);
+    const QFontMetrics metrics(font);
+    const int margin = 6;
+
+    int width = 0;
+    for (const QString& line : lines)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        width = std::max(width, metrics.horizontalAdvance(line));
+#else
+        width = std::max(width, metrics.width(line));
+#endif
+    }
+    const int height = lineCount * metrics.height();
+
+    const QRect rect(0, 0, width + 2 * margin, height + 2 * margin);
+    painter.setFont(font);
+    painter.fillRect(rect, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::yellow);
+    for (int i = 0; i < lineCount; ++i)
+        painter.drawText(margin,
+                         margin + i * metrics.height() + metrics.ascent(),
+                         lines[i]);
+    return rect;
+}
+
+} // anonymous namespace
+
 /* ---------------------------------------------------------------- *
    The data of the widget.
  * ---------------------------------------------------------------- */
@@ -20,13 +130,60 @@ struct Widget::Data
 {
     std::shared_ptr<RenderingThread> renderingThread;
     std::shared_ptr<ViewportTarget> viewportTarget;
+    std::shared_ptr<GpuTimer> presentTimer;
+
+    // Frame pacing settings of the rendering thread.
+    FramePacer::Settings framePacing;
+    // Resolution scaling settings of the rendering thread.
+    ResolutionGovernor::Settings resolutionScaling;
+    // Count of quads rendered by the thread.
+    int quadCount = 1;
+    // Count of job workers of the thread, -1 to size by hardware.
+    int jobWorkerCount = -1;
+    // Mesh and texture files of the thread, empty if none.
+    QString meshPath;
+    QString texturePath;
+    // Image files of the texture atlas of the thread.
+    QStringList atlasPaths;
+    // True if the thread renders only on demand.
+    bool renderOnDemand = false;
+    // True if the quads rotate.
+    bool animated = true;
+    // Presentation mode of the viewport target.
+    ViewportTarget::PresentMode presentMode =
+        ViewportTarget::PresentMode::Draw;
+    // Upscale filter of the viewport target.
+    ViewportTarget::UpscaleFilter upscaleFilter =
+        ViewportTarget::UpscaleFilter::Bilinear;
+    // Number and size of the frame that was painted last.
+    uint64_t paintedFrame = 0;
+    QSize paintedSize;
+    // True if the next paint must present the whole frame.
+    bool fullPresent = true;
+    // True if the statistics overlay is visible.
+    bool hudVisible = false;
+    // Height of the statistics overlay in widget coordinates.
+    int hudHeight = 0;
 };
 
 /* ---------------------------------------------------------------- */
 
 Widget::Widget()
     : d(std::make_shared<Data>())
-{}
+{
+    // Keep the content between the paints so that only the damaged
+    // part of a frame has to be presented.
+    setUpdateBehavior(QOpenGLWidget::PartialUpdate);
+
+    // Tell the pacer when the painted frame has been swapped to the
+    // screen.
+    connect(this, &QOpenGLWidget::frameSwapped, [this]()
+    {
+        if (d->renderingThread && d->paintedFrame)
+            d->renderingThread->framePacer()->framePresented(
+                d->paintedFrame);
+    });
+}
 
 /* ---------------------------------------------------------------- */
 
@@ -35,7 +192,31 @@ void Widget::startThread()
     if (d->renderingThread)
         stopThread();
 
-    d->renderingThread = std::make_shared<RenderingThread>(this);
+    // Pace the thread with the refresh rate of the current screen.
+    QScreen* screen = windowHandle() ? windowHandle()->screen()
+                                     : QGuiApplication::primaryScreen();
+    if (screen)
+        d->framePacing.refreshRate = screen->refreshRate();
+
+    d->paintedFrame = 0;
+    d->renderingThread = std::make_shared<RenderingThread>(
+        context(), size(), [this]()
+    {
+        // Notify about new frame unless an earlier notification is
+        // still pending.
+        if (d->renderingThread->framePacer()->requestUpdate())
+            QMetaObject::invokeMethod(this, "update");
+    });
+    d->renderingThread->framePacer()->setSettings(d->framePacing);
+    d->renderingThread->resolutionGovernor()->setSettings(
+        d->resolutionScaling);
+    d->renderingThread->setQuadCount(d->quadCount);
+    d->renderingThread->setJobWorkerCount(d->jobWorkerCount);
+    d->renderingThread->setMeshFile(d->meshPath);
+    d->renderingThread->setTextureFile(d->texturePath);
+    d->renderingThread->setAtlasFiles(d->atlasPaths);
+    d->renderingThread->setRenderOnDemand(d->renderOnDemand);
+    d->renderingThread->setAnimated(d->animated);
     d->renderingThread->start();
 }
 
@@ -49,24 +230,291 @@ void Widget::stopThread()
         d->renderingThread->quit();
         d->renderingThread->wait();
     }
+
+    // The shader of the viewport target is compiled by the shader
+    // compiler of the thread, delete it while the compiler exists.
+    if (d->viewportTarget || d->presentTimer)
+    {
+        makeCurrent();
+        d->viewportTarget.reset();
+        d->presentTimer.reset();
+        doneCurrent();
+    }
     d->renderingThread.reset();
 }
 
 /* ---------------------------------------------------------------- */
 
+void Widget::setFramePacing(const FramePacer::Settings& settings)
+{
+    d->framePacing = settings;
+    if (d->renderingThread)
+        d->renderingThread->framePacer()->setSettings(settings);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setResolutionScaling(
+        const ResolutionGovernor::Settings& settings)
+{
+    d->resolutionScaling = settings;
+    if (d->renderingThread)
+        d->renderingThread->resolutionGovernor()->setSettings(settings);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setRenderOnDemand(bool onDemand)
+{
+    d->renderOnDemand = onDemand;
+    if (d->renderingThread)
+        d->renderingThread->setRenderOnDemand(onDemand);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::requestFrame()
+{
+    if (d->renderingThread)
+        d->renderingThread->requestFrame();
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setAnimated(bool animated)
+{
+    d->animated = animated;
+    if (d->renderingThread)
+        d->renderingThread->setAnimated(animated);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setQuadCount(int count)
+{
+    d->quadCount = count;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setJobWorkerCount(int count)
+{
+    d->jobWorkerCount = count;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setMeshFile(const QString& path)
+{
+    d->meshPath = path;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setTextureFile(const QString& path)
+{
+    d->texturePath = path;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setAtlasFiles(const QStringList& paths)
+{
+    d->atlasPaths = paths;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setPresentMode(ViewportTarget::PresentMode mode)
+{
+    d->presentMode = mode;
+    d->fullPresent = true;
+    update();
+}
+
+/* ---------------------------------------------------------------- */
+
+ViewportTarget::PresentMode Widget::presentMode() const
+{ return d->presentMode; }
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setUpscaleFilter(ViewportTarget::UpscaleFilter filter)
+{
+    d->upscaleFilter = filter;
+    d->fullPresent = true;
+    update();
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::setHudVisible(bool visible)
+{
+    d->hudVisible = visible;
+    d->fullPresent = true;
+    update();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Widget::isHudVisible() const
+{ return d->hudVisible; }
+
+/* ---------------------------------------------------------------- */
+
 void Widget::paintGL()
 {
+    KUU_TRACE_SCOPE("Widget::paintGL");
+
     if (!d->renderingThread)
         return;
 
+    // Qt and the HUD painter change the OpenGL state outside of the
+    // state cache.
+    StateCache::current().invalidate();
+
     if (!d->viewportTarget)
-        d->viewportTarget = std::make_shared<ViewportTarget>();
+        d->viewportTarget = std::make_shared<ViewportTarget>(
+            d->renderingThread->shaderCompiler());
+    d->viewportTarget->setPresentMode(d->presentMode);
+    d->viewportTarget->setUpscaleFilter(d->upscaleFilter);
+    if (!d->presentTimer)
+        d->presentTimer = std::make_shared<GpuTimer>(1);
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point presentStart = Clock::now();
+
+    // Allow the thread to request a new update from now on.
+    d->renderingThread->framePacer()->updateDelivered();
+
+    // Take the newest frame from the rendering thread. This does not
+    // wait for the thread to finish the frame it is rendering. If no
+    // frame has been rendered since the previous paint, e.g. in the
+    // render-on-demand mode, the previous frame is presented again.
+    const SwapChain::Frame frame = d->renderingThread->acquireFrame();
+    if (frame.texture == 0)
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        d->fullPresent = true;
+        return;
+    }
+
+    // The widget keeps the previously presented frame. If it is the
+    // frame before this one then only the damage of this frame is
+    // presented, and nothing if the same frame is presented again.
+    const int pixelRatio = devicePixelRatio();
+    const QSize targetSize(width() * pixelRatio, height() * pixelRatio);
+    std::vector<glm::ivec4> rects;
+    const bool partial = !d->fullPresent &&
+                         frame.size == d->paintedSize &&
+                         (frame.number == d->paintedFrame ||
+                          frame.number == d->paintedFrame + 1);
+    if (partial && frame.number != d->paintedFrame)
+        for (const QRect& r : frame.damage)
+            rects.push_back(targetRect(r, frame.size, targetSize));
+
+    // The overlay is drawn with translucent colors so it is always
+    // presented again under the overlay.
+    if (partial && d->hudVisible && d->hudHeight > 0)
+    {
+        const int h = d->hudHeight * pixelRatio;
+        rects.push_back(glm::ivec4(0, targetSize.height() - h,
+                                   targetSize.width(), h));
+    }
+
+    // Present only the frame area of the framebuffer texture.
+    d->presentTimer->beginFrame();
+    d->presentTimer->begin(0);
+    if (!partial || !rects.empty())
+        d->viewportTarget->render(
+            frame.texture,
+            glm::ivec2(frame.size.width(), frame.size.height()),
+            glm::ivec2(frame.textureSize.width(),
+                       frame.textureSize.height()),
+            defaultFramebufferObject(),
+            glm::ivec2(targetSize.width(), targetSize.height()),
+            rects);
+    d->presentTimer->end(0);
+    d->renderingThread->releaseFrame();
+    d->paintedFrame = frame.number;
+    d->paintedSize  = frame.size;
+    d->fullPresent  = false;
+
+    using namespace std::chrono;
+    const duration<double, std::milli> presentTime =
+        Clock::now() - presentStart;
+    d->renderingThread->reportPresentTime(presentTime.count(),
+                                          d->presentTimer->elapsed(0));
+
+    // Draw the statistics on top of the frame.
+    if (d->hudVisible)
+    {
+        QPainter painter(this);
+        d->hudHeight =
+            drawHud(painter, d->renderingThread->stats()).height();
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void Widget::resizeGL(int w, int h)
+{
+    d->fullPresent = true;
+    if (d->renderingThread)
+        d->renderingThread->setFramebufferSize(QSize(w, h));
+}
+
+/* ---------------------------------------------------------------- */
 
-    d->renderingThread->lock();
-    const GLuint textureId =
-        d->renderingThread->framebufferTexture();
-    d->viewportTarget->render(textureId);
-    d->renderingThread->unlock();
+void Widget::keyPressEvent(QKeyEvent* e)
+{
+    switch (e->key())
+    {
+        case Qt::Key_B:
+            if (d->presentMode == ViewportTarget::PresentMode::Draw)
+                setPresentMode(ViewportTarget::PresentMode::Blit);
+            else
+                setPresentMode(ViewportTarget::PresentMode::Draw);
+            break;
+
+        case Qt::Key_H:
+            setHudVisible(!d->hudVisible);
+            break;
+
+        case Qt::Key_D:
+            setRenderOnDemand(!d->renderOnDemand);
+            break;
+
+        case Qt::Key_Space:
+            setAnimated(!d->animated);
+            break;
+
+        case Qt::Key_R:
+        {
+            ResolutionGovernor::Settings settings = d->resolutionScaling;
+            settings.enabled = !settings.enabled;
+            setResolutionScaling(settings);
+            break;
+        }
+
+        case Qt::Key_F:
+            if (d->upscaleFilter ==
+                ViewportTarget::UpscaleFilter::Bilinear)
+            {
+                setUpscaleFilter(ViewportTarget::UpscaleFilter::Sharpen);
+            }
+            else
+            {
+                setUpscaleFilter(ViewportTarget::UpscaleFilter::Bilinear);
+            }
+            break;
+
+        // Let the parent widgets and the shortcuts see the other keys.
+        default:
+            QOpenGLWidget::keyPressEvent(e);
+            break;
+    }
 }
 
 /* ---------------------------------------------------------------- */
@@ -7,6 +7,9 @@
 #pragma once
 
 #include <memory>
+#include "frame_pacer.h"
+#include "resolution_governor.h"
+#include "opengl_viewport_target.h"
 #ifdef _WIN32
     #include "opengl.h"
     #include <QtWidgets/QOpenGLWidget>
@@ -24,8 +27,12 @@ namespace opengl
     An widget with OpenGL rendering capabilities.
 
     The widget will render an offscreen framebuffer into screen that
-    was created by a rendering thread. The framebuffer size matches
-    the widget size when the thread was started.
+    was created by a rendering thread. The framebuffer size follows
+    the widget size, resizing does not restart the thread.
+
+    The widget keeps its content between the paints. When the frame
+    follows the previously presented frame only its damaged part is
+    presented.
 
     Below is a code snipped how to create the widget with correct
     surface format.
@@ -73,8 +80,102 @@ public:
      **/
     void stopThread();
 
+    /**
+        Sets the frame pacing settings of the rendering thread.
+
+        The refresh rate of the settings is overridden with the
+        refresh rate of the screen when the thread is started.
+     **/
+    void setFramePacing(const FramePacer::Settings& settings);
+
+    /**
+        Sets the resolution scaling settings of the rendering thread.
+        Can be changed while the thread is running. The R key toggles
+        the scaling.
+     **/
+    void setResolutionScaling(const ResolutionGovernor::Settings& settings);
+
+    /**
+        Sets the render-on-demand mode of the rendering thread. In the
+        mode the thread renders only when the scene changes or a
+        frame is requested, and the widget presents the previous frame
+        again when it is painted. The D key toggles the mode.
+     **/
+    void setRenderOnDemand(bool onDemand);
+
+    /**
+        Requests the rendering thread to render a frame.
+     **/
+    void requestFrame();
+
+    /**
+        Sets the quads rotating. The space key toggles the rotation.
+     **/
+    void setAnimated(bool animated);
+
+    /**
+        Sets the count of quads rendered by the thread. Takes effect
+        when the thread is started.
+     **/
+    void setQuadCount(int count);
+
+    /**
+        Sets the count of job workers of the thread, -1 to size by the
+        hardware threads. Takes effect when the thread is started.
+     **/
+    void setJobWorkerCount(int count);
+
+    /**
+        Sets the mesh file rendered with the quads. Takes effect when
+        the thread is started.
+     **/
+    void setMeshFile(const QString& path);
+
+    /**
+        Sets the image file that textures the quads. Takes effect
+        when the thread is started.
+     **/
+    void setTextureFile(const QString& path);
+
+    /**
+        Sets the image files packed into a texture atlas that
+        textures the quads. Takes effect when the thread is started.
+     **/
+    void setAtlasFiles(const QStringList& paths);
+
+    /**
+        Sets the mode how the frames are presented. Can be changed
+        while the thread is running. The B key toggles the mode.
+     **/
+    void setPresentMode(ViewportTarget::PresentMode mode);
+
+    /**
+        Returns the mode how the frames are presented.
+     **/
+    ViewportTarget::PresentMode presentMode() const;
+
+    /**
+        Sets the filter that upscales the frames rendered with a
+        lower resolution. The F key toggles the filter.
+     **/
+    void setUpscaleFilter(ViewportTarget::UpscaleFilter filter);
+
+    /**
+        Sets the statistics overlay visible. The overlay shows the
+        CPU and GPU times of the rendering thread and of the frame
+        present. The H key toggles the overlay.
+     **/
+    void setHudVisible(bool visible);
+
+    /**
+        Returns true if the statistics overlay is visible.
+     **/
+    bool isHudVisible() const;
+
 protected:
     void paintGL();
+    void resizeGL(int w, int h);
+    void keyPressEvent(QKeyEvent* e);
     void closeEvent(QCloseEvent* e);
 
 private:
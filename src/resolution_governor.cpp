@@ -0,0 +1,110 @@
+/**
+    @file   resolution_governor.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::ResolutionGovernor class.
+ **/
+
+#include "resolution_governor.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace kuu
+{
+
+namespace
+{
+
+// Limits of the scale change per window. The scale is lowered
+// faster than it is raised so that an overloaded GPU recovers
+// quickly and the resolution does not oscillate.
+const double MinStep = 0.75;
+const double MaxStep = 1.1;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+ResolutionGovernor::ResolutionGovernor()
+{}
+
+/* ---------------------------------------------------------------- */
+
+void ResolutionGovernor::setSettings(const Settings& settings)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    settings_ = settings;
+    settings_.minScale = std::max(settings_.minScale, 0.1);
+    settings_.maxScale = std::max(settings_.maxScale, settings_.minScale);
+    settings_.window   = std::max(settings_.window, 1);
+    scale_ = std::min(std::max(scale_, settings_.minScale),
+                      settings_.maxScale);
+    cpuTimes_.clear();
+    gpuTimes_.clear();
+}
+
+/* ---------------------------------------------------------------- */
+
+ResolutionGovernor::Settings ResolutionGovernor::settings() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return settings_;
+}
+
+/* ---------------------------------------------------------------- */
+
+double ResolutionGovernor::update(double cpuTime, double gpuTime)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!settings_.enabled)
+    {
+        scale_ = 1.0;
+        return scale_;
+    }
+
+    // Skip the frames whose GPU time is not yet known.
+    if (gpuTime <= 0.0)
+        return scale_;
+
+    cpuTimes_.push_back(cpuTime);
+    gpuTimes_.push_back(gpuTime);
+    if (int(gpuTimes_.size()) < settings_.window)
+        return scale_;
+
+    // The worst GPU time of the window must fit into the budget. The
+    // budget is never shorter than the average CPU time as the frame
+    // is at least that long.
+    const double gpu = *std::max_element(gpuTimes_.begin(),
+                                         gpuTimes_.end());
+    const double cpu =
+        std::accumulate(cpuTimes_.begin(), cpuTimes_.end(), 0.0) /
+        cpuTimes_.size();
+    const double budget = std::max(settings_.targetFrameTime, cpu);
+    cpuTimes_.clear();
+    gpuTimes_.clear();
+
+    // Change the scale only outside of the band between the headroom
+    // and the budget, then aim at the middle of the band. The GPU
+    // time is assumed to follow the pixel count.
+    if (gpu > budget || gpu < budget * settings_.headroom)
+    {
+        const double aim = budget * (1.0 + settings_.headroom) * 0.5;
+        const double step = std::min(std::max(std::sqrt(aim / gpu),
+                                              MinStep),
+                                     MaxStep);
+        scale_ = std::min(std::max(scale_ * step, settings_.minScale),
+                          settings_.maxScale);
+    }
+    return scale_;
+}
+
+/* ---------------------------------------------------------------- */
+
+double ResolutionGovernor::scale() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scale_;
+}
+
+} // namespace kuu
@@ -0,0 +1,102 @@
+/**
+    @file   resolution_governor.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::ResolutionGovernor class.
+ **/
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+namespace kuu
+{
+
+/**
+    @brief   Scales the render resolution to hold a frame time budget.
+
+    @details The rendering thread calls @ref update after each frame
+             with the CPU and GPU times of the frame and renders the
+             next frame with the returned scale of the full
+             resolution. The scale applies to both dimensions, so the
+             pixel count changes with the square of the scale.
+
+             Only the GPU time depends on the resolution. The
+             governor keeps the worst GPU time of a window of recent
+             frames under the budget: if the time is over the budget
+             the scale is lowered, if it has enough headroom the scale
+             is raised. The step is estimated from the ratio of the
+             budget and the GPU time and limited so that a single
+             slow frame does not drop the resolution at once.
+
+             The CPU and GPU work of a frame overlap, so a frame is as
+             long as the longer of the two. When the CPU time is over
+             the budget a lower resolution would not make the frames
+             shorter, the governor then lets the GPU time grow up to
+             the CPU time.
+
+             As the GPU times are read a few frames late, the scale is
+             changed only once per window.
+ **/
+class ResolutionGovernor
+{
+public:
+    /**
+        Governor settings.
+     **/
+    struct Settings
+    {
+        // True if the resolution is scaled.
+        bool enabled = false;
+        // Frame time budget in milliseconds.
+        double targetFrameTime = 1000.0 / 60.0;
+        // Scale bounds of the resolution.
+        double minScale = 0.5;
+        double maxScale = 1.0;
+        // Count of frames in a window.
+        int window = 8;
+        // Fraction of the budget the GPU time must be under before
+        // the scale is raised.
+        double headroom = 0.85;
+    };
+
+    /**
+        Constructs the governor with the default settings.
+     **/
+    ResolutionGovernor();
+
+    /**
+        Sets the settings. Can be called from any thread.
+     **/
+    void setSettings(const Settings& settings);
+
+    /**
+        Returns the settings.
+     **/
+    Settings settings() const;
+
+    /**
+        @brief  Adds the times of a frame.
+        @param  cpuTime The CPU time of the frame in milliseconds.
+        @param  gpuTime The GPU time of the frame in milliseconds,
+                        0 if not yet known.
+        @return The scale of the next frame.
+     **/
+    double update(double cpuTime, double gpuTime);
+
+    /**
+        Returns the current scale.
+     **/
+    double scale() const;
+
+private:
+    mutable std::mutex mutex_;
+    Settings settings_;
+    double scale_ = 1.0;
+
+    // Times of the current window.
+    std::vector<double> cpuTimes_;
+    std::vector<double> gpuTimes_;
+};
+
+} // namespace kuu
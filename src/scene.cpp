@@ -0,0 +1,365 @@
+/**
+    @file   scene.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::Scene class.
+ **/
+
+#include "scene.h"
+#include <iostream>
+#include <vector>
+#include "aligned_allocator.h"
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   The data of the scene.
+ * ---------------------------------------------------------------- */
+struct Scene::Data
+{
+    // Returns the dense index of the handle or -1.
+    int indexOf(const Handle& handle) const
+    {
+        if (handle.index >= slots.size())
+            return -1;
+        const Slot& slot = slots[handle.index];
+        if (slot.generation != handle.generation ||
+            slot.index == InvalidId)
+        {
+            return -1;
+        }
+        return int(slot.index);
+    }
+
+    // Moves the object from one dense index to another.
+    void move(int from, int to)
+    {
+        transforms[to]    = transforms[from];
+        positions[to]     = positions[from];
+        orientations[to]  = orientations[from];
+        rotationRates[to] = rotationRates[from];
+        colors[to]        = colors[from];
+        uvRects[to]       = uvRects[from];
+        visibility[to]    = visibility[from];
+        meshIds[to]       = meshIds[from];
+        shaderIds[to]     = shaderIds[from];
+        owners[to]        = owners[from];
+        slots[owners[to]].index = uint32_t(to);
+    }
+
+    // Removes the last object from the arrays.
+    void popBack()
+    {
+        transforms.pop_back();
+        positions.pop_back();
+        orientations.pop_back();
+        rotationRates.pop_back();
+        colors.pop_back();
+        uvRects.pop_back();
+        visibility.pop_back();
+        meshIds.pop_back();
+        shaderIds.pop_back();
+        owners.pop_back();
+    }
+
+    // Handle slots. The slot of a removed object is reused and its
+    // generation is increased to tell the old handles apart.
+    struct Slot
+    {
+        uint32_t index;      // dense index or InvalidId if free
+        uint32_t generation;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    // The object properties.
+    AlignedVector<glm::mat4> transforms;
+    AlignedVector<glm::vec4> positions;
+    AlignedVector<glm::quat> orientations;
+    AlignedVector<float> rotationRates;
+    AlignedVector<glm::u8vec4> colors;
+    AlignedVector<glm::vec4> uvRects;
+    AlignedVector<uint8_t> visibility;
+    AlignedVector<MeshId> meshIds;
+    AlignedVector<ShaderId> shaderIds;
+    // The slot of each object.
+    std::vector<uint32_t> owners;
+
+    int visibleCount = 0;
+
+    std::vector<std::shared_ptr<opengl::Mesh>> meshes;
+    std::vector<std::shared_ptr<opengl::Shader>> shaders;
+};
+
+/* ---------------------------------------------------------------- */
+
+Scene::Scene()
+    : d(std::make_shared<Data>())
+{}
+
+/* ---------------------------------------------------------------- */
+
+Scene::MeshId Scene::addMesh(std::shared_ptr<opengl::Mesh> mesh)
+{
+    d->meshes.push_back(mesh);
+    return MeshId(d->meshes.size() - 1);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::setMesh(MeshId id, std::shared_ptr<opengl::Mesh> mesh)
+{
+    if (id >= d->meshes.size())
+    {
+        std::cerr << __FUNCTION__ << ": "
+                  << "invalid mesh ID " << id
+                  << std::endl;
+        return;
+    }
+    d->meshes[id] = mesh;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<opengl::Mesh> Scene::mesh(MeshId id) const
+{
+    if (id >= d->meshes.size())
+        return nullptr;
+    return d->meshes[id];
+}
+
+/* ---------------------------------------------------------------- */
+
+Scene::ShaderId Scene::addShader(std::shared_ptr<opengl::Shader> shader)
+{
+    d->shaders.push_back(shader);
+    return ShaderId(d->shaders.size() - 1);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::setShader(ShaderId id,
+                      std::shared_ptr<opengl::Shader> shader)
+{
+    if (id >= d->shaders.size())
+    {
+        std::cerr << __FUNCTION__ << ": "
+                  << "invalid shader ID " << id
+                  << std::endl;
+        return;
+    }
+    d->shaders[id] = shader;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::shared_ptr<opengl::Shader> Scene::shader(ShaderId id) const
+{
+    if (id >= d->shaders.size())
+        return nullptr;
+    return d->shaders[id];
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::reserve(int count)
+{
+    d->transforms.reserve(count);
+    d->positions.reserve(count);
+    d->orientations.reserve(count);
+    d->rotationRates.reserve(count);
+    d->colors.reserve(count);
+    d->uvRects.reserve(count);
+    d->visibility.reserve(count);
+    d->meshIds.reserve(count);
+    d->shaderIds.reserve(count);
+    d->owners.reserve(count);
+    d->slots.reserve(count);
+}
+
+/* ---------------------------------------------------------------- */
+
+Scene::Handle Scene::create(const Object& object)
+{
+    const uint32_t index = uint32_t(d->owners.size());
+
+    uint32_t slotIndex;
+    if (d->freeSlots.empty())
+    {
+        Data::Slot slot;
+        slot.index = index;
+        slot.generation = 0;
+        slotIndex = uint32_t(d->slots.size());
+        d->slots.push_back(slot);
+    }
+    else
+    {
+        slotIndex = d->freeSlots.back();
+        d->freeSlots.pop_back();
+        d->slots[slotIndex].index = index;
+    }
+
+    d->transforms.push_back(glm::mat4(1.0f));
+    d->positions.push_back(glm::vec4(object.position, object.scale));
+    d->orientations.push_back(object.orientation);
+    d->rotationRates.push_back(object.rotationRate);
+    d->colors.push_back(object.color);
+    d->uvRects.push_back(object.uvRect);
+    d->visibility.push_back(object.visible ? 1 : 0);
+    d->meshIds.push_back(object.mesh);
+    d->shaderIds.push_back(object.shader);
+    d->owners.push_back(slotIndex);
+    if (object.visible)
+        d->visibleCount++;
+
+    updateTransforms(int(index), int(index) + 1);
+
+    Handle handle;
+    handle.index = slotIndex;
+    handle.generation = d->slots[slotIndex].generation;
+    return handle;
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::destroy(const Handle& handle)
+{
+    const int index = d->indexOf(handle);
+    if (index < 0)
+        return;
+
+    if (d->visibility[index])
+        d->visibleCount--;
+
+    // Swap and pop: the last object fills the hole.
+    const int last = int(d->owners.size()) - 1;
+    if (index != last)
+        d->move(last, index);
+    d->popBack();
+
+    Data::Slot& slot = d->slots[handle.index];
+    slot.index = InvalidId;
+    slot.generation++;
+    d->freeSlots.push_back(handle.index);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::clear()
+{
+    while (!d->owners.empty())
+        destroy(handle(int(d->owners.size()) - 1));
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Scene::contains(const Handle& handle) const
+{ return d->indexOf(handle) >= 0; }
+
+/* ---------------------------------------------------------------- */
+
+int Scene::indexOf(const Handle& handle) const
+{ return d->indexOf(handle); }
+
+/* ---------------------------------------------------------------- */
+
+Scene::Handle Scene::handle(int index) const
+{
+    Handle out;
+    if (index < 0 || index >= size())
+        return out;
+    out.index = d->owners[index];
+    out.generation = d->slots[out.index].generation;
+    return out;
+}
+
+/* ---------------------------------------------------------------- */
+
+int Scene::size() const
+{ return int(d->owners.size()); }
+
+/* ---------------------------------------------------------------- */
+
+int Scene::visibleCount() const
+{ return d->visibleCount; }
+
+/* ---------------------------------------------------------------- */
+
+void Scene::setVisible(const Handle& handle, bool visible)
+{
+    const int index = d->indexOf(handle);
+    if (index < 0 || bool(d->visibility[index]) == visible)
+        return;
+    d->visibility[index] = visible ? 1 : 0;
+    d->visibleCount += visible ? 1 : -1;
+}
+
+/* ---------------------------------------------------------------- */
+
+glm::mat4* Scene::transforms()
+{ return d->transforms.data(); }
+const glm::mat4* Scene::transforms() const
+{ return d->transforms.data(); }
+glm::vec4* Scene::positions()
+{ return d->positions.data(); }
+const glm::vec4* Scene::positions() const
+{ return d->positions.data(); }
+glm::quat* Scene::orientations()
+{ return d->orientations.data(); }
+const glm::quat* Scene::orientations() const
+{ return d->orientations.data(); }
+float* Scene::rotationRates()
+{ return d->rotationRates.data(); }
+const float* Scene::rotationRates() const
+{ return d->rotationRates.data(); }
+glm::u8vec4* Scene::colors()
+{ return d->colors.data(); }
+const glm::u8vec4* Scene::colors() const
+{ return d->colors.data(); }
+glm::vec4* Scene::uvRects()
+{ return d->uvRects.data(); }
+const glm::vec4* Scene::uvRects() const
+{ return d->uvRects.data(); }
+const uint8_t* Scene::visibility() const
+{ return d->visibility.data(); }
+const Scene::MeshId* Scene::meshIds() const
+{ return d->meshIds.data(); }
+const Scene::ShaderId* Scene::shaderIds() const
+{ return d->shaderIds.data(); }
+
+/* ---------------------------------------------------------------- */
+
+void Scene::rotate(float seconds, int begin, int end)
+{
+    const float* rates = d->rotationRates.data();
+    glm::quat* orientations = d->orientations.data();
+    const glm::vec3 axis(0.0f, 1.0f, 0.0f);
+    for (int i = begin; i < end; ++i)
+    {
+        if (rates[i] == 0.0f)
+            continue;
+        const glm::quat q = glm::angleAxis(rates[i] * seconds, axis);
+        orientations[i] = glm::normalize(q * orientations[i]);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void Scene::updateTransforms(int begin, int end)
+{
+    const glm::vec4* positions = d->positions.data();
+    const glm::quat* orientations = d->orientations.data();
+    glm::mat4* transforms = d->transforms.data();
+    for (int i = begin; i < end; ++i)
+    {
+        const glm::vec4& p = positions[i];
+        glm::mat4 m = glm::mat4_cast(orientations[i]);
+        m[0] *= p.w;
+        m[1] *= p.w;
+        m[2] *= p.w;
+        m[3] = glm::vec4(p.x, p.y, p.z, 1.0f);
+        transforms[i] = m;
+    }
+}
+
+} // namespace kuu
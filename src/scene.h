@@ -0,0 +1,235 @@
+/**
+    @file   scene.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::Scene class.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+namespace kuu
+{
+
+namespace opengl
+{
+class Mesh;
+class Shader;
+}
+
+/**
+    @brief   A store of scene objects in structure-of-arrays layout.
+
+    @details Each property of the objects is kept in its own contiguous
+             array that starts at a 16-byte boundary: the transforms,
+             the positions and scales, the orientations, the rotation
+             rates, the colors, the texture rectangles, the visibility
+             flags and the mesh and shader IDs. A pass over the
+             objects reads only the arrays it needs, in order, and the
+             arrays can be split into ranges for parallel jobs.
+
+             The arrays are dense, index 0 to @ref size - 1. An object
+             is removed by moving the last object into its place, so
+             the dense index of an object can change. A @ref Handle
+             stays valid until its object is removed and it is the
+             only way to keep a reference to an object. A handle of a
+             removed object is detected by its generation.
+
+             Objects that share a mesh and a shader refer to them by
+             ID instead of each holding the OpenGL objects. The mesh
+             or shader of an ID can be replaced, e.g. when a shader is
+             compiled again, without touching the objects.
+
+    @code
+    Scene scene;
+    const Scene::MeshId mesh = scene.addMesh(quadMesh);
+    Scene::Object object;
+    object.position = glm::vec3(1.0f, 0.0f, 0.0f);
+    object.mesh = mesh;
+    const Scene::Handle handle = scene.create(object);
+    ...
+    scene.rotate(elapsedSeconds, 0, scene.size());
+    scene.updateTransforms(0, scene.size());
+    ...
+    scene.destroy(handle);
+    @endcode
+ **/
+class Scene
+{
+public:
+    typedef uint32_t MeshId;
+    typedef uint32_t ShaderId;
+
+    // ID of no mesh or shader.
+    static const uint32_t InvalidId = 0xffffffffu;
+
+    /**
+        A stable reference to an object.
+     **/
+    struct Handle
+    {
+        uint32_t index = InvalidId;
+        uint32_t generation = 0;
+
+        bool operator==(const Handle& other) const
+        { return index == other.index && generation == other.generation; }
+        bool operator!=(const Handle& other) const
+        { return !(*this == other); }
+    };
+
+    /**
+        The properties of a new object.
+     **/
+    struct Object
+    {
+        glm::vec3 position = glm::vec3(0.0f);
+        // Uniform scale.
+        float scale = 1.0f;
+        glm::quat orientation;
+        // Rotation speed around the Y-axis in radians per second.
+        float rotationRate = 0.0f;
+        glm::u8vec4 color = glm::u8vec4(255, 255, 255, 255);
+        // Texture coordinates (u0, v0, u1, v1) of the image.
+        glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        bool visible = true;
+        MeshId mesh = InvalidId;
+        ShaderId shader = InvalidId;
+    };
+
+    /**
+        Constructs an empty scene.
+     **/
+    Scene();
+
+    /**
+        Adds the mesh, it can be nullptr until the mesh exists.
+        Returns the ID of the mesh.
+     **/
+    MeshId addMesh(std::shared_ptr<opengl::Mesh> mesh);
+
+    /**
+        Replaces the mesh of the ID.
+     **/
+    void setMesh(MeshId id, std::shared_ptr<opengl::Mesh> mesh);
+
+    /**
+        Returns the mesh of the ID or nullptr.
+     **/
+    std::shared_ptr<opengl::Mesh> mesh(MeshId id) const;
+
+    /**
+        Adds the shader, it can be nullptr until the shader is
+        compiled. Returns the ID of the shader.
+     **/
+    ShaderId addShader(std::shared_ptr<opengl::Shader> shader);
+
+    /**
+        Replaces the shader of the ID.
+     **/
+    void setShader(ShaderId id, std::shared_ptr<opengl::Shader> shader);
+
+    /**
+        Returns the shader of the ID or nullptr.
+     **/
+    std::shared_ptr<opengl::Shader> shader(ShaderId id) const;
+
+    /**
+        Reserves the arrays for the count of objects.
+     **/
+    void reserve(int count);
+
+    /**
+        Creates an object at the end of the arrays.
+     **/
+    Handle create(const Object& object);
+
+    /**
+        @brief   Removes the object.
+        @details The last object is moved into the place of the
+                 removed one. Does nothing if the handle is not valid.
+     **/
+    void destroy(const Handle& handle);
+
+    /**
+        Removes all the objects. The meshes and shaders are kept.
+     **/
+    void clear();
+
+    /**
+        Returns true if the handle refers to an existing object.
+     **/
+    bool contains(const Handle& handle) const;
+
+    /**
+        Returns the index of the object in the arrays or -1.
+     **/
+    int indexOf(const Handle& handle) const;
+
+    /**
+        Returns the handle of the object at the index.
+     **/
+    Handle handle(int index) const;
+
+    /**
+        Returns the count of objects.
+     **/
+    int size() const;
+
+    /**
+        Returns the count of visible objects.
+     **/
+    int visibleCount() const;
+
+    /**
+        Shows or hides the object.
+     **/
+    void setVisible(const Handle& handle, bool visible);
+
+    /**
+        @brief   The arrays of the object properties.
+        @details Each has @ref size items. The pointers are valid until
+                 an object is created or removed.
+     **/
+    glm::mat4* transforms();
+    const glm::mat4* transforms() const;
+    // Position in xyz and the uniform scale in w.
+    glm::vec4* positions();
+    const glm::vec4* positions() const;
+    glm::quat* orientations();
+    const glm::quat* orientations() const;
+    float* rotationRates();
+    const float* rotationRates() const;
+    glm::u8vec4* colors();
+    const glm::u8vec4* colors() const;
+    glm::vec4* uvRects();
+    const glm::vec4* uvRects() const;
+    // Non-zero if visible, changed with setVisible.
+    const uint8_t* visibility() const;
+    const MeshId* meshIds() const;
+    const ShaderId* shaderIds() const;
+
+    /**
+        Rotates the objects of the range [begin, end) around their
+        Y-axis by their rotation rates.
+        @param seconds The elapsed time in seconds.
+     **/
+    void rotate(float seconds, int begin, int end);
+
+    /**
+        Builds the transforms of the objects of the range [begin,
+        end) from their positions, scales and orientations.
+     **/
+    void updateTransforms(int begin, int end);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace kuu
@@ -0,0 +1,311 @@
+/**
+    @file   simulation_thread.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::SimulationThread class.
+ **/
+
+#include "simulation_thread.h"
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace kuu
+{
+
+namespace
+{
+
+// Maximum count of steps taken at once. If the thread falls further
+// behind, e.g. after being suspended, the missed time is dropped.
+const int MaxCatchUpSteps = 8;
+
+// Count of orientations interpolated in a job.
+const int QuadsPerJob = 1024;
+
+// Flag of the triple buffer index that is set when the middle buffer
+// holds a pair the consumer has not taken yet.
+const int Fresh = 4;
+
+/* ---------------------------------------------------------------- *
+   The orientations of the quads after a step.
+ * ---------------------------------------------------------------- */
+struct Snapshot
+{
+    uint64_t step = 0;
+    SimulationThread::Clock::time_point time;
+    std::vector<glm::quat> orientations;
+};
+
+/* ---------------------------------------------------------------- *
+   The two newest snapshots. The pair is still if both are of the
+   same step.
+ * ---------------------------------------------------------------- */
+struct SnapshotPair
+{
+    Snapshot previous;
+    Snapshot current;
+};
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   The data of the simulation thread.
+ * ---------------------------------------------------------------- */
+struct SimulationThread::Data
+{
+    Data(const std::vector<float>& speeds,
+         double stepRate,
+         const std::function<void()>& stepped)
+        : stepRate(std::max(stepRate, 1.0))
+        , stepDuration(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(1.0 / this->stepRate)))
+        , stepped(stepped)
+        , previous(speeds.size())
+        , current(speeds.size())
+    {
+        // The rotation of a step of each quad.
+        const double seconds = 1.0 / this->stepRate;
+        for (float speed : speeds)
+            rotations.push_back(glm::angleAxis(float(speed * seconds),
+                                               glm::vec3(0, 1, 0)));
+
+        // Every buffer starts with the still initial orientations.
+        time = Clock::now();
+        for (SnapshotPair& pair : buffers)
+        {
+            pair.current.time = time;
+            pair.current.orientations = current;
+            pair.previous = pair.current;
+        }
+    }
+
+    ~Data()
+    { stop(); }
+
+    // Stops the thread.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exiting = true;
+        }
+        condition.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // Advances the orientations by a step.
+    void advance()
+    {
+        std::swap(previous, current);
+        for (size_t i = 0; i < current.size(); ++i)
+            current[i] = glm::normalize(previous[i] * rotations[i]);
+        step++;
+    }
+
+    // Publishes the snapshots before and after the last step. A
+    // still pair has the current orientations in both snapshots.
+    void publish(bool still)
+    {
+        SnapshotPair& pair = buffers[back];
+        pair.current.step = step;
+        pair.current.time = time;
+        pair.current.orientations = current;
+        if (still)
+        {
+            pair.previous = pair.current;
+        }
+        else
+        {
+            pair.previous.step = step - 1;
+            pair.previous.time = time - stepDuration;
+            pair.previous.orientations = previous;
+        }
+
+        // Swap the written buffer with the middle buffer.
+        back = middle.exchange(back | Fresh,
+                               std::memory_order_acq_rel) & ~Fresh;
+
+        if (stepped)
+            stepped();
+    }
+
+    // Runs the simulation until stopped.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        time = Clock::now();
+        while (!exiting)
+        {
+            // Sleep while the quads do not rotate. The paused time is
+            // not simulated afterwards.
+            if (!animated)
+            {
+                lock.unlock();
+                publish(true);
+                lock.lock();
+                condition.wait(lock, [this]()
+                { return exiting || animated; });
+                time = Clock::now();
+                continue;
+            }
+
+            // Sleep until the next step is due.
+            const Clock::time_point next = time + stepDuration;
+            if (condition.wait_until(lock, next, [this]()
+                { return exiting || !animated; }))
+            {
+                continue;
+            }
+            lock.unlock();
+
+            // Take the due steps.
+            const Clock::time_point now = Clock::now();
+            int steps = 0;
+            while (time + stepDuration <= now && steps < MaxCatchUpSteps)
+            {
+                advance();
+                time += stepDuration;
+                steps++;
+            }
+            if (time + stepDuration <= now)
+                time = now;
+
+            if (steps > 0)
+                publish(false);
+            lock.lock();
+        }
+    }
+
+    double stepRate;
+    Clock::duration stepDuration;
+    std::function<void()> stepped;
+    // Interpolates the orientations in parallel, nullptr if none.
+    std::shared_ptr<JobSystem> jobs;
+
+    // Thread and its state, guarded by mutex.
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    bool exiting  = false;
+    bool animated = true;
+
+    // Producer: orientations before and after the last step, the
+    // rotations of a step, the step number and the step time.
+    std::vector<glm::quat> previous;
+    std::vector<glm::quat> current;
+    std::vector<glm::quat> rotations;
+    uint64_t step = 0;
+    Clock::time_point time;
+
+    // Triple buffer of snapshot pairs. The producer writes into the
+    // back buffer and the consumer reads from the front buffer, the
+    // two swap their buffer with the middle one.
+    SnapshotPair buffers[3];
+    int back = 0;
+    std::atomic<int> middle { 1 | Fresh };
+    int front = 2;
+};
+
+/* ---------------------------------------------------------------- */
+
+SimulationThread::SimulationThread(const std::vector<float>& speeds,
+                                   double stepRate,
+                                   const std::function<void()>& stepped)
+    : d(std::make_shared<Data>(speeds, stepRate, stepped))
+{}
+
+/* ---------------------------------------------------------------- */
+
+void SimulationThread::start()
+{
+    if (d->thread.joinable())
+        return;
+
+    d->exiting = false;
+    Data* data = d.get();
+    d->thread = std::thread([data]() { data->run(); });
+}
+
+/* ---------------------------------------------------------------- */
+
+void SimulationThread::stop()
+{ d->stop(); }
+
+/* ---------------------------------------------------------------- */
+
+void SimulationThread::setAnimated(bool animated)
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        d->animated = animated;
+    }
+    d->condition.notify_all();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool SimulationThread::isAnimated() const
+{
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->animated;
+}
+
+/* ---------------------------------------------------------------- */
+
+double SimulationThread::stepRate() const
+{ return d->stepRate; }
+
+/* ---------------------------------------------------------------- */
+
+void SimulationThread::setJobSystem(std::shared_ptr<JobSystem> jobs)
+{ d->jobs = jobs; }
+
+/* ---------------------------------------------------------------- */
+
+bool SimulationThread::interpolate(Clock::time_point time,
+                                   std::vector<glm::quat>& orientations)
+{
+    // Take the newest pair if one has been published.
+    const bool fresh =
+        (d->middle.load(std::memory_order_acquire) & Fresh) != 0;
+    if (fresh)
+        d->front = d->middle.exchange(d->front,
+                                      std::memory_order_acq_rel) & ~Fresh;
+
+    // A still pair is interpolated only once.
+    const SnapshotPair& pair = d->buffers[d->front];
+    const bool still = pair.previous.step == pair.current.step;
+    if (still && !fresh)
+        return false;
+
+    // Render one step behind the simulation: the current snapshot is
+    // reached one step after its time.
+    using namespace std::chrono;
+    const double t =
+        duration<double>(time - pair.current.time).count() *
+        d->stepRate;
+    const float alpha = still ? 1.0f
+                              : float(std::min(std::max(t, 0.0), 1.0));
+
+    const std::vector<glm::quat>& q0 = pair.previous.orientations;
+    const std::vector<glm::quat>& q1 = pair.current.orientations;
+    orientations.resize(q1.size());
+    const auto slerp = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+            orientations[i] = glm::slerp(q0[i], q1[i], alpha);
+    };
+    if (d->jobs)
+        d->jobs->parallelFor(0, int(q1.size()), QuadsPerJob, slerp);
+    else
+        slerp(0, int(q1.size()));
+    return true;
+}
+
+} // namespace kuu
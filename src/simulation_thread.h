@@ -0,0 +1,124 @@
+/**
+    @file   simulation_thread.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::SimulationThread class.
+ **/
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <glm/gtc/quaternion.hpp>
+
+namespace kuu
+{
+
+class JobSystem;
+
+/**
+    @brief   Simulates the rotations of the quads with a fixed timestep
+             on its own thread.
+
+    @details The thread advances the orientations of the quads by a
+             fixed step, e.g. 120 times per second, independently of
+             the frame rate. A slow frame then never changes the
+             result of the simulation and a heavy simulation does not
+             delay the thread that feeds the GPU.
+
+             After the due steps the thread publishes a pair of
+             snapshots: the orientations before and after the last
+             step. The pairs are exchanged through a lock-free triple
+             buffer, so neither the simulation nor the rendering ever
+             waits for the other one.
+
+             The rendering thread calls @ref interpolate with the
+             steady clock time of the frame. The orientations are
+             interpolated between the two snapshots, the rendered
+             state is one step behind the simulation. The motion stays
+             smooth when the frame times jitter or the frame rate is
+             not a multiple of the step rate.
+
+    @code
+    SimulationThread simulation(speeds, 120.0);
+    simulation.start();
+    ...
+    // Rendering thread
+    if (simulation.interpolate(Clock::now(), orientations))
+        batch.setOrientations(orientations);
+    @endcode
+ **/
+class SimulationThread
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+        @brief Constructs the simulation. The thread is not started.
+        @param speeds   The rotation speeds of the quads around the
+                        Y-axis in radians per second.
+        @param stepRate The count of steps per second.
+        @param stepped  Called from the thread after the steps are
+                        published, e.g. to wake up the rendering.
+     **/
+    explicit SimulationThread(const std::vector<float>& speeds,
+                              double stepRate = 120.0,
+                              const std::function<void()>& stepped =
+                                  std::function<void()>());
+
+    /**
+        Starts the thread.
+     **/
+    void start();
+
+    /**
+        Stops the thread and waits until it has exited.
+     **/
+    void stop();
+
+    /**
+        @brief   Sets the quads rotating.
+        @details When the rotation stops the current orientations are
+                 published as a still pair of snapshots and the thread
+                 sleeps until the rotation continues. The default is
+                 true. Can be called from any thread.
+     **/
+    void setAnimated(bool animated);
+
+    /**
+        Returns true if the quads rotate.
+     **/
+    bool isAnimated() const;
+
+    /**
+        Returns the count of steps per second.
+     **/
+    double stepRate() const;
+
+    /**
+        Sets the job system that @ref interpolate uses to interpolate
+        the orientations in parallel. With nullptr they are
+        interpolated on the calling thread, this is the default.
+     **/
+    void setJobSystem(std::shared_ptr<JobSystem> jobs);
+
+    /**
+        @brief   Interpolates the orientations of the quads (consumer).
+        @details Takes the newest published pair of snapshots and
+                 interpolates between them. Must be called from a
+                 single thread, it never waits for the simulation.
+        @param   time         The time of the frame.
+        @param   orientations The interpolated orientations.
+        @return  False if the orientations are the same as in the
+                 previous call, then they are not written.
+     **/
+    bool interpolate(Clock::time_point time,
+                     std::vector<glm::quat>& orientations);
+
+private:
+    struct Data;
+    std::shared_ptr<Data> d;
+};
+
+} // namespace kuu
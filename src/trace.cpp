@@ -0,0 +1,205 @@
+/**
+    @file   trace.cpp
+    @author kuumies <kuumies@gmail.com>
+    @brief  Implementation of kuu::Trace class.
+ **/
+
+#include "trace.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kuu
+{
+
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   A recorded span.
+ * ---------------------------------------------------------------- */
+struct Event
+{
+    const char* name;
+    Trace::Clock::time_point start;
+    Trace::Clock::time_point end;
+};
+
+/* ---------------------------------------------------------------- *
+   Events of a single thread. Only the owner thread writes into the
+   buffer. The count is published with release semantics so that the
+   writer of the JSON sees the complete events.
+ * ---------------------------------------------------------------- */
+struct ThreadBuffer
+{
+    static const size_t Capacity = 1 << 16;
+
+    explicit ThreadBuffer(int id)
+        : id(id)
+        , name(nullptr)
+        , events(new Event[Capacity])
+        , count(0)
+        , dropped(0)
+    {}
+
+    int id;
+    std::atomic<const char*> name;
+    std::unique_ptr<Event[]> events;
+    std::atomic<size_t> count;
+    std::atomic<size_t> dropped;
+};
+
+/* ---------------------------------------------------------------- *
+   Buffers of all the threads that have recorded events. The buffers
+   are never freed so that the threads can exit before the events
+   are written. The mutex is locked only when a thread records for
+   the first time and when the JSON is written.
+ * ---------------------------------------------------------------- */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    Trace::Clock::time_point epoch = Trace::Clock::now();
+};
+
+Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the buffer of the calling thread.
+ * ---------------------------------------------------------------- */
+ThreadBuffer* threadBuffer()
+{
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        const int id = int(r.buffers.size()) + 1;
+        r.buffers.push_back(std::make_shared<ThreadBuffer>(id));
+        buffer = r.buffers.back().get();
+    }
+    return buffer;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the time point as microseconds since the epoch.
+ * ---------------------------------------------------------------- */
+double microseconds(Trace::Clock::time_point t,
+                    Trace::Clock::time_point epoch)
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::micro>>(t - epoch)
+        .count();
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- */
+
+std::atomic<bool> Trace::enabled_(false);
+
+/* ---------------------------------------------------------------- */
+
+void Trace::setEnabled(bool enabled)
+{
+    // Fix the epoch before the first event.
+    registry();
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Trace::setThreadName(const char* name)
+{
+    // Do not allocate a buffer for a thread that is not recorded.
+    if (!isEnabled())
+        return;
+    threadBuffer()->name.store(name, std::memory_order_release);
+}
+
+/* ---------------------------------------------------------------- */
+
+void Trace::record(const char* name,
+                   Clock::time_point start,
+                   Clock::time_point end)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    const size_t i = buffer->count.load(std::memory_order_relaxed);
+    if (i >= ThreadBuffer::Capacity)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& e = buffer->events[i];
+    e.name  = name;
+    e.start = start;
+    e.end   = end;
+    buffer->count.store(i + 1, std::memory_order_release);
+}
+
+/* ---------------------------------------------------------------- */
+
+bool Trace::write(const std::string& filePath)
+{
+    std::ofstream file(filePath.c_str());
+    if (!file)
+    {
+        std::cerr << "Failed to open trace file "
+                  << filePath << std::endl;
+        return false;
+    }
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    file << std::fixed << std::setprecision(3)
+         << "{\"traceEvents\":[\n";
+    bool first = true;
+    size_t dropped = 0;
+    for (const std::shared_ptr<ThreadBuffer>& buffer : r.buffers)
+    {
+        const char* threadName =
+            buffer->name.load(std::memory_order_acquire);
+        if (threadName)
+        {
+            file << (first ? "" : ",\n")
+                 << "{\"name\":\"thread_name\",\"ph\":\"M\","
+                 << "\"pid\":1,\"tid\":" << buffer->id << ","
+                 << "\"args\":{\"name\":\"" << threadName << "\"}}";
+            first = false;
+        }
+
+        const size_t count =
+            buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Event& e = buffer->events[i];
+            const double ts = microseconds(e.start, r.epoch);
+            file << (first ? "" : ",\n")
+                 << "{\"name\":\"" << e.name << "\",\"ph\":\"X\","
+                 << "\"pid\":1,\"tid\":" << buffer->id << ","
+                 << "\"ts\":" << ts << ","
+                 << "\"dur\":" << microseconds(e.end, r.epoch) - ts
+                 << "}";
+            first = false;
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    if (dropped > 0)
+        std::cerr << "Trace buffers were full, " << dropped
+                  << " events were dropped" << std::endl;
+
+    return bool(file);
+}
+
+} // namespace kuu
@@ -0,0 +1,132 @@
+/**
+    @file   trace.h
+    @author kuumies <kuumies@gmail.com>
+    @brief  Definition of kuu::Trace class.
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace kuu
+{
+
+/**
+    @brief   A per-thread recorder of timeline events.
+
+    @details The recorder captures time spans of the threads into a
+             single timeline that can be written as Chrome trace event
+             JSON and opened in Perfetto or chrome://tracing.
+
+             Each thread records into its own fixed size buffer so
+             recording an event does not take a lock or wait for the
+             other threads. The buffer of a thread is allocated when
+             the thread records its first event. When the buffer is
+             full the subsequent events of the thread are dropped.
+
+             The recorder is disabled by default. When disabled the
+             @ref KUU_TRACE_SCOPE macro costs a single relaxed atomic
+             load.
+
+    @code
+    void renderFrame()
+    {
+        KUU_TRACE_SCOPE("renderFrame");
+        ...
+    }
+
+    Trace::setEnabled(true);
+    ...
+    Trace::write("trace.json");
+    @endcode
+ **/
+class Trace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+        Records the lifetime of the scope as a span.
+     **/
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name)
+            : name_(Trace::isEnabled() ? name : nullptr)
+        {
+            if (name_)
+                start_ = Clock::now();
+        }
+
+        ~Scope()
+        {
+            if (name_)
+                Trace::record(name_, start_, Clock::now());
+        }
+
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+        const char* name_;
+        Clock::time_point start_;
+    };
+
+    /**
+        Enables or disables the recording. Can be called from any
+        thread.
+     **/
+    static void setEnabled(bool enabled);
+
+    /**
+        Returns true if the recording is enabled.
+     **/
+    static bool isEnabled()
+    { return enabled_.load(std::memory_order_relaxed); }
+
+    /**
+        @brief   Sets the name of the calling thread in the timeline.
+        @details Ignored if the recording is not enabled.
+        @param   name The name, must be a string literal or otherwise
+                      outlive the recorder.
+     **/
+    static void setThreadName(const char* name);
+
+    /**
+        @brief Records a span of the calling thread.
+        @param name  The span name, must be a string literal or
+                     otherwise outlive the recorder.
+        @param start The start time of the span.
+        @param end   The end time of the span.
+     **/
+    static void record(const char* name,
+                       Clock::time_point start,
+                       Clock::time_point end);
+
+    /**
+        @brief   Writes the recorded events as Chrome trace event
+                 JSON.
+        @details Can be called while the threads are recording, the
+                 events recorded after the call has started might not
+                 be included.
+        @return  False if the file could not be written.
+     **/
+    static bool write(const std::string& filePath);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+} // namespace kuu
+
+#define KUU_TRACE_CONCAT_(a, b) a##b
+#define KUU_TRACE_CONCAT(a, b) KUU_TRACE_CONCAT_(a, b)
+
+/**
+    Records the rest of the enclosing scope as a span with the given
+    name.
+ **/
+#define KUU_TRACE_SCOPE(name) \
+    kuu::Trace::Scope KUU_TRACE_CONCAT(traceScope, __LINE__)(name)